@@ -72,13 +72,13 @@ namespace algorithm {
 		return h;
 	}
 
-	size_t hash(const std::string &str) {
+	size_t hash(std::string_view str) {
 		static const size_t seed = 0xc70f6907ul;
-		return murmur_hash(str.c_str(), str.size(), seed);
+		return murmur_hash(str.data(), str.size(), seed);
 	}
 
-	size_t hash_with_seed(const std::string &str, size_t seed) {
-		return murmur_hash(str.c_str(), str.size(), seed);
+	size_t hash_with_seed(std::string_view str, size_t seed) {
+		return murmur_hash(str.data(), str.size(), seed);
 	}
 
 
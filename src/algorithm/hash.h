@@ -25,10 +25,11 @@
  */
 
 #include <string>
+#include <string_view>
 
 namespace algorithm {
 
-	size_t hash(const std::string &str);
-	size_t hash_with_seed(const std::string &str, size_t seed);
+	size_t hash(std::string_view str);
+	size_t hash_with_seed(std::string_view str, size_t seed);
 
 }
@@ -25,9 +25,193 @@
  */
 
 #include "intersection.h"
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace algorithm {
 
+	/*
+	 * Use galloping search when the other array is this many times longer than the candidates.
+	 * */
+	const size_t gallop_ratio = 32;
+
+	inline uint64_t value_at(const sorted_values &arr, size_t i) {
+		uint64_t value;
+		memcpy(&value, &arr.data[i * arr.stride], sizeof(uint64_t));
+		return value;
+	}
+
+	/*
+	 * Returns the first position >= from with a value >= value. Exponential search followed by binary search.
+	 * */
+	size_t gallop(const sorted_values &arr, size_t from, uint64_t value) {
+		size_t lo = from;
+		size_t hi = from;
+		size_t step = 1;
+		while (hi < arr.len && value_at(arr, hi) < value) {
+			lo = hi + 1;
+			hi = from + step;
+			step *= 2;
+		}
+		if (hi > arr.len) hi = arr.len;
+
+		while (lo < hi) {
+			const size_t mid = lo + (hi - lo) / 2;
+			if (value_at(arr, mid) < value) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		return lo;
+	}
+
+	void intersect_gallop(const std::vector<uint64_t> &a, const sorted_values &b, size_t i, size_t j,
+			std::vector<size_t> &pos_a, std::vector<size_t> &pos_b) {
+		for (; i < a.size(); i++) {
+			j = gallop(b, j, a[i]);
+			if (j == b.len) return;
+			if (value_at(b, j) == a[i]) {
+				pos_a.push_back(i);
+				pos_b.push_back(j);
+				j++;
+			}
+		}
+	}
+
+	void intersect_scalar(const std::vector<uint64_t> &a, const sorted_values &b, size_t i, size_t j,
+			std::vector<size_t> &pos_a, std::vector<size_t> &pos_b) {
+		while (i < a.size() && j < b.len) {
+			const uint64_t value = value_at(b, j);
+			if (a[i] < value) {
+				i++;
+			} else if (value < a[i]) {
+				j++;
+			} else {
+				pos_a.push_back(i);
+				pos_b.push_back(j);
+				i++;
+				j++;
+			}
+		}
+	}
+
+#if defined(__x86_64__)
+	/*
+	 * Compares each value in a with a block of four values from b at a time. Since b is sorted we can skip the whole
+	 * block when its last value is smaller than the value from a.
+	 * */
+	__attribute__((target("avx2")))
+	void intersect_avx2(const std::vector<uint64_t> &a, const sorted_values &b, std::vector<size_t> &pos_a,
+			std::vector<size_t> &pos_b) {
+
+		const __m256i offsets = _mm256_set_epi64x(3 * b.stride, 2 * b.stride, b.stride, 0);
+
+		size_t i = 0;
+		size_t j = 0;
+		size_t loaded_j = SIZE_MAX;
+		__m256i block = _mm256_setzero_si256();
+		while (i < a.size() && j + 4 <= b.len) {
+			if (value_at(b, j + 3) < a[i]) {
+				j += 4;
+				continue;
+			}
+			if (loaded_j != j) {
+				const char *ptr = &b.data[j * b.stride];
+				if (b.stride == sizeof(uint64_t)) {
+					block = _mm256_loadu_si256((const __m256i *)ptr);
+				} else {
+					block = _mm256_i64gather_epi64((const long long *)ptr, offsets, 1);
+				}
+				loaded_j = j;
+			}
+			const __m256i equal = _mm256_cmpeq_epi64(_mm256_set1_epi64x(a[i]), block);
+			const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(equal));
+			if (mask) {
+				pos_a.push_back(i);
+				pos_b.push_back(j + __builtin_ctz(mask));
+			}
+			i++;
+		}
+
+		intersect_scalar(a, b, i, j, pos_a, pos_b);
+	}
+
+	bool has_avx2() {
+		static const bool avx2 = __builtin_cpu_supports("avx2");
+		return avx2;
+	}
+#endif
+
+	/*
+	 * Intersects the candidate values a with b, pos_a and pos_b gets the positions of the common values.
+	 * */
+	void intersect(const std::vector<uint64_t> &a, const sorted_values &b, std::vector<size_t> &pos_a,
+			std::vector<size_t> &pos_b) {
+
+		if (a.size() * gallop_ratio < b.len) {
+			intersect_gallop(a, b, 0, 0, pos_a, pos_b);
+			return;
+		}
+
+#if defined(__x86_64__)
+		if (has_avx2()) {
+			intersect_avx2(a, b, pos_a, pos_b);
+			return;
+		}
+#endif
+
+		intersect_scalar(a, b, 0, 0, pos_a, pos_b);
+	}
+
+	std::vector<std::vector<size_t>> intersection_positions(const std::vector<sorted_values> &input) {
+
+		std::vector<std::vector<size_t>> positions(input.size());
+		if (input.size() == 0) return positions;
+
+		size_t shortest = 0;
+		for (size_t i = 0; i < input.size(); i++) {
+			if (input[i].len < input[shortest].len) shortest = i;
+		}
+
+		// Start with all values in the shortest array as candidates and intersect them with one array at a time.
+		std::vector<uint64_t> candidates(input[shortest].len);
+		for (size_t i = 0; i < input[shortest].len; i++) {
+			candidates[i] = value_at(input[shortest], i);
+			positions[shortest].push_back(i);
+		}
+
+		std::vector<size_t> done = {shortest};
+		for (size_t k = 0; k < input.size() && candidates.size(); k++) {
+			if (k == shortest) continue;
+
+			std::vector<size_t> pos_a;
+			std::vector<size_t> pos_b;
+			intersect(candidates, input[k], pos_a, pos_b);
+
+			for (size_t m : done) {
+				std::vector<size_t> kept;
+				for (size_t pos : pos_a) kept.push_back(positions[m][pos]);
+				positions[m] = std::move(kept);
+			}
+
+			std::vector<uint64_t> kept;
+			for (size_t pos : pos_a) kept.push_back(candidates[pos]);
+			candidates = std::move(kept);
+
+			positions[k] = std::move(pos_b);
+			done.push_back(k);
+		}
+
+		if (candidates.size() == 0) {
+			for (auto &vec : positions) vec.clear();
+		}
+
+		return positions;
+	}
+
 	roaring::Roaring intersection(const std::vector<roaring::Roaring> &input) {
 
 		if (input.size() == 0) return roaring::Roaring();
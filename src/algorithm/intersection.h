@@ -27,12 +27,58 @@
 
 #include <vector>
 #include <memory>
+#include <cstddef>
+#include <functional>
 #include "roaring/roaring.hh"
 
 namespace algorithm {
 
 	roaring::Roaring intersection(const std::vector<roaring::Roaring> &input);
 
+	/*
+	 * A sorted array of unique uint64_t values. stride is the distance in bytes between two values so the values
+	 * can be read straight out of an array of records.
+	 * */
+	struct sorted_values {
+		const char *data;
+		size_t len;
+		size_t stride;
+	};
+
+	/*
+	 * Finds the values present in all the arrays. Returns one vector per input array with the positions of the
+	 * common values in that array. Uses galloping search when the arrays differ a lot in length and AVX2 block
+	 * compares otherwise, with a scalar fallback on CPUs without AVX2.
+	 * */
+	std::vector<std::vector<size_t>> intersection_positions(const std::vector<sorted_values> &input);
+
+	/*
+	 * Intersection of record arrays sorted by m_value with unique values, like the pages of a counted_index.
+	 * Returns the records from the shortest array.
+	 * */
+	template<typename item>
+	std::vector<item> value_intersection(const std::vector<std::unique_ptr<item[]>> &input, const std::vector<size_t> &lengths) {
+
+		if (input.size() == 0) return {};
+
+		size_t shortest = 0;
+		std::vector<sorted_values> values;
+		for (size_t i = 0; i < input.size(); i++) {
+			if (lengths[i] == 0) return {};
+			if (lengths[i] < lengths[shortest]) shortest = i;
+			values.push_back(sorted_values{(const char *)input[i].get() + offsetof(item, m_value), lengths[i], sizeof(item)});
+		}
+
+		std::vector<std::vector<size_t>> positions = intersection_positions(values);
+
+		std::vector<item> intersection;
+		for (size_t pos : positions[shortest]) {
+			intersection.push_back(input[shortest][pos]);
+		}
+
+		return intersection;
+	}
+
 	template<typename item>
 	std::vector<item> intersection(const std::vector<std::vector<item>> &input,
 		std::function<void(item &a, const item &b)> sum_fun) {
@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace algorithm {
+
+	/*
+	 * Tournament tree of losers for k-way merges. Each leaf points to the current head of one input or is nullptr
+	 * when the input is exhausted. The winner is the smallest head according to compare, equal heads are won by the
+	 * lowest leaf index. Replacing the winner costs log2(k) comparisons.
+	 * */
+	template<typename value_type, typename compare_type>
+	class loser_tree {
+
+	public:
+
+		loser_tree(size_t k, compare_type compare)
+		: m_compare(compare) {
+			m_size = 1;
+			while (m_size < k) m_size <<= 1;
+			m_heads.resize(m_size, nullptr);
+			m_tree.resize(m_size, 0);
+		}
+
+		void set(size_t leaf, const value_type *head) {
+			m_heads[leaf] = head;
+		}
+
+		/*
+		 * Builds the tree after all leaves have been set.
+		 * */
+		void build() {
+			std::vector<size_t> winners(m_size * 2);
+			for (size_t i = 0; i < m_size; i++) winners[m_size + i] = i;
+			for (size_t node = m_size - 1; node > 0; node--) {
+				const size_t a = winners[node * 2];
+				const size_t b = winners[node * 2 + 1];
+				if (better(a, b)) {
+					winners[node] = a;
+					m_tree[node] = b;
+				} else {
+					winners[node] = b;
+					m_tree[node] = a;
+				}
+			}
+			m_tree[0] = m_size > 1 ? winners[1] : 0;
+		}
+
+		size_t winner() const {
+			return m_tree[0];
+		}
+
+		/*
+		 * Returns the head of the winning leaf, nullptr when all inputs are exhausted.
+		 * */
+		const value_type *winner_head() const {
+			return m_heads[m_tree[0]];
+		}
+
+		/*
+		 * Sets a new head for the winning leaf and plays its way back up the tree.
+		 * */
+		void replace_winner(const value_type *head) {
+			size_t w = m_tree[0];
+			m_heads[w] = head;
+			for (size_t node = (w + m_size) >> 1; node > 0; node >>= 1) {
+				if (better(m_tree[node], w)) {
+					std::swap(m_tree[node], w);
+				}
+			}
+			m_tree[0] = w;
+		}
+
+	private:
+
+		compare_type m_compare;
+		size_t m_size;
+		std::vector<const value_type *> m_heads;
+		std::vector<size_t> m_tree;
+
+		bool better(size_t a, size_t b) const {
+			const value_type *ha = m_heads[a];
+			const value_type *hb = m_heads[b];
+			if (hb == nullptr) return ha != nullptr || a < b;
+			if (ha == nullptr) return false;
+			return a < b ? !m_compare(*hb, *ha) : m_compare(*ha, *hb);
+		}
+
+	};
+
+}
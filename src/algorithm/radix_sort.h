@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+namespace algorithm {
+
+	/*
+	 * Stable LSD radix sort of items by the uint64_t returned by key_of, one byte per pass. All byte histograms are
+	 * counted in a single pass first so bytes that are equal for all items are skipped. tmp is used as scratch
+	 * space and is resized to the size of items.
+	 * */
+	template<typename item, typename F>
+	void radix_sort(std::vector<item> &items, std::vector<item> &tmp, F key_of) {
+
+		const size_t n = items.size();
+		if (n < 2) return;
+
+		std::vector<std::array<size_t, 256>> counts(8);
+		for (auto &count : counts) count.fill(0);
+
+		for (const item &it : items) {
+			const uint64_t key = key_of(it);
+			for (size_t b = 0; b < 8; b++) {
+				counts[b][(key >> (b * 8)) & 0xff]++;
+			}
+		}
+
+		tmp.resize(n);
+
+		for (size_t b = 0; b < 8; b++) {
+			std::array<size_t, 256> &count = counts[b];
+
+			bool skip = false;
+			for (size_t c : count) {
+				if (c == n) {
+					skip = true;
+					break;
+				}
+				if (c) break;
+			}
+			if (skip) continue;
+
+			size_t offset = 0;
+			for (size_t &c : count) {
+				const size_t num = c;
+				c = offset;
+				offset += num;
+			}
+
+			for (const item &it : items) {
+				tmp[count[(key_of(it) >> (b * 8)) & 0xff]++] = it;
+			}
+			items.swap(tmp);
+		}
+	}
+
+}
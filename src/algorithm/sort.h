@@ -28,6 +28,7 @@
 
 #include <vector>
 #include <span>
+#include "loser_tree.h"
 
 namespace algorithm {
 
@@ -81,54 +82,53 @@ namespace algorithm {
 			}, res);
 		}
 
-		template<typename data_record, typename F>
-		void merge_array_range(const std::vector<std::vector<data_record>> &arrays, size_t i, size_t j, F compare, std::vector<data_record> &res) {
-			if (i == j) {
-				for (const data_record &rec : arrays[i]) {
-					res.push_back(rec);
-				}
-			} else if (j - i == 1) {
-				merge_arrays(arrays[i], arrays[j], compare, res);
-			} else {
-				std::vector<data_record> out1;
-				std::vector<data_record> out2;
+		/*
+		 * k-way merge of the arrays returned by get_array(0) ... get_array(k - 1) into res using a loser tree. On
+		 * equal elements the array with the highest index goes first which is the order the old pairwise merge
+		 * produced, so leaf i of the tree holds array k - 1 - i.
+		 * */
+		template<typename data_record, typename A, typename F>
+		void merge_k_arrays(size_t k, A get_array, F compare, std::vector<data_record> &res) {
+			if (k == 0) return;
+
+			size_t total = 0;
+			for (size_t i = 0; i < k; i++) total += get_array(i).size();
+			res.reserve(res.size() + total);
+
+			if (k == 1) {
+				const auto &arr = get_array(0);
+				res.insert(res.end(), arr.begin(), arr.end());
+				return;
+			}
 
-				merge_array_range(arrays, i, (i + j)/2, compare, out1);
-				merge_array_range(arrays, (i + j)/2 + 1, j, compare, out2);
+			std::vector<const data_record *> ends(k);
+			loser_tree<data_record, F> tree(k, compare);
+			for (size_t i = 0; i < k; i++) {
+				const auto &arr = get_array(k - 1 - i);
+				ends[i] = arr.data() + arr.size();
+				tree.set(i, arr.size() ? arr.data() : nullptr);
+			}
+			tree.build();
 
-				merge_arrays(out1, out2, compare, res);
+			while (const data_record *head = tree.winner_head()) {
+				res.push_back(*head);
+				head++;
+				tree.replace_winner(head != ends[tree.winner()] ? head : nullptr);
 			}
 		}
 
 		template<typename data_record, typename F>
 		void merge_arrays(const std::vector<std::vector<data_record>> &arrays, F compare, std::vector<data_record> &res) {
-			if (arrays.size() == 0) return;
-			merge_array_range(arrays, 0, arrays.size() - 1, compare, res);
-		}
-
-		template<typename data_record, typename F>
-		void merge_array_range(const std::vector<std::span<data_record> *> &arrays, size_t i, size_t j, F compare, std::vector<data_record> &res) {
-			if (i == j) {
-				for (const data_record &rec : *(arrays[i])) {
-					res.push_back(rec);
-				}
-			} else if (j - i == 1) {
-				merge_arrays(arrays[i], arrays[j], compare, res);
-			} else {
-				std::vector<data_record> out1;
-				std::vector<data_record> out2;
-
-				merge_array_range(arrays, i, (i + j)/2, compare, out1);
-				merge_array_range(arrays, (i + j)/2 + 1, j, compare, out2);
-
-				merge_arrays(out1, out2, compare, res);
-			}
+			merge_k_arrays<data_record>(arrays.size(), [&arrays](size_t i) -> const std::vector<data_record> & {
+				return arrays[i];
+			}, compare, res);
 		}
 
 		template<typename data_record, typename F>
 		void merge_arrays(const std::vector<std::span<data_record> *> &arrays, F compare, std::vector<data_record> &res) {
-			if (arrays.size() == 0) return;
-			merge_array_range(arrays, 0, arrays.size() - 1, compare, res);
+			merge_k_arrays<data_record>(arrays.size(), [&arrays](size_t i) -> const std::span<data_record> & {
+				return *(arrays[i]);
+			}, compare, res);
 		}
 	
 	}
@@ -28,17 +28,23 @@
 
 #include <vector>
 #include <functional>
+#include "loser_tree.h"
 
 namespace algorithm {
 
+	/*
+	 * Below this number of inputs a linear scan over the heads is faster than the loser tree, see benchmark_merge.
+	 * */
+	const size_t sum_sorted_tree_min_inputs = 32;
+
+	/*
+	 * Finds the smallest head by scanning all inputs, O(n k).
+	 * */
 	template<class dtype>
-	std::vector<dtype> sum_sorted(const std::vector<std::vector<dtype>> &input,
-			std::function<void(dtype &a, const dtype &b)> plus_eq) {
+	void sum_sorted_scan(const std::vector<std::vector<dtype>> &input,
+			std::function<void(dtype &a, const dtype &b)> plus_eq, std::vector<dtype> &ret) {
 
 		const size_t n = input.size();
-		if (n == 0) return {};
-
-		std::vector<dtype> ret;
 		std::vector<size_t> pos(n, 0);
 		
 		while (true) {
@@ -74,6 +80,84 @@ namespace algorithm {
 			}
 			ret.push_back(sum);
 		}
+	}
+
+	/*
+	 * Finds the smallest head with a loser tree, O(n log k).
+	 * */
+	template<class dtype>
+	void sum_sorted_tree(const std::vector<std::vector<dtype>> &input,
+			std::function<void(dtype &a, const dtype &b)> plus_eq, std::vector<dtype> &ret) {
+
+		const size_t n = input.size();
+		auto less = [](const dtype &a, const dtype &b) {
+			return a < b;
+		};
+		loser_tree<dtype, decltype(less)> tree(n, less);
+		std::vector<size_t> pos(n, 0);
+		for (size_t i = 0; i < n; i++) {
+			tree.set(i, input[i].size() ? input[i].data() : nullptr);
+		}
+		tree.build();
+
+		/*
+		 * Vectors whose next element is equal to the one just summed are held back until the sum is done so they
+		 * do not contribute twice.
+		 * */
+		std::vector<size_t> held;
+
+		while (const dtype *head = tree.winner_head()) {
+			const dtype el = *head;
+			dtype sum = el;
+			bool first = true;
+			while ((head = tree.winner_head()) && !(el < *head)) {
+				const size_t idx = tree.winner();
+				if (!first) plus_eq(sum, *head);
+				first = false;
+
+				const dtype *next = ++pos[idx] < input[idx].size() ? &input[idx][pos[idx]] : nullptr;
+				if (next && !(el < *next)) {
+					held.push_back(idx);
+					next = nullptr;
+				}
+				tree.replace_winner(next);
+			}
+			ret.push_back(sum);
+
+			if (held.size()) {
+				for (size_t idx : held) {
+					tree.set(idx, &input[idx][pos[idx]]);
+				}
+				held.clear();
+				tree.build();
+			}
+		}
+	}
+
+	/*
+	 * Merges k sorted vectors and sums elements that are equal across vectors. Each vector contributes at most one
+	 * element to each sum and the elements are added in vector order, starting from the first vector that holds the
+	 * value. The output is allocated once up front.
+	 * */
+	template<class dtype>
+	std::vector<dtype> sum_sorted(const std::vector<std::vector<dtype>> &input,
+			std::function<void(dtype &a, const dtype &b)> plus_eq) {
+
+		const size_t n = input.size();
+		if (n == 0) return {};
+		if (n == 1) return input[0];
+
+		size_t total = 0;
+		for (const auto &vec : input) total += vec.size();
+
+		std::vector<dtype> ret;
+		ret.reserve(total);
+
+		if (n < sum_sorted_tree_min_inputs) {
+			sum_sorted_scan(input, plus_eq, ret);
+		} else {
+			sum_sorted_tree(input, plus_eq, ret);
+		}
 		return ret;
 	}
 
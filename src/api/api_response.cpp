@@ -26,51 +26,87 @@
 
 #include "api_response.h"
 #include "api/result_with_snippet.h"
+#include "api/json_writer.h"
 #include "full_text/search_metric.h"
 #include "parser/unicode.h"
-#include "json.hpp"
 
 using namespace std;
-using json = nlohmann::ordered_json;
 
 namespace api {
 
+	/*
+	 * The response is written as compact JSON straight into m_response, the keys come in the same order as before.
+	 * */
 	api_response::api_response(vector<result_with_snippet> &results, const struct full_text::search_metric &metric, double profile) {
 
-		json message;
+		m_response.reserve(512 + results.size() * 512);
+		json_writer writer(m_response);
 
-		json result_array;
-		for (const result_with_snippet &result : results) {
-			json json_result;
+		writer.begin_object();
+		writer.key("status");
+		writer.value("success");
+		writer.key("time_ms");
+		writer.value(profile);
+		writer.key("total_found");
+		writer.value(metric.m_total_found);
+		writer.key("total_url_links_found");
+		writer.value(metric.m_total_url_links_found);
+		writer.key("total_domain_links_found");
+		writer.value(metric.m_total_domain_links_found);
+		writer.key("links_handled");
+		writer.value(metric.m_links_handled);
+		writer.key("link_domain_matches");
+		writer.value(metric.m_link_domain_matches);
+		writer.key("link_url_matches");
+		writer.value(metric.m_link_url_matches);
 
-			json_result["url"] = result.url().str();
-			json_result["title"] = parser::unicode::encode(result.title());
-			json_result["snippet"] = parser::unicode::encode(result.snippet());
-			json_result["score"] = result.score();
-			json_result["domain_hash"] = to_string(result.domain_hash());
-			json_result["url_hash"] = to_string(result.url().hash());
-
-			result_array.push_back(json_result);
+		// An empty result list has always been null.
+		writer.key("results");
+		if (results.empty()) {
+			writer.null();
+		} else {
+			writer.begin_array();
+			for (const result_with_snippet &result : results) {
+				writer.begin_object();
+				writer.key("url");
+				writer.value(result.url().str());
+				writer.key("title");
+				writer.value(parser::unicode::encode(result.title()));
+				writer.key("snippet");
+				writer.value(parser::unicode::encode(result.snippet()));
+				writer.key("score");
+				writer.value((double)result.score());
+				writer.key("domain_hash");
+				writer.value(to_string(result.domain_hash()));
+				writer.key("url_hash");
+				writer.value(to_string(result.url().hash()));
+				writer.end_object();
+			}
+			writer.end_array();
 		}
 
-		message["status"] = "success";
-		message["time_ms"] = profile;
-		message["total_found"] = metric.m_total_found;
-		message["total_url_links_found"] = metric.m_total_url_links_found;
-		message["total_domain_links_found"] = metric.m_total_domain_links_found;
-		message["links_handled"] = metric.m_links_handled;
-		message["link_domain_matches"] = metric.m_link_domain_matches;
-		message["link_url_matches"] = metric.m_link_url_matches;
-		message["results"] = result_array;
-
-		//m_response = message.dump();
-		m_response = message.dump(4);
+		writer.end_object();
 	}
 
 	api_response::~api_response() {
 
 	}
 
+	std::string api_response::with_time_ms(const std::string &response, double profile) {
+		// time_ms is the second key so the first match is ours, the value is a number and ends at the next comma.
+		const std::string key = "\"time_ms\":";
+		const size_t value_start = response.find(key);
+		if (value_start == std::string::npos) return response;
+		const size_t value_end = response.find(',', value_start + key.size());
+		if (value_end == std::string::npos) return response;
+
+		std::string out = response.substr(0, value_start + key.size());
+		json_writer writer(out);
+		writer.value(profile);
+		out.append(response, value_end);
+		return out;
+	}
+
 	ostream &operator<<(ostream &os, const api_response &api_response) {
 		os << api_response.m_response;
 		return os;
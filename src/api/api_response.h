@@ -43,6 +43,11 @@ namespace api {
 			api_response(std::vector<result_with_snippet> &results, const struct full_text::search_metric &metric, double profile);
 			~api_response();
 
+			/*
+			 * Returns a response written by api_response with time_ms replaced, used for responses served from a cache.
+			 * */
+			static std::string with_time_ms(const std::string &response, double profile);
+
 			friend std::ostream &operator<<(std::ostream &os, const api_response &api_response);
 
 		private:
@@ -0,0 +1,185 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "json_writer.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace api {
+
+	json_writer::json_writer(std::string &out)
+	: m_out(out) {
+	}
+
+	void json_writer::begin_object() {
+		separator();
+		m_out += '{';
+		m_need_comma = false;
+	}
+
+	void json_writer::end_object() {
+		m_out += '}';
+		m_need_comma = true;
+	}
+
+	void json_writer::begin_array() {
+		separator();
+		m_out += '[';
+		m_need_comma = false;
+	}
+
+	void json_writer::end_array() {
+		m_out += ']';
+		m_need_comma = true;
+	}
+
+	void json_writer::key(std::string_view key) {
+		separator();
+		write_string(key);
+		m_out += ':';
+		m_need_comma = false;
+	}
+
+	void json_writer::value(std::string_view str) {
+		separator();
+		write_string(str);
+		m_need_comma = true;
+	}
+
+	void json_writer::value(size_t number) {
+		separator();
+		char buffer[24];
+		const auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+		m_out.append(buffer, result.ptr - buffer);
+		m_need_comma = true;
+	}
+
+	/*
+	 * Shortest representation that reads back as the same double, formatted like nlohmann::json: plain decimal
+	 * notation for decimal exponents in (-4, 15] with ".0" added to whole numbers, otherwise d.ddde+XX. nlohmann
+	 * (Grisu2) sometimes picks another last digit, both read back as the same value.
+	 * */
+	void json_writer::value(double number) {
+		separator();
+		m_need_comma = true;
+
+		if (!std::isfinite(number)) {
+			m_out += "null";
+			return;
+		}
+		if (number == 0.0) {
+			m_out += std::signbit(number) ? "-0.0" : "0.0";
+			return;
+		}
+
+		char buffer[32];
+		const auto result = std::to_chars(buffer, buffer + sizeof(buffer), number, std::chars_format::scientific);
+		const char *end = result.ptr;
+		const char *exponent_pos = (const char *)memchr(buffer, 'e', end - buffer);
+		int exponent = 0;
+		std::from_chars(exponent_pos + (exponent_pos[1] == '+' ? 2 : 1), end, exponent);
+
+		if (buffer[0] == '-') m_out += '-';
+		const char *first = buffer[0] == '-' ? buffer + 1 : buffer;
+
+		char digits[32];
+		size_t num_digits = 0;
+		for (const char *c = first; c < exponent_pos; c++) {
+			if (*c != '.') digits[num_digits++] = *c;
+		}
+
+		// The decimal point goes after the first n digits.
+		const int n = exponent + 1;
+		if (n > 0 && n <= 15) {
+			if ((size_t)n >= num_digits) {
+				m_out.append(digits, num_digits);
+				m_out.append(n - num_digits, '0');
+				m_out += ".0";
+			} else {
+				m_out.append(digits, n);
+				m_out += '.';
+				m_out.append(digits + n, num_digits - n);
+			}
+		} else if (n <= 0 && n > -4) {
+			m_out += "0.";
+			m_out.append(-n, '0');
+			m_out.append(digits, num_digits);
+		} else {
+			m_out += digits[0];
+			if (num_digits > 1) {
+				m_out += '.';
+				m_out.append(digits + 1, num_digits - 1);
+			}
+			char exponent_str[16];
+			snprintf(exponent_str, sizeof(exponent_str), "e%c%02d", exponent < 0 ? '-' : '+', std::abs(exponent));
+			m_out += exponent_str;
+		}
+	}
+
+	void json_writer::null() {
+		separator();
+		m_out += "null";
+		m_need_comma = true;
+	}
+
+	void json_writer::separator() {
+		if (m_need_comma) m_out += ',';
+	}
+
+	/*
+	 * Copies runs of characters that need no escaping in one append.
+	 * */
+	void json_writer::write_string(std::string_view str) {
+		m_out.reserve(m_out.size() + str.size() + 2);
+		m_out += '"';
+		size_t run_start = 0;
+		for (size_t i = 0; i < str.size(); i++) {
+			const unsigned char c = str[i];
+			if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+			m_out.append(str.data() + run_start, i - run_start);
+			run_start = i + 1;
+			switch (c) {
+				case '"': m_out += "\\\""; break;
+				case '\\': m_out += "\\\\"; break;
+				case '\b': m_out += "\\b"; break;
+				case '\f': m_out += "\\f"; break;
+				case '\n': m_out += "\\n"; break;
+				case '\r': m_out += "\\r"; break;
+				case '\t': m_out += "\\t"; break;
+				default: {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					m_out += escaped;
+				}
+			}
+		}
+		m_out.append(str.data() + run_start, str.size() - run_start);
+		m_out += '"';
+	}
+
+}
@@ -0,0 +1,66 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace api {
+
+	/*
+		Writes compact JSON straight into a string without building a document first. The caller writes the values in
+		order and the writer adds the separators. The output is the same as nlohmann::json::dump() for the same values,
+		except for the last digit of some doubles.
+	*/
+	class json_writer {
+
+		public:
+
+			explicit json_writer(std::string &out);
+
+			void begin_object();
+			void end_object();
+			void begin_array();
+			void end_array();
+
+			void key(std::string_view key);
+			void value(std::string_view str);
+			void value(size_t number);
+			void value(double number);
+			void null();
+
+		private:
+
+			std::string &m_out;
+			bool m_need_comma = false;
+
+			void separator();
+			void write_string(std::string_view str);
+
+	};
+
+}
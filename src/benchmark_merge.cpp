@@ -0,0 +1,125 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compares the linear scan and loser tree versions of sum_sorted and the loser tree merge_arrays with the pairwise
+ * merge it replaced. Run with ./benchmark_merge [records per input]
+ * */
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include "algorithm/sum_sorted.h"
+#include "algorithm/sort.h"
+#include "indexer/counted_record.h"
+
+using namespace std;
+using indexer::counted_record;
+
+namespace reference {
+
+	/*
+	 * The previous merge_arrays, merges recursively in pairs.
+	 * */
+	void merge_range(const vector<vector<counted_record>> &arrays, size_t i, size_t j, vector<counted_record> &res) {
+		if (i == j) {
+			res.insert(res.end(), arrays[i].begin(), arrays[i].end());
+		} else if (j - i == 1) {
+			::algorithm::sort::merge_arrays(arrays[i], arrays[j], res);
+		} else {
+			vector<counted_record> out1;
+			vector<counted_record> out2;
+			merge_range(arrays, i, (i + j) / 2, out1);
+			merge_range(arrays, (i + j) / 2 + 1, j, out2);
+			::algorithm::sort::merge_arrays(out1, out2, res);
+		}
+	}
+
+}
+
+template<typename F>
+double time_ms(F f, size_t iterations) {
+	auto start = chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < iterations; i++) f();
+	auto elapsed = chrono::high_resolution_clock::now() - start;
+	return chrono::duration_cast<chrono::microseconds>(elapsed).count() / 1000.0 / iterations;
+}
+
+int main(int argc, const char **argv) {
+
+	const size_t records_per_input = argc > 1 ? stoull(argv[1]) : 10000;
+
+	mt19937_64 gen(42);
+
+	cout << "k\tsum_sorted_scan\tsum_sorted_tree\tmerge_pairwise\tmerge_tree (ms)" << endl;
+
+	for (size_t k = 2; k <= 256; k *= 2) {
+		vector<vector<counted_record>> input(k);
+		for (auto &vec : input) {
+			uniform_int_distribution<uint64_t> dist(0, records_per_input * k);
+			for (size_t i = 0; i < records_per_input; i++) {
+				vec.emplace_back(counted_record(dist(gen), 1.0f));
+			}
+			sort(vec.begin(), vec.end());
+			vec.erase(unique(vec.begin(), vec.end()), vec.end());
+		}
+
+		const size_t iterations = max<size_t>(1, 64 / k);
+		size_t check = 0;
+
+		auto plus_eq = [](counted_record &a, const counted_record &b) {
+			a.m_score += b.m_score;
+		};
+		const double sum_scan = time_ms([&]() {
+			vector<counted_record> res;
+			::algorithm::sum_sorted_scan<counted_record>(input, plus_eq, res);
+			check += res.size();
+		}, iterations);
+		const double sum_tree = time_ms([&]() {
+			vector<counted_record> res;
+			::algorithm::sum_sorted_tree<counted_record>(input, plus_eq, res);
+			check += res.size();
+		}, iterations);
+		const double merge_pairwise = time_ms([&]() {
+			vector<counted_record> res;
+			reference::merge_range(input, 0, k - 1, res);
+			check += res.size();
+		}, iterations);
+		const double merge_tree = time_ms([&]() {
+			vector<counted_record> res;
+			::algorithm::sort::merge_arrays(input, res);
+			check += res.size();
+		}, iterations);
+
+		cout << k << "\t" << sum_scan << "\t" << sum_tree << "\t" << merge_pairwise << "\t" << merge_tree
+			<< "\t(" << check << ")" << endl;
+	}
+
+	return 0;
+}
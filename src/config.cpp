@@ -87,6 +87,21 @@ namespace config {
 	size_t shard_hash_table_size = 100000;
 	size_t html_parser_long_text_len = 1000;
 	size_t ft_shard_builder_buffer_len = 240000;
+	size_t index_reader_cache_size = 256;
+	bool index_compress_pages = false;
+	size_t index_merge_memory_mb = 4096;
+	bool ht_dictionary_compression = false;
+	size_t search_snippet_cache_mb = 256;
+	size_t search_result_cache_mb = 64;
+	size_t search_result_cache_ttl = 300;
+	string http_frontend = "fastcgi";
+	size_t http_port = 8000;
+	size_t http_max_body_mb = 1024;
+	vector<string> url_servers;
+	size_t url_server_timeout_ms = 5000;
+	size_t url_server_cache_mb = 4096;
+	size_t url_server_cache_entries = 16384;
+	size_t url_server_threads = 32;
 
 	size_t ft_num_shards = 2048;
 	size_t ft_max_sections = 8;
@@ -192,6 +207,36 @@ namespace config {
 				shard_hash_table_size = stoull(parts[1]);
 			} else if (parts[0] == "html_parser_long_text_len") {
 				html_parser_long_text_len = stoull(parts[1]);
+			} else if (parts[0] == "index_reader_cache_size") {
+				index_reader_cache_size = stoull(parts[1]);
+			} else if (parts[0] == "index_compress_pages") {
+				index_compress_pages = static_cast<bool>(stoull(parts[1]));
+			} else if (parts[0] == "index_merge_memory_mb") {
+				index_merge_memory_mb = stoull(parts[1]);
+			} else if (parts[0] == "ht_dictionary_compression") {
+				ht_dictionary_compression = static_cast<bool>(stoull(parts[1]));
+			} else if (parts[0] == "search_snippet_cache_mb") {
+				search_snippet_cache_mb = stoull(parts[1]);
+			} else if (parts[0] == "search_result_cache_mb") {
+				search_result_cache_mb = stoull(parts[1]);
+			} else if (parts[0] == "search_result_cache_ttl") {
+				search_result_cache_ttl = stoull(parts[1]);
+			} else if (parts[0] == "http_frontend") {
+				http_frontend = parts[1];
+			} else if (parts[0] == "http_port") {
+				http_port = stoull(parts[1]);
+			} else if (parts[0] == "http_max_body_mb") {
+				http_max_body_mb = stoull(parts[1]);
+			} else if (parts[0] == "url_servers[]") {
+				url_servers.push_back(parts[1]);
+			} else if (parts[0] == "url_server_timeout_ms") {
+				url_server_timeout_ms = stoull(parts[1]);
+			} else if (parts[0] == "url_server_cache_mb") {
+				url_server_cache_mb = stoull(parts[1]);
+			} else if (parts[0] == "url_server_cache_entries") {
+				url_server_cache_entries = stoull(parts[1]);
+			} else if (parts[0] == "url_server_threads") {
+				url_server_threads = stoull(parts[1]);
 			} else if (parts[0] == "data_path") {
 				s_instance.data_path(parts[1]);
 			}
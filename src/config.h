@@ -82,6 +82,21 @@ namespace config {
 	extern size_t shard_hash_table_size;
 	extern size_t html_parser_long_text_len;
 	extern size_t ft_shard_builder_buffer_len;
+	extern size_t index_reader_cache_size;
+	extern bool index_compress_pages;
+	extern size_t index_merge_memory_mb;
+	extern bool ht_dictionary_compression;
+	extern size_t search_snippet_cache_mb;
+	extern size_t search_result_cache_mb;
+	extern size_t search_result_cache_ttl;
+	extern std::string http_frontend;
+	extern size_t http_port;
+	extern size_t http_max_body_mb;
+	extern std::vector<std::string> url_servers;
+	extern size_t url_server_timeout_ms;
+	extern size_t url_server_cache_mb;
+	extern size_t url_server_cache_entries;
+	extern size_t url_server_threads;
 
 	/*
 		Constants only configurable at compilation time.
@@ -29,6 +29,7 @@
 #include "config.h"
 #include "common/datetime.h"
 #include "warc/warc.h"
+#include "warc/pipeline.h"
 #include "utils/thread_pool.hpp"
 #include "utils/id_allocator.h"
 #include "file/archive.h"
@@ -47,66 +48,50 @@ using namespace std;
 
 namespace downloader {
 
-	void run_downloader(const string &warc_path, utils::id_allocator<indexer::index_builder<indexer::value_record>> &internal_link_allocator,
-			std::unordered_map<uint64_t, indexer::index_builder<indexer::value_record> *> &internal_link_cache, hash_table2::builder &ht) {
-
-		std::string all_links;
-
-		warc::parser pp;
-		warc::multipart_download("http://data.commoncrawl.org/" + warc_path, [&pp, &ht, &internal_link_cache, &internal_link_allocator, &all_links](const string &chunk) {
-			stringstream ss(chunk);
-			pp.parse_stream(ss, [&ht, &internal_link_cache, &internal_link_allocator, &all_links](const string &url_str, const parser::html_parser &html, const std::string &ip, const std::string &date) {
-					URL url(url_str);
-					std::tm t = {};
-					std::istringstream ss(date);
-					ss >> std::get_time(&t, "%Y-%m-%dT%H:%M:%SZ");
-					size_t time = (t.tm_year + 1900) * 10000000000ull + (t.tm_mon + 1) * 100000000ull + (t.tm_mday) * 1000000ull + (t.tm_hour) * 10000ull + (t.tm_min) * 100ull + t.tm_sec;
-
-					uint64_t host_hash = url.host_hash();
-					if (!internal_link_cache.count(host_hash)) {
-						internal_link_cache[host_hash] = internal_link_allocator.get(host_hash, "internal_links", host_hash, 1000);
-					}
-					auto internal_link_builder = internal_link_cache[host_hash];
-
-					const std::string data = (url.str()
-						+ '\t' + html.title()
-						+ '\t' + html.h1()
-						+ '\t' + html.meta()
-						+ '\t' + html.text()
-						+ '\t' + date
-						+ '\t' + ip
-						+ '\n');
-
-					ht.add(url.hash(), data, time);
-
-					for (const auto &link : html.links()) {
-						all_links += (link.host()
-							+ '\t' + link.path()
-							+ '\t' + link.target_host()
-							+ '\t' + link.target_path()
-							+ '\t' + link.text()
-							+ '\t' + (link.nofollow() ? "1" : "0")
-							+ '\n');
-					}
-
-					for (const auto &link : html.internal_links()) {
-						// link is a std::pair<uint64_t, uint64_t> link_from -> link_to
-						// but we store the internal links as link_to -> link_from because the hyper_ball algorithm requires it.
-						// see src/algorithm/hyper_ball.h
-						internal_link_builder->add(link.second, indexer::value_record(link.first));
-					}
-			});
-		});
+	void write_page(const warc::page &page, hash_table2::builder &ht,
+			utils::id_allocator<indexer::index_builder<indexer::value_record>> &internal_link_allocator,
+			std::unordered_map<uint64_t, indexer::index_builder<indexer::value_record> *> &internal_link_cache,
+			std::string &links) {
 
-		LOG_INFO("uploading: " + warc_path);
-		int error;
-		//error = transfer::upload_gz_file(warc::get_result_path(warc_path), pp.result());
-		error = transfer::upload_gz_file(warc::get_link_result_path(warc_path), all_links);
+		URL url(page.m_url);
+		std::tm t = {};
+		std::istringstream ss(page.m_date);
+		ss >> std::get_time(&t, "%Y-%m-%dT%H:%M:%SZ");
+		size_t time = (t.tm_year + 1900) * 10000000000ull + (t.tm_mon + 1) * 100000000ull + (t.tm_mday) * 1000000ull + (t.tm_hour) * 10000ull + (t.tm_min) * 100ull + t.tm_sec;
 
-		if (error) {
-			LOG_INFO("error uploading: " + warc_path);
+		uint64_t host_hash = url.host_hash();
+		if (!internal_link_cache.count(host_hash)) {
+			internal_link_cache[host_hash] = internal_link_allocator.get(host_hash, "internal_links", host_hash, 1000);
+		}
+		auto internal_link_builder = internal_link_cache[host_hash];
+
+		const std::string data = (url.str()
+			+ '\t' + page.m_title
+			+ '\t' + page.m_h1
+			+ '\t' + page.m_meta
+			+ '\t' + page.m_text
+			+ '\t' + page.m_date
+			+ '\t' + page.m_ip
+			+ '\n');
+
+		ht.add(url.hash(), data, time);
+
+		for (const auto &link : page.m_links) {
+			links += (link.host()
+				+ '\t' + link.path()
+				+ '\t' + link.target_host()
+				+ '\t' + link.target_path()
+				+ '\t' + link.text()
+				+ '\t' + (link.nofollow() ? "1" : "0")
+				+ '\n');
 		}
 
+		for (const auto &link : page.m_internal_links) {
+			// link is a std::pair<uint64_t, uint64_t> link_from -> link_to
+			// but we store the internal links as link_to -> link_from because the hyper_ball algorithm requires it.
+			// see src/algorithm/hyper_ball.h
+			internal_link_builder->add(link.second, indexer::value_record(link.first));
+		}
 	}
 
 	vector<string> download_warc_paths() {
@@ -143,30 +128,43 @@ namespace downloader {
 		indexer::merger::set_mem_limit(0.1);
 		indexer::merger::start_merge_thread();
 
-		const size_t num_threads = 24;
-
-		std::vector<std::vector<std::string>> chunks;
-		algorithm::vector_chunk<std::string>(warc_paths, std::ceil(warc_paths.size() / num_threads) + 1, chunks);
-
-		utils::thread_pool pool(num_threads);
-
 		hash_table2::builder ht("crawl_index", 1019);
 		ht.truncate();
 		utils::id_allocator<indexer::index_builder<indexer::value_record>> internal_link_allocator;
 
-		for (const auto &chunk : chunks) {
-			pool.enqueue([chunk, &ht, &internal_link_allocator] {
-				std::unordered_map<uint64_t, indexer::index_builder<indexer::value_record> *> internal_link_cache;
-				size_t count = 0;
-				for (const auto &warc_path : chunk) {
-					run_downloader(warc_path, internal_link_allocator, internal_link_cache, ht);
-					count++;
-					std::cout << "done with " << warc_path << " done with " << count << "/" << chunk.size() << std::endl;
-				}
-			});
-		}
+		warc::http_source source("http://data.commoncrawl.org/");
+		warc::pipeline::options options;
+		warc::pipeline pipeline(source, options);
+
+		// Every writer thread keeps its own cache of internal link builders, the links of a file can be written by
+		// several writers so they are collected under a lock per file.
+		std::vector<std::unordered_map<uint64_t, indexer::index_builder<indexer::value_record> *>> internal_link_caches(
+			options.m_write_threads);
+		std::vector<std::string> all_links(warc_paths.size());
+		std::vector<std::mutex> all_links_locks(warc_paths.size());
+		std::atomic<size_t> num_done = 0;
+
+		pipeline.run(warc_paths, [&](size_t writer_id, const warc::page &page) {
+			std::string links;
+			write_page(page, ht, internal_link_allocator, internal_link_caches[writer_id], links);
+
+			std::lock_guard lock(all_links_locks[page.m_file]);
+			all_links[page.m_file] += links;
+		}, [&](size_t file) {
+			const std::string &warc_path = warc_paths[file];
+			std::string links;
+			{
+				std::lock_guard lock(all_links_locks[file]);
+				links.swap(all_links[file]);
+			}
 
-		pool.run_all();
+			LOG_INFO("uploading: " + warc_path);
+			int error = transfer::upload_gz_file(warc::get_link_result_path(warc_path), links);
+			if (error) {
+				LOG_INFO("error uploading: " + warc_path);
+			}
+			std::cout << "done with " << warc_path << " done with " << ++num_done << "/" << warc_paths.size() << std::endl;
+		});
 
 		indexer::merger::stop_merge_thread();
 	}
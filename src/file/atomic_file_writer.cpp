@@ -0,0 +1,134 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "atomic_file_writer.h"
+#include "logger/logger.h"
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace file {
+
+	atomic_file_writer::atomic_file_writer(const std::string &filename)
+	: atomic_file_writer(filename, 1024*1024) {
+	}
+
+	atomic_file_writer::atomic_file_writer(const std::string &filename, size_t buffer_len)
+	: m_filename(filename), m_tmp_filename(filename + ".tmp"), m_buffer(buffer_len) {
+
+		m_fd = ::open(m_tmp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (m_fd < 0) {
+			throw LOG_ERROR_EXCEPTION("Could not open " + m_tmp_filename + ". Error: " + std::string(strerror(errno)));
+		}
+	}
+
+	atomic_file_writer::~atomic_file_writer() {
+		if (m_fd >= 0) {
+			::close(m_fd);
+			::unlink(m_tmp_filename.c_str());
+		}
+	}
+
+	void atomic_file_writer::write(const char *data, size_t len) {
+		if (m_buffer_used + len > m_buffer.size()) {
+			flush();
+		}
+		if (len >= m_buffer.size()) {
+			write_fully(m_size, data, len);
+		} else {
+			memcpy(m_buffer.data() + m_buffer_used, data, len);
+			m_buffer_used += len;
+		}
+		m_size += len;
+	}
+
+	void atomic_file_writer::pwrite(size_t pos, const char *data, size_t len) {
+		// The buffer holds the bytes from m_size - m_buffer_used, write it out first if the ranges overlap.
+		if (pos + len > m_size - m_buffer_used) {
+			flush();
+		}
+		write_fully(pos, data, len);
+		if (pos + len > m_size) {
+			m_size = pos + len;
+		}
+	}
+
+	void atomic_file_writer::commit() {
+		flush();
+
+		if (::fsync(m_fd) != 0) {
+			throw LOG_ERROR_EXCEPTION("Could not fsync " + m_tmp_filename + ". Error: " + std::string(strerror(errno)));
+		}
+		::close(m_fd);
+		m_fd = -1;
+
+		if (::rename(m_tmp_filename.c_str(), m_filename.c_str()) != 0) {
+			throw LOG_ERROR_EXCEPTION("Could not rename " + m_tmp_filename + " to " + m_filename + ". Error: " +
+				std::string(strerror(errno)));
+		}
+
+		sync_directory();
+	}
+
+	void atomic_file_writer::sync_directory() const {
+		// The rename is only durable once the directory entry is on disk.
+		const size_t slash = m_filename.find_last_of('/');
+		const std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : m_filename.substr(0, slash));
+
+		const int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+		if (dir_fd < 0) {
+			throw LOG_ERROR_EXCEPTION("Could not open directory " + dir + ". Error: " + std::string(strerror(errno)));
+		}
+		const int ret = ::fsync(dir_fd);
+		const int fsync_errno = errno;
+		::close(dir_fd);
+		if (ret != 0) {
+			throw LOG_ERROR_EXCEPTION("Could not fsync directory " + dir + ". Error: " + std::string(strerror(fsync_errno)));
+		}
+	}
+
+	void atomic_file_writer::flush() {
+		if (m_buffer_used) {
+			write_fully(m_size - m_buffer_used, m_buffer.data(), m_buffer_used);
+			m_buffer_used = 0;
+		}
+	}
+
+	void atomic_file_writer::write_fully(size_t pos, const char *data, size_t len) {
+		while (len) {
+			const ssize_t written = ::pwrite(m_fd, data, len, pos);
+			if (written < 0) {
+				if (errno == EINTR) continue;
+				throw LOG_ERROR_EXCEPTION("Could not write to " + m_tmp_filename + ". Error: " + std::string(strerror(errno)));
+			}
+			data += written;
+			pos += written;
+			len -= written;
+		}
+	}
+
+}
@@ -0,0 +1,79 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+namespace file {
+
+	/*
+		Writes a file through a fixed size buffer to filename.tmp and replaces filename with it on commit(). The
+		replacement is atomic: fsync, rename, then fsync of the directory, so readers that have the old file open or
+		memory mapped keep seeing the old content and a crash never leaves a half written file behind.
+
+		pwrite() writes at an absolute position, it is meant for filling in headers such as hash tables after the
+		data has been written. If the writer is destroyed without commit() the temporary file is removed.
+	*/
+	class atomic_file_writer {
+
+		private:
+			atomic_file_writer(const atomic_file_writer &);
+			atomic_file_writer &operator=(const atomic_file_writer &);
+
+		public:
+
+			explicit atomic_file_writer(const std::string &filename);
+			atomic_file_writer(const std::string &filename, size_t buffer_len);
+			~atomic_file_writer();
+
+			void write(const char *data, size_t len);
+			void pwrite(size_t pos, const char *data, size_t len);
+
+			/*
+			 * Number of bytes written, this is the position the next write() goes to.
+			 * */
+			size_t size() const { return m_size; }
+
+			void commit();
+
+		private:
+
+			std::string m_filename;
+			std::string m_tmp_filename;
+			int m_fd = -1;
+			std::vector<char> m_buffer;
+			size_t m_buffer_used = 0;
+			size_t m_size = 0;
+
+			void sync_directory() const;
+			void flush();
+			void write_fully(size_t pos, const char *data, size_t len);
+
+	};
+
+}
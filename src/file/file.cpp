@@ -28,6 +28,7 @@
 #include "file.h"
 #include <boost/filesystem.hpp>
 #include <boost/range/iterator_range.hpp>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -99,4 +100,16 @@ namespace file {
 		return infile.good();
 	}
 
+	file_version version(const std::string &filename) {
+		struct stat st;
+		if (::stat(filename.c_str(), &st) != 0) return {};
+
+		file_version ver;
+		ver.exists = true;
+		ver.inode = st.st_ino;
+		ver.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+		ver.size = st.st_size;
+		return ver;
+	}
+
 }
@@ -30,6 +30,7 @@
 #include <fstream>
 #include <stdio.h>
 #include <functional>
+#include <cstdint>
 
 namespace file {
 
@@ -53,4 +54,19 @@ namespace file {
 	bool directory_exists(const std::string &filename);
 	bool file_exists(const std::string &filename);
 
+	/*
+	 * Identifies the content of a file without reading it. Replacing the file with a rename changes the inode,
+	 * writing to it in place changes the modification time or the size.
+	 * */
+	struct file_version {
+		bool exists = false;
+		uint64_t inode = 0;
+		int64_t mtime_ns = 0;
+		uint64_t size = 0;
+
+		bool operator==(const file_version &) const = default;
+	};
+
+	file_version version(const std::string &filename);
+
 }
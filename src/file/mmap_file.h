@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+
+namespace file {
+
+	/*
+		Read only memory mapping of a whole file. The mapping is shared so pages are served straight from the page cache
+		and many threads can read from it at the same time without any locking.
+
+		is_open() returns false if the file does not exist or is empty, the caller should then fall back to regular
+		reads.
+	*/
+	class mmap_file {
+
+		private:
+			mmap_file(const mmap_file &);
+			mmap_file &operator=(const mmap_file &);
+
+		public:
+
+			explicit mmap_file(const std::string &filename);
+			~mmap_file();
+
+			bool is_open() const { return m_data != nullptr; }
+			const char *data() const { return m_data; }
+			size_t size() const { return m_size; }
+
+		private:
+
+			const char *m_data = nullptr;
+			size_t m_size = 0;
+
+	};
+
+}
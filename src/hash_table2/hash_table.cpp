@@ -28,6 +28,7 @@
 #include "hash_table.h"
 #include "hash_table_shard_builder.h"
 #include "logger/logger.h"
+#include "utils/thread_pool.hpp"
 
 using namespace std;
 
@@ -72,6 +73,45 @@ namespace hash_table2 {
 		return m_shards[key % m_shards.size()]->find(key, ver);
 	}
 
+	std::vector<std::string> hash_table::find_many(const std::vector<uint64_t> &keys, size_t num_threads) {
+
+		// Indexes into keys, grouped by shard.
+		std::map<size_t, std::vector<size_t>> shard_indexes;
+		for (size_t i = 0; i < keys.size(); i++) {
+			shard_indexes[keys[i] % m_shards.size()].push_back(i);
+		}
+
+		std::vector<std::string> values(keys.size());
+
+		auto find_in_shard = [this, &keys, &values](size_t shard_id, const std::vector<size_t> &indexes) {
+			std::vector<uint64_t> shard_keys;
+			shard_keys.reserve(indexes.size());
+			for (size_t index : indexes) {
+				shard_keys.push_back(keys[index]);
+			}
+			std::vector<std::string> shard_values = m_shards[shard_id]->find_many(shard_keys);
+			for (size_t i = 0; i < indexes.size(); i++) {
+				values[indexes[i]] = std::move(shard_values[i]);
+			}
+		};
+
+		if (num_threads > 1 && shard_indexes.size() > 1) {
+			utils::thread_pool pool(std::min(num_threads, shard_indexes.size()));
+			for (const auto &iter : shard_indexes) {
+				pool.enqueue([&find_in_shard, &iter]() {
+					find_in_shard(iter.first, iter.second);
+				});
+			}
+			pool.run_all();
+		} else {
+			for (const auto &iter : shard_indexes) {
+				find_in_shard(iter.first, iter.second);
+			}
+		}
+
+		return values;
+	}
+
 	size_t hash_table::size() const {
 		size_t num_items = 0;
 		for (const auto &shard : m_shards) {
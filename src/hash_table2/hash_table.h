@@ -51,6 +51,13 @@ namespace hash_table2 {
 		void truncate();
 		std::string find(uint64_t key);
 		std::string find(uint64_t key, size_t &ver);
+
+		/*
+		 * Finds the values of all keys and returns them in the order of the keys. The keys are grouped by shard and
+		 * every shard is read once, in file order. With num_threads > 1 the shards are read in parallel.
+		 * */
+		std::vector<std::string> find_many(const std::vector<uint64_t> &keys, size_t num_threads = 1);
+
 		size_t size() const;
 		void for_each(std::function<void(uint64_t, const std::string &)> callback) const;
 		void for_each_shard(std::function<void(const hash_table_shard *shard)> callback) const;
@@ -25,14 +25,15 @@
  */
 
 #include <iostream>
-#include <sstream>
 #include <numeric>
+#include <algorithm>
 #include "config.h"
 #include "hash_table_shard.h"
 #include "logger/logger.h"
 
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
+#include "value_codec.h"
+
+#include <cstring>
 
 using namespace std;
 
@@ -55,7 +56,97 @@ namespace hash_table2 {
 
 	string hash_table_shard::find(uint64_t key, size_t &ver) const {
 
+		if (auto files = map_files()) {
+			const size_t pos = find_mapped_position(*files, key, ver);
+			if (pos == SIZE_MAX) return "";
+			return mapped_data_at_position(*files, pos);
+		}
+
 		std::ifstream reader(filename_pos(), std::ios::binary);
+		const size_t pos = find_position(reader, key, ver);
+		if (pos == SIZE_MAX) return "";
+
+		return data_at_position(pos, nullptr);
+	}
+
+	/*
+	 * All positions are looked up first, then the values are read ordered by their position in the data file so
+	 * the shard is read in one forward pass.
+	 * */
+	std::vector<std::string> hash_table_shard::find_many(const std::vector<uint64_t> &keys) const {
+
+		std::vector<std::string> values(keys.size());
+
+		// Pairs of (position in data file, index in keys).
+		std::vector<std::pair<size_t, size_t>> positions;
+		positions.reserve(keys.size());
+
+		const auto files = map_files();
+		std::ifstream reader;
+		if (!files) reader.open(filename_pos(), std::ios::binary);
+
+		for (size_t i = 0; i < keys.size(); i++) {
+			size_t ver;
+			const size_t pos = files ? find_mapped_position(*files, keys[i], ver) : find_position(reader, keys[i], ver);
+			if (pos != SIZE_MAX) positions.emplace_back(pos, i);
+		}
+
+		std::sort(positions.begin(), positions.end());
+
+		if (files) {
+			for (const auto &[pos, index] : positions) {
+				values[index] = mapped_data_at_position(*files, pos);
+			}
+		} else {
+			std::ifstream infile(filename_data(), std::ios::binary);
+			for (const auto &[pos, index] : positions) {
+				values[index] = data_at_position(infile, pos, nullptr);
+			}
+		}
+
+		return values;
+	}
+
+	/*
+	 * Returns the current mapping, mapping the files again if the .pos or .dict file has changed. Returns nullptr
+	 * if the files can't be mapped.
+	 * */
+	std::shared_ptr<const hash_table_shard::mapped_files> hash_table_shard::map_files() const {
+
+		// Stat before mapping so a file replaced in between is noticed on the next lookup.
+		const file::file_version pos_version = file::version(filename_pos());
+		const file::file_version dictionary_version = file::version(filename_dictionary());
+
+		std::lock_guard lock(m_map_lock);
+		if (m_mapped && m_mapped->pos_version == pos_version && m_mapped->dictionary_version == dictionary_version) {
+			return m_mapped;
+		}
+
+		m_mapped.reset();
+		if (!pos_version.exists) return nullptr;
+
+		// Map the data file first, the builders write the .pos file after the data it points to.
+		auto files = std::make_shared<mapped_files>();
+		files->pos_version = pos_version;
+		files->dictionary_version = dictionary_version;
+		if (dictionary_version.exists) files->dictionary = value_codec::read_dictionary(filename_dictionary());
+		auto data_map = std::make_unique<file::mmap_file>(filename_data());
+		auto pos_map = std::make_unique<file::mmap_file>(filename_pos());
+		if (!pos_map->is_open() || pos_map->size() < this->hash_table_byte_size()) return nullptr;
+
+		files->pos_map = std::move(pos_map);
+		if (data_map->is_open()) files->data_map = std::move(data_map);
+		m_mapped = std::move(files);
+
+		return m_mapped;
+	}
+
+	/*
+	 * Reads the position of the key in the data file from the .pos file, SIZE_MAX if the key is not present.
+	 * */
+	size_t hash_table_shard::find_position(std::ifstream &reader, uint64_t key, size_t &ver) const {
+
+		reader.clear();
 
 		const size_t hash_pos = key % this->m_hash_table_size;
 		reader.seekg(hash_pos * sizeof(size_t));
@@ -64,7 +155,7 @@ namespace hash_table2 {
 		size_t page_pos = SIZE_MAX;
 		reader.read((char *)&page_pos, sizeof(size_t));
 
-		if (page_pos == SIZE_MAX) return "";
+		if (page_pos == SIZE_MAX) return SIZE_MAX;
 
 		// Read page.
 		size_t page_len;
@@ -83,12 +174,80 @@ namespace hash_table2 {
 			}
 		}
 
-		if (pos == SIZE_MAX) return "";
+		return pos;
+	}
+
+	/*
+	 * Looks up the key in the mapped .pos file. The entries of a page are sorted by key so they are binary
+	 * searched.
+	 * */
+	size_t hash_table_shard::find_mapped_position(const mapped_files &files, uint64_t key, size_t &ver) const {
+
+		const char *pos_data = files.pos_map->data();
+		const size_t pos_size = files.pos_map->size();
+
+		const size_t hash_pos = key % this->m_hash_table_size;
+
+		size_t page_pos;
+		memcpy(&page_pos, &pos_data[hash_pos * sizeof(size_t)], sizeof(size_t));
+		if (page_pos == SIZE_MAX) return SIZE_MAX;
+
+		const size_t page_start = this->hash_table_byte_size() + page_pos;
+		if (page_start + sizeof(size_t) > pos_size) return SIZE_MAX;
+
+		size_t page_len;
+		memcpy(&page_len, &pos_data[page_start], sizeof(size_t));
+
+		const size_t item_size = sizeof(std::array<uint64_t, 3>);
+		const char *items = &pos_data[page_start + sizeof(size_t)];
+		if (page_len > (pos_size - page_start - sizeof(size_t)) / item_size) return SIZE_MAX;
+
+		// Lower bound of key.
+		size_t first = 0;
+		size_t count = page_len;
+		while (count > 0) {
+			const size_t half = count / 2;
+			uint64_t item_key;
+			memcpy(&item_key, &items[(first + half) * item_size], sizeof(uint64_t));
+			if (item_key < key) {
+				first += half + 1;
+				count -= half + 1;
+			} else {
+				count = half;
+			}
+		}
+		if (first == page_len) return SIZE_MAX;
+
+		std::array<uint64_t, 3> item;
+		memcpy(item.data(), &items[first * item_size], item_size);
+		if (item[0] != key) return SIZE_MAX;
 
-		return data_at_position(pos);
+		ver = item[2];
+		return item[1];
+	}
+
+	/*
+	 * Inflates the value straight from the mapped .data file.
+	 * */
+	string hash_table_shard::mapped_data_at_position(const mapped_files &files, size_t pos) const {
+
+		const size_t header_len = sizeof(uint64_t) + sizeof(size_t);
+		if (!files.data_map || pos + header_len > files.data_map->size()) {
+			// Appended after the file was mapped.
+			return data_at_position(pos, &files);
+		}
+
+		size_t data_len;
+		memcpy(&data_len, &files.data_map->data()[pos + sizeof(uint64_t)], sizeof(size_t));
+		if (data_len > files.data_map->size() - pos - header_len) {
+			return data_at_position(pos, &files);
+		}
+
+		return decode_value(&files.data_map->data()[pos + header_len], data_len, &files);
 	}
 
 	void hash_table_shard::for_each(std::function<void(uint64_t, std::string)> callback) const {
+		const auto files = map_files();
 		ifstream infile(filename_data(), ios::binary);
 		infile.seekg(0, ios::beg);
 
@@ -116,18 +275,8 @@ namespace hash_table2 {
 			char *buffer = buffer_allocator.get();
 
 			infile.read(buffer, data_len);
-			stringstream ss(string(buffer, data_len));
 
-			boost::iostreams::filtering_istream decompress_stream;
-			decompress_stream.push(boost::iostreams::gzip_decompressor());
-			decompress_stream.push(ss);
-
-			stringstream decompressed;
-			decompressed << decompress_stream.rdbuf();
-
-			const std::string value = decompressed.str();
-
-			callback(key, std::move(value));
+			callback(key, decode_value(buffer, data_len, files.get()));
 		}
 	}
 
@@ -146,9 +295,14 @@ namespace hash_table2 {
 		return infile.tellg();
 	}
 
-	string hash_table_shard::data_at_position(size_t pos) const {
-
+	string hash_table_shard::data_at_position(size_t pos, const mapped_files *files) const {
 		ifstream infile(filename_data(), ios::binary);
+		return data_at_position(infile, pos, files);
+	}
+
+	string hash_table_shard::data_at_position(std::ifstream &infile, size_t pos, const mapped_files *files) const {
+
+		infile.clear();
 		infile.seekg(pos, ios::beg);
 
 		// Read key
@@ -170,16 +324,24 @@ namespace hash_table2 {
 		char *buffer = buffer_allocator.get();
 
 		infile.read(buffer, data_len);
-		stringstream ss(string(buffer, data_len));
 
-		boost::iostreams::filtering_istream decompress_stream;
-		decompress_stream.push(boost::iostreams::gzip_decompressor());
-		decompress_stream.push(ss);
+		return decode_value(buffer, data_len, files);
+	}
 
-		stringstream decompressed;
-		decompressed << decompress_stream.rdbuf();
+	/*
+	 * Values are decoded with the dictionary of the mapping they were found through. Without a mapping the
+	 * dictionary is read from disk.
+	 * */
+	string hash_table_shard::decode_value(const char *data, size_t len, const mapped_files *files) const {
+		if (!value_codec::uses_dictionary(data, len)) {
+			return value_codec::decompress(data, len, "");
+		}
+
+		if (files) {
+			return value_codec::decompress(data, len, files->dictionary);
+		}
 
-		return decompressed.str();
+		return value_codec::decompress(data, len, value_codec::read_dictionary(filename_dictionary()));
 	}
 
 }
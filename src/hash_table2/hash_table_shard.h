@@ -30,9 +30,15 @@
 #include <map>
 #include <vector>
 #include <functional>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
 #include "config.h"
 #include "hash_table_shard_base.h"
+#include "file/file.h"
+#include "file/mmap_file.h"
 
 namespace hash_table2 {
 
@@ -54,6 +60,12 @@ namespace hash_table2 {
 			 * */
 			std::string find(uint64_t key, size_t &ver) const;
 
+			/*
+			 * Finds the values for all keys, returned in the order of the keys. Empty strings for keys that are
+			 * not present.
+			 * */
+			std::vector<std::string> find_many(const std::vector<uint64_t> &keys) const;
+
 			/*
 			 * Applies the given function to all elements in hash table shard. 
 			 * */
@@ -76,7 +88,31 @@ namespace hash_table2 {
 
 		private:
 
-			std::string data_at_position(size_t pos) const;
+			/*
+			 * The .pos and .data files are mapped together and kept until the .pos or .dict file changes on disk.
+			 * Every lookup stats both files and maps the files again when the builders have replaced them, lookups
+			 * that are running keep using the old mapping through their shared_ptr. The builders only append to
+			 * the .data file while the .pos file stays the same, values past the end of the mapping are read
+			 * from the file. Lookups fall back to reading the files if they can't be mapped.
+			 * */
+			struct mapped_files {
+				file::file_version pos_version;
+				file::file_version dictionary_version;
+				std::unique_ptr<file::mmap_file> pos_map;
+				std::unique_ptr<file::mmap_file> data_map;
+				std::string dictionary;
+			};
+
+			mutable std::mutex m_map_lock;
+			mutable std::shared_ptr<const mapped_files> m_mapped;
+
+			std::shared_ptr<const mapped_files> map_files() const;
+			size_t find_position(std::ifstream &reader, uint64_t key, size_t &ver) const;
+			size_t find_mapped_position(const mapped_files &files, uint64_t key, size_t &ver) const;
+			std::string mapped_data_at_position(const mapped_files &files, size_t pos) const;
+			std::string data_at_position(size_t pos, const mapped_files *files) const;
+			std::string data_at_position(std::ifstream &infile, size_t pos, const mapped_files *files) const;
+			std::string decode_value(const char *data, size_t len, const mapped_files *files) const;
 
 	};
 
@@ -67,6 +67,10 @@ namespace hash_table2 {
 				return file_base() + ".pos";
 			}
 
+			std::string filename_dictionary() const {
+				return file_base_data() + ".dict";
+			}
+
 			std::string filename_data_tmp() const {
 				return file_base() + ".data.tmp";
 			}
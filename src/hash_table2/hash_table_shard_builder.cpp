@@ -29,7 +29,8 @@
 #include "hash_table_shard_builder.h"
 #include "logger/logger.h"
 #include "file/file.h"
-#include "indexer/merger.h"
+#include "file/atomic_file_writer.h"
+#include "value_codec.h"
 
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
@@ -42,7 +43,7 @@ namespace hash_table2 {
 		const std::string &data_path)
 	: hash_table_shard_base(db_name, shard_id, hash_table_size, data_path)
 	{
-		indexer::merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = indexer::merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 		indexer::merger::register_merger((size_t)this, [this]() {merge();});
 	}
 
@@ -51,7 +52,7 @@ namespace hash_table2 {
 	}
 
 	void hash_table_shard_builder::add(uint64_t key, const string &value, size_t version) {
-		indexer::merger::lock();
+		indexer::merger::lock(*m_appender);
 
 		std::lock_guard guard(m_lock);
 
@@ -80,22 +81,16 @@ namespace hash_table2 {
 
 		ofstream outfile(this->filename_data_tmp(), ios::binary | ios::app);
 
+		if (config::ht_dictionary_compression) {
+			load_or_train_dictionary();
+		}
+
 		for (const auto &iter : m_cache) {
 			const size_t version = m_version[iter.first];
 			outfile.write((char *)&iter.first, sizeof(uint64_t));
 			outfile.write((char *)&version, sizeof(size_t));
 
-			// Compress data
-			stringstream ss(iter.second);
-
-			boost::iostreams::filtering_istream compress_stream;
-			compress_stream.push(boost::iostreams::gzip_compressor());
-			compress_stream.push(ss);
-
-			stringstream compressed;
-			compressed << compress_stream.rdbuf();
-
-			string compressed_string(compressed.str());
+			const string compressed_string = compress_value(iter.second);
 
 			const size_t data_len = compressed_string.size();
 			outfile.write((char *)&data_len, sizeof(size_t));
@@ -109,6 +104,48 @@ namespace hash_table2 {
 		m_data_size = 0;
 	}
 
+	/*
+	 * Compresses with the shard dictionary if there is one, otherwise on its own with gzip.
+	 * */
+	std::string hash_table_shard_builder::compress_value(const std::string &value) const {
+		if (m_dictionary.size()) {
+			return value_codec::compress(value, m_dictionary);
+		}
+
+		stringstream ss(value);
+
+		boost::iostreams::filtering_istream compress_stream;
+		compress_stream.push(boost::iostreams::gzip_compressor());
+		compress_stream.push(ss);
+
+		stringstream compressed;
+		compressed << compress_stream.rdbuf();
+
+		return compressed.str();
+	}
+
+	/*
+	 * Reads the dictionary of the shard. If there is none yet one is trained on the values in the cache, it is then
+	 * used for all values appended to the shard until it is truncated.
+	 * */
+	void hash_table_shard_builder::load_or_train_dictionary() {
+		if (!m_dictionary_loaded) {
+			m_dictionary = value_codec::read_dictionary(this->filename_dictionary());
+			m_dictionary_loaded = true;
+		}
+		if (m_dictionary.size()) return;
+
+		std::vector<std::string_view> samples;
+		for (const auto &iter : m_cache) {
+			samples.push_back(iter.second);
+		}
+
+		m_dictionary = value_codec::train_dictionary(samples);
+		if (m_dictionary.size()) {
+			value_codec::write_dictionary(this->filename_dictionary(), m_dictionary);
+		}
+	}
+
 	void hash_table_shard_builder::merge() {
 
 		auto pages = this->read_pages();
@@ -162,6 +199,10 @@ namespace hash_table2 {
 			if (pages[page_id].size() == 0) {
 				pages[page_id].push_back(elem);
 				add_data = true;
+			} else if (insert_at == pages[page_id].begin()) {
+				// Smaller than all keys in the page.
+				pages[page_id].insert(insert_at, elem);
+				add_data = true;
 			} else {
 
 				const auto elem_at = *(insert_at - 1);
@@ -214,10 +255,17 @@ namespace hash_table2 {
 
 	void hash_table_shard_builder::truncate() {
 		std::lock_guard guard(m_lock);
-		ofstream outfile(this->filename_data(), ios::binary | ios::trunc);
-		ofstream outfile_pos(this->filename_pos(), ios::binary | ios::trunc);
+
+		// Replace the files instead of truncating them, readers may have them mapped.
+		file::atomic_file_writer outfile(this->filename_data());
+		outfile.commit();
+		file::atomic_file_writer outfile_pos(this->filename_pos());
+		outfile_pos.commit();
 
 		file::delete_file(this->filename_data_tmp());
+		file::delete_file(this->filename_dictionary());
+		m_dictionary.clear();
+		m_dictionary_loaded = false;
 	}
 
 	void hash_table_shard_builder::merge_with(const hash_table_shard_builder &other) {
@@ -256,8 +304,27 @@ namespace hash_table2 {
 		std::ofstream outfile(this->filename_data_tmp(), std::ios::binary | std::ios::trunc);
 
 		std::ifstream data_file_2(data_file, std::ios::binary);
-		
-		read_optimized_to(pages2, data_file_2, outfile);
+
+		// Values compressed with the dictionary of the other shard are copied as they are if this shard has the same
+		// dictionary, or has none and dictionary compression is enabled, then the dictionary is taken over. Otherwise
+		// they are compressed again.
+		std::string other_dictionary;
+		if (data_file.ends_with(".data")) {
+			other_dictionary = value_codec::read_dictionary(data_file.substr(0, data_file.size() - 5) + ".dict");
+		}
+		if (!m_dictionary_loaded) {
+			m_dictionary = value_codec::read_dictionary(this->filename_dictionary());
+			m_dictionary_loaded = true;
+		}
+		if (config::ht_dictionary_compression && other_dictionary.size() && m_dictionary.empty()) {
+			m_dictionary = other_dictionary;
+			value_codec::write_dictionary(this->filename_dictionary(), m_dictionary);
+		}
+		if (other_dictionary == m_dictionary) {
+			other_dictionary.clear();
+		}
+
+		read_optimized_to(pages2, data_file_2, outfile, other_dictionary);
 
 		outfile.close();
 
@@ -265,7 +332,7 @@ namespace hash_table2 {
 	}
 
 	void hash_table_shard_builder::read_optimized_to(const std::vector<std::vector<std::array<uint64_t, 3>>> &pages, std::ifstream &infile,
-		std::ofstream &outfile) const {
+		std::ofstream &outfile, const std::string &source_dictionary) const {
 		
 		infile.seekg(0, std::ios::beg);
 
@@ -286,7 +353,7 @@ namespace hash_table2 {
 				return a[0] < b[0];
 			});
 
-			if (pages[page_id].size() == 0) {
+			if (iter == pages[page_id].cbegin()) {
 				// Skip. Did not find key.
 				infile.seekg(data_len, std::ios::cur);
 				continue;
@@ -312,8 +379,15 @@ namespace hash_table2 {
 				const size_t version = elem[2];
 				outfile.write((char *)&key, sizeof(uint64_t));
 				outfile.write((char *)&version, sizeof(size_t));
-				outfile.write((char *)&data_len, sizeof(size_t));
-				outfile.write(buffer, data_len);
+				if (source_dictionary.size() && value_codec::uses_dictionary(buffer, data_len)) {
+					const std::string value = compress_value(value_codec::decompress(buffer, data_len, source_dictionary));
+					const size_t value_len = value.size();
+					outfile.write((char *)&value_len, sizeof(size_t));
+					outfile.write(value.data(), value_len);
+				} else {
+					outfile.write((char *)&data_len, sizeof(size_t));
+					outfile.write(buffer, data_len);
+				}
 			} else {
 				// Ignore data.
 				infile.seekg(data_len, std::ios::cur);
@@ -323,7 +397,8 @@ namespace hash_table2 {
 
 	void hash_table_shard_builder::write_pages(const std::vector<std::vector<std::array<uint64_t, 3>>> &pages) {
 
-		std::ofstream key_writer(this->filename_pos(), std::ios::binary | std::ios::trunc);
+		// Written to a temporary file and renamed so readers never see a half written pos file.
+		file::atomic_file_writer key_writer(this->filename_pos());
 
 		const size_t page_item_size = sizeof(std::array<uint64_t, 3>);
 		const size_t empty_key = SIZE_MAX;
@@ -349,6 +424,8 @@ namespace hash_table2 {
 				}
 			}
 		}
+
+		key_writer.commit();
 	}
 
 	void hash_table_shard_builder::remove_keys_from_pages(std::vector<std::vector<std::array<uint64_t, 3>>> &pages) {
@@ -32,6 +32,7 @@
 
 #include "hash_table.h"
 #include "hash_table_shard_base.h"
+#include "indexer/merger.h"
 
 namespace hash_table2 {
 
@@ -109,9 +110,17 @@ namespace hash_table2 {
 
 			std::map<uint64_t, size_t> m_sort_pos;
 			std::mutex m_lock;
+			std::shared_ptr<indexer::merger::appender> m_appender;
 			size_t m_data_size = 0;
 
-			void read_optimized_to(const std::vector<std::vector<std::array<uint64_t, 3>>> &pages, std::ifstream &infile, std::ofstream &outfile) const;
+			// Values are compressed with this dictionary when config::ht_dictionary_compression is set.
+			std::string m_dictionary;
+			bool m_dictionary_loaded = false;
+
+			std::string compress_value(const std::string &value) const;
+			void load_or_train_dictionary();
+			void read_optimized_to(const std::vector<std::vector<std::array<uint64_t, 3>>> &pages, std::ifstream &infile,
+				std::ofstream &outfile, const std::string &source_dictionary = "") const;
 			void write_pages(const std::vector<std::vector<std::array<uint64_t, 3>>> &pages);
 			void remove_keys_from_pages(std::vector<std::vector<std::array<uint64_t, 3>>> &pages);
 
@@ -0,0 +1,221 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "value_codec.h"
+#include "logger/logger.h"
+#include "file/atomic_file_writer.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
+#include <zlib.h>
+
+namespace hash_table2 {
+
+	namespace value_codec {
+
+		/*
+		 * Zlib streams and output buffers reused by all values compressed and decompressed on the thread.
+		 * */
+		struct inflater {
+			z_stream m_stream{};
+			std::string m_buffer;
+			inflater(int window_bits) {
+				if (inflateInit2(&m_stream, window_bits) != Z_OK) {
+					throw LOG_ERROR_EXCEPTION("inflateInit2 failed");
+				}
+			}
+			~inflater() { inflateEnd(&m_stream); }
+		};
+
+		struct deflater {
+			z_stream m_stream{};
+			std::string m_buffer;
+			deflater() {
+				if (deflateInit(&m_stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+					throw LOG_ERROR_EXCEPTION("deflateInit failed");
+				}
+			}
+			~deflater() { deflateEnd(&m_stream); }
+		};
+
+		std::string train_dictionary(const std::vector<std::string_view> &samples, size_t max_size) {
+
+			const size_t segment_len = 16;
+			// Only this much of the samples is used, training has to stay cheap.
+			const size_t max_sample_bytes = 1024 * 1024;
+
+			// Number of samples each segment occurs in, and the last sample it was counted for.
+			std::unordered_map<std::string_view, std::pair<size_t, size_t>> counts;
+			size_t sample_bytes = 0;
+			for (size_t sample_id = 0; sample_id < samples.size() && sample_bytes < max_sample_bytes; sample_id++) {
+				const std::string_view sample = samples[sample_id];
+				sample_bytes += sample.size();
+				for (size_t i = 0; i + segment_len <= sample.size(); i++) {
+					// Segments start at the start of a token, this keeps shifted copies of the same text out.
+					if (i > 0 && isalnum((unsigned char)sample[i - 1])) continue;
+					auto &count = counts[sample.substr(i, segment_len)];
+					if (count.first == 0 || count.second != sample_id) {
+						count.first++;
+						count.second = sample_id;
+					}
+				}
+			}
+
+			std::vector<std::pair<size_t, std::string_view>> candidates;
+			for (const auto &iter : counts) {
+				if (iter.second.first > 1) candidates.emplace_back(iter.second.first, iter.first);
+			}
+			std::sort(candidates.begin(), candidates.end(), [](const auto &a, const auto &b) {
+				return a.first > b.first || (a.first == b.first && a.second < b.second);
+			});
+
+			// Most common first, reversed when the dictionary is assembled.
+			std::string selected;
+			std::vector<std::string_view> segments;
+			for (const auto &candidate : candidates) {
+				if (selected.size() + segment_len > max_size) break;
+				if (selected.find(candidate.second) != std::string::npos) continue;
+				selected.append(candidate.second);
+				segments.push_back(candidate.second);
+			}
+
+			std::string dictionary;
+			dictionary.reserve(selected.size());
+			for (auto iter = segments.rbegin(); iter != segments.rend(); ++iter) {
+				dictionary.append(*iter);
+			}
+
+			return dictionary;
+		}
+
+		std::string compress(std::string_view value, const std::string &dictionary) {
+
+			thread_local deflater def;
+			z_stream &stream = def.m_stream;
+			std::string &buffer = def.m_buffer;
+
+			deflateReset(&stream);
+			if (deflateSetDictionary(&stream, (const Bytef *)dictionary.data(), dictionary.size()) != Z_OK) {
+				throw LOG_ERROR_EXCEPTION("deflateSetDictionary failed");
+			}
+
+			buffer.resize(deflateBound(&stream, value.size()) + 1);
+			buffer[0] = dictionary_marker;
+
+			stream.next_in = (Bytef *)value.data();
+			stream.avail_in = value.size();
+			stream.next_out = (Bytef *)&buffer[1];
+			stream.avail_out = buffer.size() - 1;
+
+			if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+				throw LOG_ERROR_EXCEPTION("Could not compress hash table value");
+			}
+
+			return std::string(buffer.data(), buffer.size() - stream.avail_out);
+		}
+
+		std::string decompress(const char *data, size_t len, const std::string &dictionary) {
+
+			// 16 + MAX_WBITS reads a gzip stream, MAX_WBITS a zlib stream.
+			thread_local inflater gzip_inf(16 + MAX_WBITS);
+			thread_local inflater zlib_inf(MAX_WBITS);
+
+			const bool with_dictionary = uses_dictionary(data, len);
+			inflater &inf = with_dictionary ? zlib_inf : gzip_inf;
+			z_stream &stream = inf.m_stream;
+			std::string &buffer = inf.m_buffer;
+
+			inflateReset(&stream);
+			stream.next_in = (Bytef *)(with_dictionary ? data + 1 : data);
+			stream.avail_in = with_dictionary ? len - 1 : len;
+
+			if (buffer.size() < len * 4 + 256) buffer.resize(len * 4 + 256);
+
+			size_t out_len = 0;
+			while (true) {
+				stream.next_out = (Bytef *)&buffer[out_len];
+				stream.avail_out = buffer.size() - out_len;
+				int ret = inflate(&stream, Z_NO_FLUSH);
+				out_len = buffer.size() - stream.avail_out;
+
+				if (ret == Z_NEED_DICT) {
+					const uLong dictionary_id = adler32(adler32(0, nullptr, 0), (const Bytef *)dictionary.data(),
+						dictionary.size());
+					if (dictionary.empty() || stream.adler != dictionary_id) {
+						throw LOG_ERROR_EXCEPTION("Hash table value was compressed with another dictionary");
+					}
+					inflateSetDictionary(&stream, (const Bytef *)dictionary.data(), dictionary.size());
+					continue;
+				}
+
+				if (ret == Z_STREAM_END) break;
+				if ((ret != Z_OK && ret != Z_BUF_ERROR) || (stream.avail_out > 0 && stream.avail_in == 0)) {
+					throw LOG_ERROR_EXCEPTION("Could not decompress hash table value");
+				}
+				if (stream.avail_out == 0) buffer.resize(buffer.size() * 2);
+			}
+
+			return std::string(buffer.data(), out_len);
+		}
+
+		bool uses_dictionary(const char *data, size_t len) {
+			return len > 0 && data[0] == dictionary_marker;
+		}
+
+		std::string read_dictionary(const std::string &filename) {
+			std::ifstream infile(filename, std::ios::binary);
+			if (!infile.is_open()) return "";
+
+			uint64_t version = 0;
+			uint64_t length = 0;
+			infile.read((char *)&version, sizeof(uint64_t));
+			infile.read((char *)&length, sizeof(uint64_t));
+			if (!infile || version != dictionary_file_version || length > max_dictionary_size) {
+				throw LOG_ERROR_EXCEPTION("Invalid hash table dictionary file " + filename);
+			}
+
+			std::string dictionary(length, '\0');
+			if (!infile.read(dictionary.data(), length)) {
+				throw LOG_ERROR_EXCEPTION("Invalid hash table dictionary file " + filename);
+			}
+
+			return dictionary;
+		}
+
+		void write_dictionary(const std::string &filename, const std::string &dictionary) {
+			file::atomic_file_writer writer(filename);
+			const uint64_t length = dictionary.size();
+			writer.write((char *)&dictionary_file_version, sizeof(uint64_t));
+			writer.write((char *)&length, sizeof(uint64_t));
+			writer.write(dictionary.data(), dictionary.size());
+			writer.commit();
+		}
+
+	}
+
+}
@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string_view>
+
+namespace hash_table2 {
+
+	/*
+		Compression of hash table values. Values are either a gzip stream, or a zlib stream compressed with the
+		preset dictionary of the shard prefixed with dictionary_marker. Both kinds can be mixed in one data file.
+
+		The dictionary is stored in the .dict file of the shard:
+		<version> uint64_t   dictionary_file_version
+		<length>  uint64_t
+		<data>    char[length]
+	*/
+	namespace value_codec {
+
+		/*
+		 * First byte of values compressed with the shard dictionary. gzip streams always start with 0x1f.
+		 * */
+		const char dictionary_marker = 'D';
+
+		/*
+		 * zlib only uses the last 32KB of a preset dictionary.
+		 * */
+		const size_t max_dictionary_size = 32768;
+
+		const uint64_t dictionary_file_version = 1;
+
+		/*
+		 * Builds a dictionary from substrings that are common to many of the samples. The most common substrings
+		 * are placed at the end where they are cheapest for zlib to reference. Returns an empty string if the
+		 * samples have nothing in common.
+		 * */
+		std::string train_dictionary(const std::vector<std::string_view> &samples,
+			size_t max_size = max_dictionary_size);
+
+		/*
+		 * Compresses the value with the dictionary, the result starts with dictionary_marker.
+		 * */
+		std::string compress(std::string_view value, const std::string &dictionary);
+
+		/*
+		 * Decompresses a value of either kind. The dictionary is only used for values starting with
+		 * dictionary_marker. Throws if the data is corrupt or was compressed with another dictionary.
+		 * */
+		std::string decompress(const char *data, size_t len, const std::string &dictionary);
+
+		bool uses_dictionary(const char *data, size_t len);
+
+		/*
+		 * Returns an empty string if the file does not exist.
+		 * */
+		std::string read_dictionary(const std::string &filename);
+		void write_dictionary(const std::string &filename, const std::string &dictionary);
+
+	}
+
+}
@@ -0,0 +1,520 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "epoll_server.h"
+#include "request_parser.h"
+#include "logger/logger.h"
+#include "URL.h"
+
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace http {
+
+	/*
+	 * Body of a streamed response. The body_writer runs on m_thread and appends chunks to m_pending, the worker
+	 * moves them to the connection when the socket has taken everything before them. The writer waits while
+	 * max_stream_buffer bytes are pending so a slow client pushes back on the writer and not on the worker.
+	 * */
+	struct body_stream {
+		std::mutex m_lock;
+		std::condition_variable m_cv;
+		std::string m_pending;
+		bool m_done = false;
+		bool m_failed = false;
+		bool m_cancelled = false;
+		std::thread m_thread;
+
+		/*
+		 * Makes write return false, the writer returns on its next write.
+		 * */
+		void cancel() {
+			{
+				std::lock_guard lock(m_lock);
+				m_cancelled = true;
+			}
+			m_cv.notify_all();
+		}
+
+		bool done() {
+			std::lock_guard lock(m_lock);
+			return m_done;
+		}
+	};
+
+	/*
+	 * State of one client connection, owned by the worker that accepted it.
+	 * */
+	struct connection {
+		int m_fd;
+		request_parser m_parser;
+		std::string m_in;
+		std::string m_out;
+		size_t m_out_pos = 0;
+		bool m_close_after_write = false;
+		uint32_t m_events = EPOLLIN;
+		std::chrono::steady_clock::time_point m_last_active;
+
+		/*
+		 * Set while a streamed response is sent, requests after it wait in m_in until it is done.
+		 * */
+		std::shared_ptr<body_stream> m_stream;
+		bool m_stream_keep_alive = false;
+
+		connection(int fd, size_t max_body_len)
+		: m_fd(fd), m_parser(max_body_len), m_last_active(std::chrono::steady_clock::now()) {}
+	};
+
+	std::string status_text(size_t code) {
+		switch (code) {
+			case 100: return "Continue";
+			case 200: return "OK";
+			case 301: return "Moved Permanently";
+			case 302: return "Found";
+			case 400: return "Bad Request";
+			case 403: return "Forbidden";
+			case 404: return "Not Found";
+			case 413: return "Payload Too Large";
+			case 431: return "Request Header Fields Too Large";
+			case 500: return "Internal Server Error";
+			case 501: return "Not Implemented";
+			case 503: return "Service Unavailable";
+			case 505: return "HTTP Version Not Supported";
+		}
+		return "Unknown";
+	}
+
+	void append_response(std::string &out, size_t code, const std::string &content_type, const std::string &body,
+			bool keep_alive) {
+		out += "HTTP/1.1 " + std::to_string(code) + " " + status_text(code) + "\r\n";
+		out += "Content-Type: " + content_type + "\r\n";
+		out += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+		out += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+		out += body;
+	}
+
+	/*
+	 * Writes the headers of a response with a body_writer to the output and starts the writer. Every write becomes
+	 * one chunk, event_fd is signalled when there is output for the worker.
+	 * */
+	void start_streamed_response(connection &conn, const http::response &res, bool keep_alive,
+			int event_fd) {
+		conn.m_out += "HTTP/1.1 " + std::to_string(res.code()) + " " + status_text(res.code()) + "\r\n";
+		conn.m_out += "Content-Type: " + res.content_type() + "\r\n";
+		conn.m_out += "Transfer-Encoding: chunked\r\n";
+		conn.m_out += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+		auto stream = std::make_shared<body_stream>();
+		auto notify = [event_fd]() {
+			const uint64_t one = 1;
+			if (write(event_fd, &one, sizeof(one)) < 0) {
+				// The counter is already signalled.
+			}
+		};
+
+		stream->m_thread = std::thread([stream = stream.get(), writer = res.body_writer(), notify]() {
+			try {
+				writer([stream, &notify](const std::string &data) {
+					std::unique_lock lock(stream->m_lock);
+					stream->m_cv.wait(lock, [stream]() {
+						return stream->m_cancelled || stream->m_pending.size() < epoll_server::max_stream_buffer;
+					});
+					if (stream->m_cancelled) return false;
+					if (data.empty()) return true;
+
+					char chunk_size[32];
+					snprintf(chunk_size, sizeof(chunk_size), "%zx\r\n", data.size());
+					stream->m_pending += chunk_size;
+					stream->m_pending += data;
+					stream->m_pending += "\r\n";
+					lock.unlock();
+
+					notify();
+					return true;
+				});
+
+				std::lock_guard lock(stream->m_lock);
+				stream->m_pending += "0\r\n\r\n";
+				stream->m_done = true;
+			} catch (const std::exception &error) {
+				// The headers are sent, all we can do is to close the connection.
+				LOG_ERROR("Body writer failed: " + std::string(error.what()));
+				std::lock_guard lock(stream->m_lock);
+				stream->m_failed = true;
+				stream->m_done = true;
+			}
+			notify();
+		});
+
+		conn.m_stream = stream;
+		conn.m_stream_keep_alive = keep_alive;
+	}
+
+	epoll_server::epoll_server(std::function<http::response(const http::request &)> handler, const std::string &address,
+			size_t port, size_t num_workers, size_t max_body_len)
+	: m_handler(handler), m_address(address), m_port(port), m_num_workers(num_workers), m_max_body_len(max_body_len) {
+	}
+
+	void epoll_server::run() {
+
+		std::vector<int> sockets;
+		for (size_t i = 0; i < m_num_workers; i++) {
+			const int listen_fd = open_socket();
+			if (listen_fd < 0) {
+				LOG_ERROR("Could not open socket on " + m_address + ":" + std::to_string(m_port) + ": " +
+					std::string(strerror(errno)));
+				for (int fd : sockets) close(fd);
+				return;
+			}
+			sockets.push_back(listen_fd);
+		}
+
+		LOG_INFO("Server has started...");
+
+		std::vector<std::thread> threads;
+		for (int listen_fd : sockets) {
+			threads.emplace_back([this, listen_fd]() { run_worker(listen_fd); });
+		}
+
+		for (auto &thread : threads) {
+			thread.join();
+		}
+
+		for (int fd : sockets) close(fd);
+	}
+
+	void epoll_server::stop() {
+		m_stop = true;
+	}
+
+	int epoll_server::open_socket() const {
+		const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0) return -1;
+
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(m_port);
+		if (inet_pton(AF_INET, m_address.c_str(), &addr.sin_addr) != 1 ||
+				bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0) {
+			const int error = errno;
+			close(fd);
+			errno = error;
+			return -1;
+		}
+
+		return fd;
+	}
+
+	void epoll_server::run_worker(int listen_fd) {
+
+		const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0) {
+			LOG_ERROR("epoll_create1 failed: " + std::string(strerror(errno)));
+			return;
+		}
+
+		// Signalled by the body writers when they have output or are done.
+		const int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (event_fd < 0) {
+			LOG_ERROR("eventfd failed: " + std::string(strerror(errno)));
+			close(epoll_fd);
+			return;
+		}
+
+		epoll_event listen_event{};
+		listen_event.events = EPOLLIN;
+		listen_event.data.fd = listen_fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+		epoll_event stream_event{};
+		stream_event.events = EPOLLIN;
+		stream_event.data.fd = event_fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &stream_event);
+
+		std::unordered_map<int, std::unique_ptr<connection>> connections;
+
+		// Streams of closed connections whose writers have not returned yet, joined when they are done.
+		std::vector<std::shared_ptr<body_stream>> cancelled_streams;
+
+		auto close_connection = [&connections, &cancelled_streams, epoll_fd](int fd) {
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+			close(fd);
+			auto iter = connections.find(fd);
+			if (iter != connections.end() && iter->second->m_stream) {
+				auto &stream = iter->second->m_stream;
+				if (stream->done()) {
+					stream->m_thread.join();
+				} else {
+					stream->cancel();
+					cancelled_streams.push_back(stream);
+				}
+			}
+			connections.erase(fd);
+		};
+
+		auto set_events = [epoll_fd](connection &conn, uint32_t events) {
+			if (conn.m_events == events) return;
+			conn.m_events = events;
+			epoll_event event{};
+			event.events = events;
+			event.data.fd = conn.m_fd;
+			epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.m_fd, &event);
+		};
+
+		// Runs the handler for every complete request in the input buffer. Stops at a streamed response, the
+		// requests after it are handled when it is done.
+		auto handle_input = [this, event_fd](connection &conn) {
+			size_t pos = 0;
+			while (pos < conn.m_in.size() && !conn.m_close_after_write && !conn.m_stream) {
+				const bool had_headers = conn.m_parser.headers_done();
+				pos += conn.m_parser.parse(conn.m_in.data() + pos, conn.m_in.size() - pos);
+
+				if (conn.m_parser.error()) {
+					const size_t code = conn.m_parser.error_code();
+					append_response(conn.m_out, code, "text/html", std::to_string(code), false);
+					conn.m_close_after_write = true;
+					break;
+				}
+
+				if (!had_headers && conn.m_parser.headers_done() && !conn.m_parser.done() &&
+						conn.m_parser.expects_continue()) {
+					conn.m_out += "HTTP/1.1 100 Continue\r\n\r\n";
+				}
+
+				if (!conn.m_parser.done()) break;
+
+				const bool keep_alive = conn.m_parser.keep_alive();
+				::http::request http_request(URL("http://alexandria.org" + conn.m_parser.uri()),
+					conn.m_parser.method(), conn.m_parser.body());
+				conn.m_parser.reset();
+
+				try {
+					::http::response http_response = m_handler(http_request);
+					if (http_response.body_writer()) {
+						start_streamed_response(conn, http_response, keep_alive, event_fd);
+						break;
+					}
+					append_response(conn.m_out, http_response.code(), http_response.content_type(),
+						http_response.body(), keep_alive);
+				} catch (const std::exception &error) {
+					LOG_ERROR("Handler failed: " + std::string(error.what()));
+					append_response(conn.m_out, 500, "text/html", "500", keep_alive);
+				}
+
+				conn.m_close_after_write = !keep_alive;
+			}
+			conn.m_in.erase(0, pos);
+		};
+
+		// Moves the output of a finished or running streamed response to the connection. Returns false if the
+		// writer failed and the connection has to be closed.
+		auto take_stream_output = [&handle_input](connection &conn) {
+			body_stream &stream = *conn.m_stream;
+			bool done;
+			{
+				std::lock_guard lock(stream.m_lock);
+				if (stream.m_failed) return false;
+				conn.m_out.append(stream.m_pending);
+				stream.m_pending.clear();
+				done = stream.m_done;
+			}
+			stream.m_cv.notify_all();
+
+			if (done) {
+				stream.m_thread.join();
+				conn.m_stream.reset();
+				conn.m_close_after_write = !conn.m_stream_keep_alive;
+				handle_input(conn);
+			}
+			return true;
+		};
+
+		// Writes as much of the output as the socket takes, taking more from a streamed response only when all
+		// output before it is sent. Returns false if the connection should be closed.
+		auto write_out = [&set_events, &take_stream_output](connection &conn) {
+			while (true) {
+				while (conn.m_out_pos < conn.m_out.size()) {
+					const ssize_t sent = send(conn.m_fd, conn.m_out.data() + conn.m_out_pos,
+						conn.m_out.size() - conn.m_out_pos, MSG_NOSIGNAL);
+					if (sent < 0) {
+						if (errno == EINTR) continue;
+						if (errno == EAGAIN || errno == EWOULDBLOCK) {
+							set_events(conn, EPOLLOUT);
+							return true;
+						}
+						return false;
+					}
+					conn.m_out_pos += sent;
+				}
+				conn.m_out.clear();
+				conn.m_out_pos = 0;
+
+				if (!conn.m_stream) break;
+				if (!take_stream_output(conn)) return false;
+				if (conn.m_out.empty()) break;
+			}
+
+			// Not reading while streaming, the next request has to wait for the response anyway.
+			set_events(conn, conn.m_stream ? 0 : EPOLLIN);
+			return conn.m_stream || !conn.m_close_after_write;
+		};
+
+		const size_t buffer_len = 64 * 1024;
+		std::unique_ptr<char[]> buffer_allocator = std::make_unique<char[]>(buffer_len);
+		char *buffer = buffer_allocator.get();
+
+		const size_t max_events = 256;
+		epoll_event events[max_events];
+		auto last_idle_check = std::chrono::steady_clock::now();
+
+		while (!m_stop) {
+			const int num_events = epoll_wait(epoll_fd, events, max_events, 1000);
+			const auto now = std::chrono::steady_clock::now();
+
+			for (int i = 0; i < num_events; i++) {
+				const int fd = events[i].data.fd;
+
+				if (fd == event_fd) {
+					uint64_t count;
+					if (read(event_fd, &count, sizeof(count)) < 0) {
+						// Already reset.
+					}
+					// Connections waiting for EPOLLOUT take their output when the client has read, the time out
+					// still applies to them.
+					std::vector<int> streaming;
+					for (const auto &iter : connections) {
+						if (iter.second->m_stream && iter.second->m_events != EPOLLOUT) streaming.push_back(iter.first);
+					}
+					for (int stream_fd : streaming) {
+						connection &stream_conn = *connections[stream_fd];
+						stream_conn.m_last_active = now;
+						if (!write_out(stream_conn)) close_connection(stream_fd);
+					}
+					std::erase_if(cancelled_streams, [](const std::shared_ptr<body_stream> &stream) {
+						if (!stream->done()) return false;
+						stream->m_thread.join();
+						return true;
+					});
+					continue;
+				}
+
+				if (fd == listen_fd) {
+					while (true) {
+						const int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+						if (client_fd < 0) break;
+
+						int one = 1;
+						setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+						epoll_event event{};
+						event.events = EPOLLIN;
+						event.data.fd = client_fd;
+						epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event);
+						connections[client_fd] = std::make_unique<connection>(client_fd, m_max_body_len);
+					}
+					continue;
+				}
+
+				auto iter = connections.find(fd);
+				if (iter == connections.end()) continue;
+				connection &conn = *iter->second;
+				conn.m_last_active = now;
+
+				if (events[i].events & EPOLLOUT) {
+					if (!write_out(conn)) close_connection(fd);
+					continue;
+				}
+
+				bool keep = true;
+				while (true) {
+					const ssize_t read_bytes = recv(fd, buffer, buffer_len, 0);
+					if (read_bytes > 0) {
+						conn.m_in.append(buffer, read_bytes);
+						// Parse as we go so a large body is not held twice.
+						handle_input(conn);
+						if (conn.m_close_after_write) break;
+						continue;
+					}
+					if (read_bytes < 0 && errno == EINTR) continue;
+					if (read_bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+					// Closed by the client or an error.
+					if (conn.m_stream) {
+						conn.m_stream_keep_alive = false;
+					} else {
+						keep = conn.m_out.size() > 0 && !conn.m_close_after_write;
+						conn.m_close_after_write = true;
+					}
+					break;
+				}
+
+				if (!keep || (conn.m_out.empty() && conn.m_close_after_write && !conn.m_stream) || !write_out(conn)) {
+					close_connection(fd);
+				}
+			}
+
+			if (now - last_idle_check > std::chrono::seconds(1)) {
+				last_idle_check = now;
+				std::vector<int> idle;
+				for (const auto &iter : connections) {
+					if (now - iter.second->m_last_active > std::chrono::seconds(idle_timeout_s)) {
+						idle.push_back(iter.first);
+					}
+				}
+				for (int fd : idle) close_connection(fd);
+			}
+		}
+
+		for (auto &iter : connections) {
+			close(iter.first);
+			if (iter.second->m_stream) cancelled_streams.push_back(iter.second->m_stream);
+		}
+		for (auto &stream : cancelled_streams) {
+			stream->cancel();
+			stream->m_thread.join();
+		}
+		close(event_fd);
+		close(epoll_fd);
+	}
+
+}
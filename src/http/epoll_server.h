@@ -0,0 +1,85 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <functional>
+#include "request.h"
+#include "response.h"
+
+namespace http {
+
+	/*
+		HTTP/1.1 server that speaks to clients directly, an alternative to the FastCGI front end in http::server.
+
+		Every worker thread has its own listening socket (SO_REUSEPORT) and its own epoll loop, so workers accept
+		connections without sharing a lock. Sockets are non blocking and requests are parsed incrementally with
+		request_parser, a slow client only holds a connection, never a thread. Connections are kept alive until the
+		client closes them, asks for Connection: close or has been idle for idle_timeout_s seconds.
+
+		The handler runs on the worker thread that read the request. Responses with a body_writer are sent with
+		chunked transfer encoding, the writer runs on a thread of its own and hands its chunks to the worker through
+		a buffer of max_stream_buffer bytes. When the client reads slower than the writer writes the writer waits
+		for the buffer, the worker keeps serving its other connections.
+	*/
+	class epoll_server {
+
+		public:
+
+			static const size_t idle_timeout_s = 60;
+			static const size_t max_stream_buffer = 1024 * 1024;
+
+			epoll_server(std::function<http::response(const http::request &)> handler, const std::string &address,
+				size_t port, size_t num_workers, size_t max_body_len);
+
+			/*
+			 * Runs the workers, returns when stop() is called or the socket could not be opened.
+			 * */
+			void run();
+			void stop();
+
+		private:
+
+			std::function<http::response(const http::request &)> m_handler;
+			std::string m_address;
+			size_t m_port;
+			size_t m_num_workers;
+			size_t m_max_body_len;
+			std::atomic<bool> m_stop = false;
+
+			int open_socket() const;
+			void run_worker(int listen_fd);
+
+	};
+
+	/*
+	 * Status line reason for the HTTP status code.
+	 * */
+	std::string status_text(size_t code);
+
+}
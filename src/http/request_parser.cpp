@@ -0,0 +1,174 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "request_parser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <strings.h>
+
+namespace http {
+
+	request_parser::request_parser(size_t max_body_len)
+	: m_max_body_len(max_body_len) {
+	}
+
+	size_t request_parser::parse(const char *data, size_t len) {
+
+		size_t consumed = 0;
+
+		if (m_state == state::headers) {
+			// The end of the headers can span two calls, start the search a few bytes back.
+			const size_t search_from = m_header_buffer.size() >= 3 ? m_header_buffer.size() - 3 : 0;
+			const size_t copy_len = std::min(len, max_header_len + 1 - m_header_buffer.size());
+			m_header_buffer.append(data, copy_len);
+
+			const size_t end = m_header_buffer.find("\r\n\r\n", search_from);
+			if (end == std::string::npos) {
+				if (m_header_buffer.size() > max_header_len) set_error(431);
+				return copy_len;
+			}
+
+			// Bytes after the headers are given back to the caller.
+			consumed = copy_len - (m_header_buffer.size() - (end + 4));
+			m_header_buffer.resize(end + 2);
+
+			parse_headers();
+			if (m_state == state::error) return consumed;
+		}
+
+		if (m_state == state::body) {
+			const size_t body_len = std::min(len - consumed, m_content_length - m_body.size());
+			m_body.append(data + consumed, body_len);
+			consumed += body_len;
+
+			if (m_body.size() == m_content_length) {
+				m_state = state::done;
+			}
+		}
+
+		return consumed;
+	}
+
+	void request_parser::reset() {
+		m_state = state::headers;
+		m_error_code = 0;
+		m_content_length = 0;
+		m_header_buffer.clear();
+		m_method.clear();
+		m_uri.clear();
+		m_version.clear();
+		m_headers.clear();
+		m_body.clear();
+	}
+
+	std::string request_parser::header(const std::string &name) const {
+		for (const auto &iter : m_headers) {
+			if (strcasecmp(iter.first.c_str(), name.c_str()) == 0) return iter.second;
+		}
+		return "";
+	}
+
+	bool request_parser::keep_alive() const {
+		const std::string connection = header("Connection");
+		if (m_version == "HTTP/1.0") {
+			return strcasecmp(connection.c_str(), "keep-alive") == 0;
+		}
+		return strcasecmp(connection.c_str(), "close") != 0;
+	}
+
+	bool request_parser::expects_continue() const {
+		return strcasecmp(header("Expect").c_str(), "100-continue") == 0;
+	}
+
+	void request_parser::parse_headers() {
+
+		// Request line.
+		size_t line_end = m_header_buffer.find("\r\n");
+		const std::string request_line = m_header_buffer.substr(0, line_end);
+
+		const size_t method_end = request_line.find(' ');
+		const size_t uri_end = request_line.find(' ', method_end + 1);
+		if (method_end == std::string::npos || uri_end == std::string::npos || method_end == 0 ||
+				uri_end == method_end + 1) {
+			set_error(400);
+			return;
+		}
+		m_method = request_line.substr(0, method_end);
+		m_uri = request_line.substr(method_end + 1, uri_end - method_end - 1);
+		m_version = request_line.substr(uri_end + 1);
+		if (m_version != "HTTP/1.1" && m_version != "HTTP/1.0") {
+			set_error(505);
+			return;
+		}
+
+		// Headers.
+		size_t pos = line_end + 2;
+		while (pos < m_header_buffer.size()) {
+			line_end = m_header_buffer.find("\r\n", pos);
+			const std::string line = m_header_buffer.substr(pos, line_end - pos);
+			pos = line_end + 2;
+
+			const size_t colon = line.find(':');
+			if (colon == std::string::npos || colon == 0) {
+				set_error(400);
+				return;
+			}
+			const size_t value_start = line.find_first_not_of(" \t", colon + 1);
+			const size_t value_end = line.find_last_not_of(" \t");
+			std::string value;
+			if (value_start != std::string::npos) value = line.substr(value_start, value_end - value_start + 1);
+			m_headers.emplace_back(line.substr(0, colon), value);
+		}
+		m_header_buffer.clear();
+
+		if (header("Transfer-Encoding").size()) {
+			set_error(501);
+			return;
+		}
+
+		const std::string content_length = header("Content-Length");
+		if (content_length.size()) {
+			if (content_length.find_first_not_of("0123456789") != std::string::npos || content_length.size() > 18) {
+				set_error(400);
+				return;
+			}
+			m_content_length = std::stoull(content_length);
+			if (m_content_length > m_max_body_len) {
+				set_error(413);
+				return;
+			}
+		}
+
+		m_state = m_content_length ? state::body : state::done;
+	}
+
+	void request_parser::set_error(size_t code) {
+		m_state = state::error;
+		m_error_code = code;
+	}
+
+}
@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <utility>
+
+namespace http {
+
+	/*
+		Incremental parser for HTTP/1.x requests. Bytes are fed with parse() as they arrive, it returns how many of
+		them belong to the current request so the rest of the buffer can be fed again after reset() when clients
+		pipeline requests.
+
+		Bodies are read by Content-Length and are limited to max_body_len, the limit is checked as soon as the
+		headers are complete. Chunked request bodies are not supported and give error 501.
+	*/
+	class request_parser {
+
+		public:
+
+			/*
+			 * Largest accepted request line plus headers.
+			 * */
+			static const size_t max_header_len = 64 * 1024;
+
+			explicit request_parser(size_t max_body_len);
+
+			size_t parse(const char *data, size_t len);
+			void reset();
+
+			bool headers_done() const { return m_state == state::body || m_state == state::done; }
+			bool done() const { return m_state == state::done; }
+			bool error() const { return m_state == state::error; }
+
+			/*
+			 * HTTP status code to answer with when error() is true.
+			 * */
+			size_t error_code() const { return m_error_code; }
+
+			const std::string &method() const { return m_method; }
+			const std::string &uri() const { return m_uri; }
+			const std::string &version() const { return m_version; }
+			const std::string &body() const { return m_body; }
+
+			/*
+			 * Value of the header, names are case insensitive. Empty string if the header is missing.
+			 * */
+			std::string header(const std::string &name) const;
+
+			bool keep_alive() const;
+
+			/*
+			 * True if the client waits for "100 Continue" before sending the body.
+			 * */
+			bool expects_continue() const;
+
+		private:
+
+			enum class state { headers, body, done, error };
+
+			size_t m_max_body_len;
+			state m_state = state::headers;
+			size_t m_error_code = 0;
+			size_t m_content_length = 0;
+
+			std::string m_header_buffer;
+			std::string m_method;
+			std::string m_uri;
+			std::string m_version;
+			std::vector<std::pair<std::string, std::string>> m_headers;
+			std::string m_body;
+
+			void parse_headers();
+			void set_error(size_t code);
+
+	};
+
+}
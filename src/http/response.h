@@ -27,6 +27,7 @@
 #pragma once
 
 #include <iostream>
+#include <functional>
 
 namespace http {
 
@@ -42,10 +43,20 @@ namespace http {
 			void content_type(const std::string &content_type) { m_content_type = content_type; }
 			const std::string &content_type() const { return m_content_type; }
 
+			/*
+			 * Streams the body instead of sending body(). The server calls the writer once the headers are sent, the
+			 * writer passes every part of the body to write as soon as it is ready. write returns false when the
+			 * client is gone.
+			 * */
+			typedef std::function<bool(const std::string &)> write_function;
+			void body_writer(std::function<void(const write_function &write)> writer) { m_body_writer = writer; }
+			const std::function<void(const write_function &write)> &body_writer() const { return m_body_writer; }
+
 		private:
 			size_t m_code = 200;
 			std::string m_body = "";
 			std::string m_content_type = "text/html";
+			std::function<void(const write_function &write)> m_body_writer;
 
 	};
 
@@ -25,7 +25,9 @@
  */
 
 #include "server.h"
+#include "epoll_server.h"
 #include "fcgio.h"
+#include "config.h"
 #include "logger/logger.h"
 #include "URL.h"
 
@@ -42,7 +44,7 @@ namespace http {
 
 	void server::run_worker(int socket_id) {
 
-		const size_t max_post_len = 1024*1024*1024;
+		const size_t max_post_len = config::http_max_body_mb * 1024 * 1024;
 		const size_t buffer_len = 1024*1024;
 		std::unique_ptr<char[]> buffer_allocator = std::make_unique<char[]>(buffer_len);
 		char *buffer = buffer_allocator.get();
@@ -105,7 +107,20 @@ namespace http {
 			FCGX_FPrintF(request.out, status.c_str());
 			FCGX_FPrintF(request.out, content_type.c_str());
 			FCGX_FPrintF(request.out, end_req.c_str());
-			FCGX_PutStr(data_out.c_str(), data_out.size(), request.out);
+
+			if (http_response.body_writer()) {
+				// Flush every part so it reaches the client as soon as it is written. nginx has to be configured
+				// with fastcgi_buffering off for this location to pass it on.
+				try {
+					http_response.body_writer()([&request](const std::string &data) {
+						return FCGX_PutStr(data.c_str(), data.size(), request.out) >= 0 && FCGX_FFlush(request.out) == 0;
+					});
+				} catch (const std::exception &error) {
+					LOG_ERROR("Body writer failed: " + std::string(error.what()));
+				}
+			} else {
+				FCGX_PutStr(data_out.c_str(), data_out.size(), request.out);
+			}
 
 			FCGX_Finish_r(&request);
 		}
@@ -113,10 +128,24 @@ namespace http {
 		FCGX_Free(&request, true);
 	}
 
+	/*
+	 * Serves FastCGI behind nginx by default. With http_frontend = epoll in the config we speak HTTP directly on
+	 * the same address.
+	 * */
 	void server::start() {
+		if (config::http_frontend == "epoll") {
+			epoll_server srv(m_handler, "127.0.0.1", config::http_port, m_workers, config::http_max_body_mb * 1024 * 1024);
+			srv.run();
+			return;
+		}
+		start_fastcgi();
+	}
+
+	void server::start_fastcgi() {
 		FCGX_Init();
 
-		int socket_id = FCGX_OpenSocket("127.0.0.1:8000", 20);
+		const std::string address = "127.0.0.1:" + std::to_string(config::http_port);
+		int socket_id = FCGX_OpenSocket(address.c_str(), 20);
 		if (socket_id < 0) {
 			LOG_INFO("Could not open socket, exiting");
 			return;
@@ -46,6 +46,7 @@ namespace http {
 
 			void run_worker(int socket_id);
 			void start();
+			void start_fastcgi();
 	};
 
 }
@@ -28,6 +28,7 @@
 
 #include "index_reader.h"
 #include "index_base.h"
+#include "file/mmap_file.h"
 #include <vector>
 
 namespace indexer {
@@ -54,10 +55,20 @@ namespace indexer {
 		 * */
 		void for_each(std::function<void(uint64_t key, std::vector<data_record> &recs)> on_each_key) const;
 
+		/*
+		 * Path of the data file of index id in db_name.
+		 * */
+		static std::string shard_filename(const std::string &db_name, size_t id);
+
 	private:
 
 		mutable std::istream *m_reader;
 		std::unique_ptr<std::ifstream> m_default_reader;
+
+		/*
+		 * Set when the index is opened from a file. Lookups are then served from the mapping without locking.
+		 * */
+		std::unique_ptr<file::mmap_file> m_mmap;
 		
 		std::string m_file_name;
 		std::string m_db_name;
@@ -69,28 +80,26 @@ namespace indexer {
 		std::string mountpoint() const;
 		std::string filename() const;
 		std::string meta_filename() const;
+		void open_file();
 		
 	};
 
 	template<typename data_record>
 	counted_index<data_record>::counted_index(const std::string &file_name)
 	: index_base<data_record>(), m_file_name(file_name) {
-		m_default_reader = std::make_unique<std::ifstream>(filename(), std::ios::binary);
-		m_reader = m_default_reader.get();
+		open_file();
 	}
 
 	template<typename data_record>
 	counted_index<data_record>::counted_index(const std::string &db_name, size_t id)
 	: index_base<data_record>(), m_db_name(db_name), m_id(id) {
-		m_default_reader = std::make_unique<std::ifstream>(filename(), std::ios::binary);
-		m_reader = m_default_reader.get();
+		open_file();
 	}
 
 	template<typename data_record>
 	counted_index<data_record>::counted_index(const std::string &db_name, size_t id, size_t hash_table_size)
 	: index_base<data_record>(hash_table_size), m_db_name(db_name), m_id(id) {
-		m_default_reader = std::make_unique<std::ifstream>(filename(), std::ios::binary);
-		m_reader = m_default_reader.get();
+		open_file();
 	}
 
 	template<typename data_record>
@@ -111,8 +120,6 @@ namespace indexer {
 	template<typename data_record>
 	std::vector<data_record> counted_index<data_record>::find(uint64_t key, size_t limit) const {
 
-		std::lock_guard lock(this->m_lock);
-
 		size_t num_records;
 		unique_ptr<data_record[]> ptr = find_ptr(key, limit, num_records);
 
@@ -133,10 +140,33 @@ namespace indexer {
 	template<typename data_record>
 	std::unique_ptr<data_record[]> counted_index<data_record>::find_ptr(uint64_t key, size_t limit, size_t &num_records) const {
 
-		std::lock_guard lock(this->m_lock);
-
 		num_records = 0;
 
+		if (m_mmap) {
+			size_t len;
+			bool compressed;
+			const char *data = this->find_mapped_data(m_mmap->data(), m_mmap->size(), key, len, &compressed);
+			if (data == nullptr) {
+				return {};
+			}
+
+			if (compressed) {
+				return page_codec::decode_records<data_record>(data, len, limit, num_records);
+			}
+
+			num_records = len / sizeof(data_record);
+			if (limit && num_records > limit) {
+				num_records = limit;
+			}
+
+			std::unique_ptr<data_record[]> ret = std::make_unique<data_record[]>(num_records);
+			memcpy((char *)ret.get(), data, num_records * sizeof(data_record));
+
+			return ret;
+		}
+
+		std::lock_guard lock(this->m_lock);
+
 		size_t key_pos = read_key_pos(key);
 
 		if (key_pos == SIZE_MAX) {
@@ -147,17 +177,14 @@ namespace indexer {
 		m_reader->seekg(key_pos);
 		size_t num_keys;
 		m_reader->read((char *)&num_keys, sizeof(size_t));
+		const bool compressed = num_keys & page_codec::compressed_page_flag;
+		num_keys &= ~page_codec::compressed_page_flag;
 
 		std::unique_ptr<uint64_t[]> keys_allocator = std::make_unique<uint64_t[]>(num_keys);
 		uint64_t *keys = keys_allocator.get();
 		m_reader->read((char *)keys, num_keys * sizeof(uint64_t));
 
-		size_t key_data_pos = SIZE_MAX;
-		for (size_t i = 0; i < num_keys; i++) {
-			if (keys[i] == key) {
-				key_data_pos = i;
-			}
-		}
+		const size_t key_data_pos = this->search_page_keys((const char *)keys, num_keys, key);
 
 		if (key_data_pos == SIZE_MAX) {
 			return {};
@@ -176,6 +203,12 @@ namespace indexer {
 
 		m_reader->seekg(key_pos + 8 + (num_keys * 8)*3 + pos);
 
+		if (compressed) {
+			std::unique_ptr<char[]> data = std::make_unique<char[]>(len);
+			m_reader->read(data.get(), len);
+			return page_codec::decode_records<data_record>(data.get(), len, limit, num_records);
+		}
+
 		num_records = len / sizeof(data_record);
 
 		if (limit && num_records > limit) {
@@ -247,16 +280,35 @@ namespace indexer {
 		m_unique_count = m.unique_count;
 	}
 
+	/*
+	 * Maps the index file into memory. Falls back to reading with an ifstream if the file could not be mapped,
+	 * for example if it does not exist.
+	 * */
+	template<typename data_record>
+	void counted_index<data_record>::open_file() {
+		m_mmap = std::make_unique<file::mmap_file>(filename());
+		if (!m_mmap->is_open()) {
+			m_mmap.reset();
+			m_default_reader = std::make_unique<std::ifstream>(filename(), std::ios::binary);
+		}
+		m_reader = m_default_reader.get();
+	}
+
 	template<typename data_record>
 	std::string counted_index<data_record>::mountpoint() const {
 		return std::to_string(m_id % 8);
 	}
 
+	template<typename data_record>
+	std::string counted_index<data_record>::shard_filename(const std::string &db_name, size_t id) {
+		return config::data_path() + "/" + std::to_string(id % 8) + "/full_text/" + db_name + "/" + std::to_string(id) +
+			".data";
+	}
+
 	template<typename data_record>
 	std::string counted_index<data_record>::filename() const {
 		if (m_file_name != "") return m_file_name + ".data";
-		return config::data_path() + "/" + mountpoint() + "/full_text/" + m_db_name + "/" + std::to_string(m_id) +
-			".data";
+		return shard_filename(m_db_name, m_id);
 	}
 
 	template<typename data_record>
@@ -42,7 +42,11 @@
 #include "logger/logger.h"
 #include "memory/debugger.h"
 #include "file/file.h"
+#include "file/atomic_file_writer.h"
 #include "index_base.h"
+#include "index_generation.h"
+#include "page_codec.h"
+#include "external_sorter.h"
 
 namespace indexer {
 
@@ -83,6 +87,7 @@ namespace indexer {
 		const size_t m_buffer_len = config::ft_shard_builder_buffer_len;
 		char *m_buffer;
 		std::mutex m_lock;
+		std::shared_ptr<merger::appender> m_appender;
 
 		// Caches
 		std::vector<uint64_t> m_key_cache;
@@ -90,15 +95,21 @@ namespace indexer {
 
 		std::map<uint64_t, vector<data_record>> m_cache;
 
-		void read_append_cache();
+		/*
+		 * Appended record as it is sorted by merge.
+		 * */
+		struct cache_item {
+			uint64_t m_key;
+			data_record m_record;
+		};
+
+		void read_append_cache(external_sorter<cache_item> &sorter);
 		void read_data_to_cache();
-		void sort_cache();
 		void sort_record_list(uint64_t key, std::vector<data_record> &records);
 		void reset_cache_variables();
 		void save_file();
-		void write_key(std::ofstream &key_writer, uint64_t key, size_t page_pos);
-		size_t write_page(std::ofstream &writer, const std::vector<uint64_t> &keys);
-		void reset_key_map(std::ofstream &key_writer);
+		size_t write_page(file::atomic_file_writer &writer, const std::vector<uint64_t> &keys,
+			std::map<uint64_t, std::vector<data_record>> &records);
 
 		std::string mountpoint() const;
 		std::string cache_filename() const;
@@ -114,28 +125,28 @@ namespace indexer {
 		m_max_results(config::ft_max_results_per_section)
 	{
 		merger::register_merger((size_t)this, [this]() {merge();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
 	counted_index_builder<data_record>::counted_index_builder(const std::string &db_name, size_t id)
 	: index_base<data_record>(), m_db_name(db_name), m_id(id), m_max_results(config::ft_max_results_per_section) {
 		merger::register_merger((size_t)this, [this]() {merge();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
 	counted_index_builder<data_record>::counted_index_builder(const std::string &db_name, size_t id, size_t hash_table_size)
 	: index_base<data_record>(hash_table_size), m_db_name(db_name), m_id(id), m_max_results(config::ft_max_results_per_section) {
 		merger::register_merger((size_t)this, [this]() {append();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
 	counted_index_builder<data_record>::counted_index_builder(const std::string &db_name, size_t id, size_t hash_table_size, size_t max_results)
 	: index_base<data_record>(hash_table_size), m_db_name(db_name), m_id(id), m_max_results(max_results) {
 		merger::register_merger((size_t)this, [this]() {append();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
@@ -146,7 +157,7 @@ namespace indexer {
 	template<typename data_record>
 	void counted_index_builder<data_record>::add(uint64_t key, const data_record &record) {
 
-		indexer::merger::lock();
+		indexer::merger::lock(*m_appender);
 
 		m_lock.lock();
 
@@ -171,6 +182,8 @@ namespace indexer {
 	template<typename data_record>
 	void counted_index_builder<data_record>::append() {
 
+		std::lock_guard guard(m_lock);
+
 		assert(m_record_cache.size() == m_key_cache.size());
 
 		std::ofstream record_writer(cache_filename(), std::ios::binary | std::ios::app);
@@ -194,16 +207,113 @@ namespace indexer {
 		m_key_cache.shrink_to_fit();
 	}
 
+	/*
+	 * Merges the appended records into the shard without reading the whole shard into memory. The appended
+	 * (key, record) pairs are sorted with external_sorter within merger::merge_memory_budget() and merged key by key
+	 * with the pages of the current file, which are stored in the same order. The result is written to a temporary
+	 * file that then replaces the shard.
+	 * */
 	template<typename data_record>
 	void counted_index_builder<data_record>::merge() {
 
-		{
-			read_append_cache();
-			sort_cache();
-			save_file();
-			truncate_cache_files();
+		external_sorter<cache_item> sorter(cache_filename(), this->m_hash_table_size,
+			merger::merge_memory_budget() / (2 * sizeof(cache_item)));
+
+		read_append_cache(sorter);
+		sorter.finish();
+
+		file::atomic_file_writer writer(target_filename());
+
+		// Page positions, written over the placeholder when all pages are written.
+		std::vector<size_t> hash_table(this->m_hash_table_size, SIZE_MAX);
+		writer.write((char *)hash_table.data(), this->hash_table_byte_size());
+
+		std::ifstream reader(target_filename(), std::ios::binary);
+		bool has_pages = false;
+		if (reader.is_open()) {
+			reader.seekg(0, std::ios::end);
+			const size_t file_size = reader.tellg();
+			if (file_size > this->hash_table_byte_size()) {
+				reader.seekg(this->hash_table_byte_size(), std::ios::beg);
+				has_pages = true;
+			}
+		}
+
+		// The page of the current file we are at.
+		std::map<uint64_t, std::vector<data_record>> old_page;
+		auto old_iter = old_page.end();
+
+		// The page we are writing.
+		std::map<uint64_t, std::vector<data_record>> page;
+		size_t page_slot = 0;
+
+		auto write_current_page = [this, &writer, &hash_table, &page, &page_slot]() {
+			std::vector<uint64_t> keys;
+			for (const auto &iter : page) keys.push_back(iter.first);
+			const size_t page_pos = write_page(writer, keys, page);
+			if (this->m_hash_table_size) hash_table[page_slot] = page_pos;
+			page.clear();
+		};
+
+		auto add_to_page = [this, &sorter, &page, &page_slot, &write_current_page](uint64_t key,
+				std::vector<data_record> &records) {
+			const size_t slot = sorter.slot(key);
+			if (page.size() && slot != page_slot) {
+				write_current_page();
+			}
+			page_slot = slot;
+			sort_record_list(key, records);
+			page[key] = std::move(records);
+		};
+
+		uint64_t new_key = 0;
+		std::vector<cache_item> new_items;
+		bool has_new = sorter.next(new_key, new_items);
+
+		std::vector<data_record> records;
+		while (true) {
+
+			while (old_iter == old_page.end() && has_pages) {
+				old_page.clear();
+				has_pages = this->read_page_into(reader, old_page);
+				old_iter = old_page.begin();
+			}
+			const bool has_old = old_iter != old_page.end();
+
+			if (!has_old && !has_new) break;
+
+			records.clear();
+			uint64_t key;
+			if (has_old && (!has_new || !sorter.less(new_key, old_iter->first))) {
+				key = old_iter->first;
+				records.swap(old_iter->second);
+				++old_iter;
+			} else {
+				key = new_key;
+			}
+			if (has_new && new_key == key) {
+				for (const cache_item &item : new_items) {
+					records.push_back(item.m_record);
+				}
+				has_new = sorter.next(new_key, new_items);
+			}
+
+			add_to_page(key, records);
+		}
+
+		if (page.size()) {
+			write_current_page();
 		}
 
+		reader.close();
+
+		writer.pwrite(0, (char *)hash_table.data(), this->hash_table_byte_size());
+		writer.commit();
+
+		// Results cached by the servers are stale now.
+		touch_index_generation();
+
+		truncate_cache_files();
 	}
 
 	/*
@@ -245,8 +355,11 @@ namespace indexer {
 		create_directories();
 		truncate_cache_files();
 
-		std::ofstream target_writer(target_filename(), std::ios::trunc);
-		target_writer.close();
+		// Replace the file instead of truncating it, readers may have it mapped.
+		file::atomic_file_writer target_writer(target_filename());
+		target_writer.commit();
+
+		touch_index_generation();
 	}
 
 	/*
@@ -270,14 +383,8 @@ namespace indexer {
 	}
 
 	template<typename data_record>
-	void counted_index_builder<data_record>::read_append_cache() {
+	void counted_index_builder<data_record>::read_append_cache(external_sorter<cache_item> &sorter) {
 
-		// Read the current file.
-		read_data_to_cache();
-
-		//profiler::instance prof("index_builder::read_append_cache");
-
-		// Read the cache into memory.
 		std::ifstream reader(cache_filename(), std::ios::binary);
 		if (!reader.is_open()) {
 			throw LOG_ERROR_EXCEPTION("Could not open full text shard (" + cache_filename() + "). Error: " + std::string(strerror(errno)));
@@ -290,32 +397,12 @@ namespace indexer {
 
 		const size_t buffer_len = 10000;
 
-		std::unique_ptr<data_record[]> buffer_allocator;
-		try {
-			buffer_allocator = std::make_unique<data_record[]>(buffer_len);
-		} catch (std::bad_alloc &exception) {
-			std::cout << "bad_alloc detected: " << exception.what() << " file: " << __FILE__ << " line: " << __LINE__ << std::endl;
-			std::cout << "tried to allocate: " << buffer_len * sizeof(data_record) << " bytes" << std::endl;
-			return;
-		}
-
-		std::unique_ptr<uint64_t[]> key_buffer_allocator;
-		try {
-			key_buffer_allocator = std::make_unique<uint64_t[]>(buffer_len);
-		} catch (std::bad_alloc &exception) {
-			std::cout << "bad_alloc detected: " << exception.what() << " file: " << __FILE__ << " line: " << __LINE__ << std::endl;
-			std::cout << "tried to allocate: " << buffer_len * sizeof(uint64_t) << " bytes" << std::endl;
-			return;
-		}
+		std::unique_ptr<data_record[]> buffer_allocator = std::make_unique<data_record[]>(buffer_len);
+		std::unique_ptr<uint64_t[]> key_buffer_allocator = std::make_unique<uint64_t[]>(buffer_len);
 
 		data_record *buffer = buffer_allocator.get();
 		uint64_t *key_buffer = key_buffer_allocator.get();
 
-		reader.seekg(0, std::ios::beg);
-
-		unordered_map<uint64_t, uint32_t> internal_id_map; 
-		unordered_map<uint64_t, vector<uint32_t>> bitmap_data;
-
 		while (!reader.eof()) {
 
 			reader.read((char *)buffer, buffer_len * sizeof(data_record));
@@ -325,7 +412,7 @@ namespace indexer {
 			const size_t num_records = read_bytes / sizeof(data_record);
 
 			for (size_t i = 0; i < num_records; i++) {
-				m_cache[key_buffer[i]].push_back(buffer[i]);
+				sorter.add(cache_item{key_buffer[i], buffer[i]});
 			}
 		}
 	}
@@ -350,13 +437,6 @@ namespace indexer {
 		}
 	}
 
-	template<typename data_record>
-	void counted_index_builder<data_record>::sort_cache() {
-		for (auto &iter : m_cache) {
-			sort_record_list(iter.first, iter.second);
-		}
-	}
-
 	template<typename data_record>
 	void counted_index_builder<data_record>::sort_record_list(uint64_t key, std::vector<data_record> &records) {
 
@@ -392,17 +472,19 @@ namespace indexer {
 		m_cache = std::map<uint64_t, vector<data_record>>{};
 	}
 
+	/*
+	 * Streams the file to a temporary file that replaces the shard when it is complete.
+	 * */
 	template<typename data_record>
 	void counted_index_builder<data_record>::save_file() {
 
 		//profiler::instance prof("index_builder::save_file");
 
-		std::ofstream writer(target_filename(), std::ios::binary | std::ios::trunc);
-		if (!writer.is_open()) {
-			throw LOG_ERROR_EXCEPTION("Could not open full text shard. Error: " + std::string(strerror(errno)));
-		}
+		file::atomic_file_writer writer(target_filename());
 
-		reset_key_map(writer);
+		// Page positions, written over the placeholder when all pages are written.
+		std::vector<size_t> hash_table(this->m_hash_table_size, SIZE_MAX);
+		writer.write((char *)hash_table.data(), this->hash_table_byte_size());
 
 		std::map<uint64_t, std::vector<uint64_t>> pages;
 		for (auto &iter : m_cache) {
@@ -414,45 +496,50 @@ namespace indexer {
 		}
 
 		for (const auto &iter : pages) {
-			size_t page_pos = write_page(writer, iter.second);
-			write_key(writer, iter.first, page_pos);
-			writer.flush();
+			size_t page_pos = write_page(writer, iter.second, m_cache);
+			if (this->m_hash_table_size) hash_table[iter.first] = page_pos;
 		}
-	}
 
-	template<typename data_record>
-	void counted_index_builder<data_record>::write_key(std::ofstream &key_writer, uint64_t key, size_t page_pos) {
-		if (this->m_hash_table_size > 0) {
-			assert(key < this->m_hash_table_size);
-			key_writer.seekp(key * sizeof(uint64_t));
-			key_writer.write((char *)&page_pos, sizeof(size_t));
-		}
+		writer.pwrite(0, (char *)hash_table.data(), this->hash_table_byte_size());
+		writer.commit();
+
+		// Results cached by the servers are stale now.
+		touch_index_generation();
 	}
 
 	/*
 	 * Writes the page with keys, appending it to the file stream writer.
 	 * */
 	template<typename data_record>
-	size_t counted_index_builder<data_record>::write_page(std::ofstream &writer, const std::vector<uint64_t> &keys) {
+	size_t counted_index_builder<data_record>::write_page(file::atomic_file_writer &writer, const std::vector<uint64_t> &keys,
+			std::map<uint64_t, std::vector<data_record>> &records) {
 
-		writer.seekp(0, ios::end);
+		const size_t page_pos = writer.size();
 
-		const size_t page_pos = writer.tellp();
+		const bool compress = config::index_compress_pages;
 
 		size_t num_keys = keys.size();
+		if (compress) num_keys |= page_codec::compressed_page_flag;
 
 		writer.write((char *)&num_keys, 8);
 		writer.write((char *)keys.data(), keys.size() * 8);
 
 		std::vector<size_t> v_pos;
 		std::vector<size_t> v_len;
+		std::vector<std::string> encoded;
 
 		size_t pos = 0;
 		for (uint64_t key : keys) {
 
+			const std::vector<data_record> &key_records = records[key];
+			size_t len = key_records.size() * sizeof(data_record);
+			if (compress) {
+				encoded.emplace_back();
+				page_codec::encode_records<data_record>(key_records.data(), key_records.size(), encoded.back());
+				len = encoded.back().size();
+			}
+
 			// Store position and length
-			const size_t len = m_cache[key].size() * sizeof(data_record);
-			
 			v_pos.push_back(pos);
 			v_len.push_back(len);
 
@@ -466,22 +553,17 @@ namespace indexer {
 		size_t i = 0;
 		for (uint64_t key : keys) {
 			const size_t len = v_len[i];
-			writer.write((char *)m_cache[key].data(), len);
+			if (compress) {
+				writer.write(encoded[i].data(), len);
+			} else {
+				writer.write((char *)records[key].data(), len);
+			}
 			i++;
 		}
 
 		return page_pos;
 	}
 
-	template<typename data_record>
-	void counted_index_builder<data_record>::reset_key_map(std::ofstream &key_writer) {
-		key_writer.seekp(0);
-		uint64_t data = SIZE_MAX;
-		for (size_t i = 0; i < this->m_hash_table_size; i++) {
-			key_writer.write((char *)&data, sizeof(uint64_t));
-		}
-	}
-
 	template<typename data_record>
 	std::string counted_index_builder<data_record>::mountpoint() const {
 		return std::to_string(m_id % 8);
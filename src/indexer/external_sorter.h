@@ -0,0 +1,233 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include "algorithm/radix_sort.h"
+#include "algorithm/loser_tree.h"
+#include "logger/logger.h"
+#include "file/file.h"
+
+namespace indexer {
+
+	/*
+	 * Sorts items with a uint64_t m_key member in the order shard files store their keys, by hash table slot
+	 * (key % hash_table_size) and then by key. Items are collected in chunks of at most max_items, each full chunk
+	 * is radix sorted and written to a run file named run_prefix.run<n>. next() merges the runs with a loser tree.
+	 * If everything fits in one chunk nothing is written to disk.
+	 * */
+	template<typename item>
+	class external_sorter {
+
+	public:
+
+		external_sorter(const std::string &run_prefix, size_t hash_table_size, size_t max_items);
+		~external_sorter();
+
+		void add(const item &it);
+
+		/*
+		 * Must be called after the last add and before next.
+		 * */
+		void finish();
+
+		/*
+		 * Replaces items with all items of the next key. Returns false when there are no more items.
+		 * */
+		bool next(uint64_t &key, std::vector<item> &items);
+
+		size_t num_runs() const { return m_run_files.size(); }
+
+		size_t slot(uint64_t key) const {
+			return m_hash_table_size ? key % m_hash_table_size : 0;
+		}
+
+		bool less(uint64_t a, uint64_t b) const {
+			const size_t slot_a = slot(a);
+			const size_t slot_b = slot(b);
+			return slot_a < slot_b || (slot_a == slot_b && a < b);
+		}
+
+	private:
+
+		struct run_reader {
+			std::ifstream file;
+			std::vector<item> buffer;
+			size_t pos = 0;
+			size_t len = 0;
+
+			const item *head() const {
+				return pos < len ? &buffer[pos] : nullptr;
+			}
+
+			void fill() {
+				pos = len = 0;
+				if (!file.is_open()) return;
+				file.read((char *)buffer.data(), buffer.size() * sizeof(item));
+				len = file.gcount() / sizeof(item);
+			}
+
+			const item *next() {
+				if (++pos >= len) fill();
+				return head();
+			}
+		};
+
+		struct compare_items {
+			const external_sorter *sorter;
+			bool operator()(const item &a, const item &b) const {
+				return sorter->less(a.m_key, b.m_key);
+			}
+		};
+
+		using tree_type = ::algorithm::loser_tree<item, compare_items>;
+
+		const std::string m_run_prefix;
+		const size_t m_hash_table_size;
+		const size_t m_max_items;
+
+		std::vector<item> m_chunk;
+		std::vector<std::string> m_run_files;
+		std::vector<std::unique_ptr<run_reader>> m_readers;
+		std::unique_ptr<tree_type> m_tree;
+
+		void sort_chunk();
+		void write_run();
+
+	};
+
+	template<typename item>
+	external_sorter<item>::external_sorter(const std::string &run_prefix, size_t hash_table_size, size_t max_items)
+	: m_run_prefix(run_prefix), m_hash_table_size(hash_table_size), m_max_items(std::max<size_t>(max_items, 1024)) {
+	}
+
+	template<typename item>
+	external_sorter<item>::~external_sorter() {
+		m_readers.clear();
+		for (const std::string &run_file : m_run_files) {
+			file::delete_file(run_file);
+		}
+	}
+
+	template<typename item>
+	void external_sorter<item>::add(const item &it) {
+		if (m_chunk.size() == m_max_items) {
+			write_run();
+		}
+		if (m_chunk.capacity() == 0) {
+			m_chunk.reserve(m_max_items);
+		}
+		m_chunk.push_back(it);
+	}
+
+	template<typename item>
+	void external_sorter<item>::finish() {
+
+		if (m_run_files.size() && m_chunk.size()) {
+			write_run();
+		}
+
+		if (m_run_files.size()) {
+			// Split the budget between the run buffers.
+			const size_t buffer_len = std::max<size_t>(m_max_items / m_run_files.size(), 1024);
+			for (const std::string &run_file : m_run_files) {
+				auto reader = std::make_unique<run_reader>();
+				reader->file.open(run_file, std::ios::binary);
+				if (!reader->file.is_open()) {
+					throw LOG_ERROR_EXCEPTION("Could not open run file " + run_file + ". Error: " +
+						std::string(strerror(errno)));
+				}
+				reader->buffer.resize(buffer_len);
+				reader->fill();
+				m_readers.push_back(std::move(reader));
+			}
+		} else {
+			sort_chunk();
+			auto reader = std::make_unique<run_reader>();
+			reader->buffer.swap(m_chunk);
+			reader->len = reader->buffer.size();
+			m_readers.push_back(std::move(reader));
+		}
+		m_chunk = std::vector<item>{};
+
+		m_tree = std::make_unique<tree_type>(m_readers.size(), compare_items{this});
+		for (size_t i = 0; i < m_readers.size(); i++) {
+			m_tree->set(i, m_readers[i]->head());
+		}
+		m_tree->build();
+	}
+
+	template<typename item>
+	bool external_sorter<item>::next(uint64_t &key, std::vector<item> &items) {
+
+		items.clear();
+
+		const item *head = m_tree->winner_head();
+		if (head == nullptr) return false;
+
+		key = head->m_key;
+		while (head != nullptr && head->m_key == key) {
+			items.push_back(*head);
+			m_tree->replace_winner(m_readers[m_tree->winner()]->next());
+			head = m_tree->winner_head();
+		}
+
+		return true;
+	}
+
+	template<typename item>
+	void external_sorter<item>::sort_chunk() {
+		std::vector<item> tmp;
+		::algorithm::radix_sort(m_chunk, tmp, [](const item &it) { return it.m_key; });
+		if (m_hash_table_size) {
+			::algorithm::radix_sort(m_chunk, tmp, [this](const item &it) { return (uint64_t)slot(it.m_key); });
+		}
+	}
+
+	template<typename item>
+	void external_sorter<item>::write_run() {
+
+		sort_chunk();
+
+		const std::string run_file = m_run_prefix + ".run" + std::to_string(m_run_files.size());
+		std::ofstream writer(run_file, std::ios::binary | std::ios::trunc);
+		if (!writer.is_open()) {
+			throw LOG_ERROR_EXCEPTION("Could not open run file " + run_file + ". Error: " + std::string(strerror(errno)));
+		}
+		writer.write((const char *)m_chunk.data(), m_chunk.size() * sizeof(item));
+		writer.close();
+
+		m_run_files.push_back(run_file);
+		m_chunk.clear();
+	}
+
+}
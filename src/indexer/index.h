@@ -29,7 +29,9 @@
 #include <set>
 #include <cmath>
 #include <mutex>
+#include <queue>
 #include "index_base.h"
+#include "file/mmap_file.h"
 #include "roaring/roaring.hh"
 #include "algorithm/intersection.h"
 #include "algorithm/top_k.h"
@@ -60,6 +62,7 @@ namespace indexer {
 		 * Find intersection of multiple keys applying lambda function score_mod to the scores before.
 		 * Returns n records with highest score.
 		 * score_mod is applied in storage_order of data_record.
+		 * Scores are kept in a per thread buffer so this can be called from several threads at once.
 		 * */
 		std::vector<data_record> find_top(size_t &total_num_results, const std::vector<uint64_t> &keys, size_t n,
 				std::function<float(const data_record &)> score_mod = [](const data_record &) { return 0.0f; }) const;
@@ -70,6 +73,15 @@ namespace indexer {
 		std::vector<data_record> find_top(const std::vector<uint64_t> &keys, size_t n,
 				std::function<float(const data_record &)> score_mod = [](const data_record &) { return 0.0f; }) const;
 
+		/*
+		 * Same as find_top but skips whole blocks of records that can't make it into the top n (block-max pruning).
+		 * score_mod_bound(max_score) must return an upper bound of score_mod for any record with
+		 * m_score <= max_score. score_mod is still applied in storage_order but only to records in blocks that
+		 * are not skipped. total_num_results is the full size of the intersection.
+		 * */
+		std::vector<data_record> find_top(size_t &total_num_results, const std::vector<uint64_t> &keys, size_t n,
+				std::function<float(const data_record &)> score_mod, std::function<float(float)> score_mod_bound) const;
+
 		
 		/*
 		 * Returns inverse document frequency (idf) for the last search.
@@ -84,10 +96,21 @@ namespace indexer {
 
 		void for_each(std::function<void(uint64_t key, roaring::Roaring &bitmap)> on_each_key) const;
 
+		/*
+		 * Path of the data file of index id in db_name.
+		 * */
+		static std::string shard_filename(const std::string &db_name, size_t id);
+
 	private:
 
 		mutable std::istream *m_reader;
-		std::unique_ptr<std::ifstream> m_default_reader;
+		mutable std::unique_ptr<std::ifstream> m_default_reader;
+
+		/*
+		 * When the index is opened from a file we map it into memory and serve lookups from the mapping without
+		 * locking. m_reader is then only opened when we need to scan the whole file.
+		 * */
+		std::unique_ptr<file::mmap_file> m_mmap;
 
 		std::string m_file_name;
 		std::string m_db_name;
@@ -95,38 +118,44 @@ namespace indexer {
 		size_t m_unique_count = 0;
 
 		std::vector<data_record> m_records;
-		mutable std::vector<float> m_scores;
+
+		/*
+		 * Highest m_score in each block of block_size records. Calculated on the first pruned find_top.
+		 * */
+		static const size_t block_size = 512;
+		mutable std::vector<float> m_block_max;
+		mutable std::once_flag m_block_max_flag;
 
 		size_t read_key_pos(uint64_t key) const;
 		void read_meta();
 		std::string mountpoint() const;
 		std::string filename() const;
 		std::string meta_filename() const;
+		void open_file();
+		std::istream *stream() const;
 		void read_records();
+		void calculate_block_max() const;
 		
 	};
 
 	template<typename data_record>
 	index<data_record>::index(const std::string &file_name)
 	: index_base<data_record>(), m_file_name(file_name) {
-		m_default_reader = std::make_unique<std::ifstream>(filename(), std::ios::binary);
-		m_reader = m_default_reader.get();
+		open_file();
 		read_records();
 	}
 
 	template<typename data_record>
 	index<data_record>::index(const std::string &db_name, size_t id)
 	: index_base<data_record>(), m_db_name(db_name), m_id(id) {
-		m_default_reader = std::make_unique<std::ifstream>(filename(), std::ios::binary);
-		m_reader = m_default_reader.get();
+		open_file();
 		read_records();
 	}
 
 	template<typename data_record>
 	index<data_record>::index(const std::string &db_name, size_t id, size_t hash_table_size)
 	: index_base<data_record>(hash_table_size), m_db_name(db_name), m_id(id) {
-		m_default_reader = std::make_unique<std::ifstream>(filename(), std::ios::binary);
-		m_reader = m_default_reader.get();
+		open_file();
 		read_records();
 	}
 
@@ -144,20 +173,12 @@ namespace indexer {
 	template<typename data_record>
 	std::vector<data_record> index<data_record>::find(uint64_t key) const {
 
-		std::lock_guard lock(this->m_lock);
-
 		roaring::Roaring rr = find_bitmap(key);
 
-		std::function<data_record(uint32_t)> id_to_rec = [this](uint32_t id) {
-			data_record rec;
-			m_reader->seekg((this->m_hash_table_size + 1) * sizeof(uint64_t) + id * sizeof(data_record), std::ios::beg);
-			m_reader->read((char *)&rec, sizeof(data_record));
-			return rec;
-		};
-
+		// All records are already in m_records so we don't need to touch the file here.
 		std::vector<data_record> ret;
 		for (uint32_t internal_id : rr) {
-			ret.emplace_back(id_to_rec(internal_id));
+			ret.emplace_back(m_records[internal_id]);
 		}
 
 		return ret;
@@ -165,10 +186,20 @@ namespace indexer {
 
 	template<typename data_record>
 	roaring::Roaring index<data_record>::find_bitmap(uint64_t key) const {
-		size_t key_pos = read_key_pos(key);
+
+		if (m_mmap) {
+			size_t len;
+			const char *data = this->find_mapped_data(m_mmap->data(), m_mmap->size(), key, len);
+			if (data == nullptr) {
+				return roaring::Roaring();
+			}
+			return roaring::Roaring::readSafe(data, len);
+		}
 
 		std::lock_guard lock(this->m_lock);
 
+		size_t key_pos = read_key_pos(key);
+
 		if (key_pos == SIZE_MAX) {
 			return roaring::Roaring();
 		}
@@ -182,12 +213,7 @@ namespace indexer {
 		uint64_t *keys = keys_allocator.get();
 		m_reader->read((char *)keys, num_keys * sizeof(uint64_t));
 
-		size_t key_data_pos = SIZE_MAX;
-		for (size_t i = 0; i < num_keys; i++) {
-			if (keys[i] == key) {
-				key_data_pos = i;
-			}
-		}
+		const size_t key_data_pos = this->search_page_keys((const char *)keys, num_keys, key);
 
 		if (key_data_pos == SIZE_MAX) {
 			return roaring::Roaring();
@@ -217,8 +243,6 @@ namespace indexer {
 	template<typename data_record>
 	std::vector<data_record> index<data_record>::find_intersection(const std::vector<uint64_t> &keys) const {
 
-		std::lock_guard lock(this->m_lock);
-
 		std::vector<roaring::Roaring> bitmaps;
 		for (auto key : keys) {
 			bitmaps.emplace_back(std::move(find_bitmap(key)));
@@ -237,8 +261,6 @@ namespace indexer {
 	std::vector<data_record> index<data_record>::find_top(size_t &total_num_results, const std::vector<uint64_t> &keys, size_t num,
 			std::function<float(const data_record &)> score_mod) const {
 
-		std::lock_guard lock(this->m_lock);
-
 		std::vector<roaring::Roaring> bitmaps;
 		for (auto key : keys) {
 			bitmaps.emplace_back(std::move(find_bitmap(key)));
@@ -255,15 +277,17 @@ namespace indexer {
 
 		total_num_results = intersection.cardinality();
 
+		score_buffer scores(m_records.size());
+
 		// Apply score modifications.
 		std::vector<uint32_t> ids;
 		for (auto internal_id : intersection) {
 			ids.push_back(internal_id);
-			m_scores[internal_id] = m_records[internal_id].m_score + score_mod(m_records[internal_id]);
+			scores[internal_id] = m_records[internal_id].m_score + score_mod(m_records[internal_id]);
 		}
 
-		auto ordered = [this](const uint32_t &a, const uint32_t &b) {
-			return m_scores[a] < m_scores[b];
+		auto ordered = [&scores](const uint32_t &a, const uint32_t &b) {
+			return scores[a] < scores[b];
 		};
 
 		std::vector<uint32_t> top_ids = ::algorithm::top_k<uint32_t>(ids, num, ordered);
@@ -271,7 +295,7 @@ namespace indexer {
 		std::vector<data_record> ret;
 		for (uint32_t internal_id : top_ids) {
 			ret.push_back(m_records[internal_id]);
-			ret.back().m_score = m_scores[internal_id];
+			ret.back().m_score = scores[internal_id];
 		}
 
 		std::sort(ret.begin(), ret.end(), typename data_record::truncate_order());
@@ -286,6 +310,72 @@ namespace indexer {
 		return find_top(total_num_results, keys, num, score_mod);
 	}
 
+	template<typename data_record>
+	std::vector<data_record> index<data_record>::find_top(size_t &total_num_results, const std::vector<uint64_t> &keys, size_t num,
+			std::function<float(const data_record &)> score_mod, std::function<float(float)> score_mod_bound) const {
+
+		std::vector<roaring::Roaring> bitmaps;
+		for (auto key : keys) {
+			bitmaps.emplace_back(std::move(find_bitmap(key)));
+		}
+
+		if (keys.size() == 0) {
+			// Return all records...
+			roaring::Roaring all_ids;
+			all_ids.addRange(0, m_records.size());
+			bitmaps.push_back(all_ids);
+		}
+
+		auto intersection = ::algorithm::intersection(bitmaps);
+
+		total_num_results = intersection.cardinality();
+
+		if (num == 0) return {};
+
+		std::call_once(m_block_max_flag, [this]() { calculate_block_max(); });
+
+		// Min heap with the current top num (score, internal_id), top() is the score to beat.
+		typedef std::pair<float, uint32_t> scored_id;
+		std::priority_queue<scored_id, std::vector<scored_id>, std::greater<scored_id>> top;
+
+		auto iter = intersection.begin();
+		const auto end = intersection.end();
+		while (iter != end) {
+			const size_t block = *iter / block_size;
+			const uint64_t block_end = (block + 1) * block_size;
+
+			const float max_score = m_block_max[block];
+			if (top.size() == num && max_score + score_mod_bound(max_score) <= top.top().first) {
+				// Nothing in this block can beat the current top, jump to the next block.
+				if (block_end > UINT32_MAX) break;
+				iter.equalorlarger(block_end);
+				continue;
+			}
+
+			for (; iter != end && *iter < block_end; ++iter) {
+				const uint32_t internal_id = *iter;
+				const float score = m_records[internal_id].m_score + score_mod(m_records[internal_id]);
+				if (top.size() < num) {
+					top.emplace(score, internal_id);
+				} else if (score > top.top().first) {
+					top.pop();
+					top.emplace(score, internal_id);
+				}
+			}
+		}
+
+		std::vector<data_record> ret;
+		while (top.size()) {
+			ret.push_back(m_records[top.top().second]);
+			ret.back().m_score = top.top().first;
+			top.pop();
+		}
+
+		std::sort(ret.begin(), ret.end(), typename data_record::truncate_order());
+
+		return ret;
+	}
+
 	template<typename data_record>
 	float index<data_record>::get_idf(size_t documents_with_term) const {
 		if (documents_with_term) {
@@ -307,6 +397,13 @@ namespace indexer {
 
 		const size_t hash_pos = key % this->m_hash_table_size;
 
+		if (m_mmap) {
+			if ((hash_pos + 1) * sizeof(size_t) > m_mmap->size()) return SIZE_MAX;
+			size_t pos;
+			memcpy(&pos, &m_mmap->data()[hash_pos * sizeof(size_t)], sizeof(size_t));
+			return pos;
+		}
+
 		m_reader->seekg(hash_pos * sizeof(size_t), std::ios::beg);
 
 		size_t pos;
@@ -340,11 +437,16 @@ namespace indexer {
 		return std::to_string(m_id % 8);
 	}
 
+	template<typename data_record>
+	std::string index<data_record>::shard_filename(const std::string &db_name, size_t id) {
+		return config::data_path() + "/" + std::to_string(id % 8) + "/full_text/" + db_name + "/" + std::to_string(id) +
+			".data";
+	}
+
 	template<typename data_record>
 	std::string index<data_record>::filename() const {
 		if (m_file_name != "") return m_file_name + ".data";
-		return config::data_path() + "/" + mountpoint() + "/full_text/" + m_db_name + "/" + std::to_string(m_id) +
-			".data";
+		return shard_filename(m_db_name, m_id);
 	}
 
 	template<typename data_record>
@@ -367,8 +469,11 @@ namespace indexer {
 		size_t total_cardinality = 0;
 		size_t total_page_header_size = 0;
 
-		m_reader->seekg(this->hash_table_byte_size(), std::ios::beg);
-		m_reader->read((char *)&total_num_records, sizeof(size_t));
+		std::lock_guard lock(this->m_lock);
+
+		std::istream *reader = stream();
+		reader->seekg(this->hash_table_byte_size(), std::ios::beg);
+		reader->read((char *)&total_num_records, sizeof(size_t));
 
 		total_record_size = total_num_records * sizeof(data_record);
 
@@ -380,15 +485,15 @@ namespace indexer {
 			}
 
 			// Read page.
-			m_reader->seekg(key_pos, std::ios::beg);
+			reader->seekg(key_pos, std::ios::beg);
 			size_t num_keys;
-			m_reader->read((char *)&num_keys, sizeof(size_t));
+			reader->read((char *)&num_keys, sizeof(size_t));
 
 			total_num_keys += num_keys;
 
 			std::unique_ptr<uint64_t[]> keys_allocator = std::make_unique<uint64_t[]>(num_keys);
 			uint64_t *keys = keys_allocator.get();
-			m_reader->read((char *)keys, num_keys * sizeof(uint64_t));
+			reader->read((char *)keys, num_keys * sizeof(uint64_t));
 			total_page_header_size += num_keys * sizeof(uint64_t) * 3;
 
 			for (size_t i = 0; i < num_keys; i++) {
@@ -397,20 +502,20 @@ namespace indexer {
 				char buffer[64];
 
 				// Read position and length.
-				m_reader->seekg(key_pos + 8 + num_keys * 8 + key_data_pos * 8, std::ios::beg);
-				m_reader->read(buffer, 8);
+				reader->seekg(key_pos + 8 + num_keys * 8 + key_data_pos * 8, std::ios::beg);
+				reader->read(buffer, 8);
 				size_t pos = *((size_t *)(&buffer[0]));
 
-				m_reader->seekg(key_pos + 8 + (num_keys * 8)*2 + key_data_pos * 8, std::ios::beg);
-				m_reader->read(buffer, 8);
+				reader->seekg(key_pos + 8 + (num_keys * 8)*2 + key_data_pos * 8, std::ios::beg);
+				reader->read(buffer, 8);
 				size_t len = *((size_t *)(&buffer[0]));
 
-				m_reader->seekg(key_pos + 8 + (num_keys * 8)*3 + pos, std::ios::beg);
+				reader->seekg(key_pos + 8 + (num_keys * 8)*3 + pos, std::ios::beg);
 
 				std::unique_ptr<char[]> data_allocator = std::make_unique<char[]>(len);
 				char *data = data_allocator.get();
 
-				m_reader->read(data, len);
+				reader->read(data, len);
 
 				roaring::Roaring rr = roaring::Roaring::readSafe(data, len);
 
@@ -442,6 +547,10 @@ namespace indexer {
 
 		std::set<uint64_t> all_keys;
 
+		std::lock_guard lock(this->m_lock);
+
+		std::istream *reader = stream();
+
 		for (size_t page = 0; page < this->m_hash_table_size; page++) {
 			size_t key_pos = read_key_pos(page);
 
@@ -450,13 +559,13 @@ namespace indexer {
 			}
 
 			// Read page.
-			m_reader->seekg(key_pos, std::ios::beg);
+			reader->seekg(key_pos, std::ios::beg);
 			size_t num_keys;
-			m_reader->read((char *)&num_keys, sizeof(size_t));
+			reader->read((char *)&num_keys, sizeof(size_t));
 
 			std::unique_ptr<uint64_t[]> keys_allocator = std::make_unique<uint64_t[]>(num_keys);
 			uint64_t *keys = keys_allocator.get();
-			m_reader->read((char *)keys, num_keys * sizeof(uint64_t));
+			reader->read((char *)keys, num_keys * sizeof(uint64_t));
 
 			for (size_t i = 0; i < num_keys; i++) {
 				size_t key_data_pos = i;
@@ -464,20 +573,20 @@ namespace indexer {
 				char buffer[64];
 
 				// Read position and length.
-				m_reader->seekg(key_pos + 8 + num_keys * 8 + key_data_pos * 8, std::ios::beg);
-				m_reader->read(buffer, 8);
+				reader->seekg(key_pos + 8 + num_keys * 8 + key_data_pos * 8, std::ios::beg);
+				reader->read(buffer, 8);
 				size_t pos = *((size_t *)(&buffer[0]));
 
-				m_reader->seekg(key_pos + 8 + (num_keys * 8)*2 + key_data_pos * 8, std::ios::beg);
-				m_reader->read(buffer, 8);
+				reader->seekg(key_pos + 8 + (num_keys * 8)*2 + key_data_pos * 8, std::ios::beg);
+				reader->read(buffer, 8);
 				size_t len = *((size_t *)(&buffer[0]));
 
-				m_reader->seekg(key_pos + 8 + (num_keys * 8)*3 + pos, std::ios::beg);
+				reader->seekg(key_pos + 8 + (num_keys * 8)*3 + pos, std::ios::beg);
 
 				std::unique_ptr<char[]> data_allocator = std::make_unique<char[]>(len);
 				char *data = data_allocator.get();
 
-				m_reader->read(data, len);
+				reader->read(data, len);
 
 				roaring::Roaring rr = roaring::Roaring::readSafe(data, len);
 
@@ -494,14 +603,17 @@ namespace indexer {
 	template<typename data_record>
 	void index<data_record>::for_each(std::function<void(uint64_t key, roaring::Roaring &bitmap)> on_each_key) const {
 
-		m_reader->seekg(this->hash_table_byte_size(), std::ios::beg);
+		std::lock_guard lock(this->m_lock);
+
+		std::istream *reader = stream();
+		reader->seekg(this->hash_table_byte_size(), std::ios::beg);
 
 		size_t num_records = 0;
-		m_reader->read((char *)&num_records, sizeof(size_t));
-		m_reader->seekg(num_records * sizeof(data_record), std::ios::cur);
+		reader->read((char *)&num_records, sizeof(size_t));
+		reader->seekg(num_records * sizeof(data_record), std::ios::cur);
 
 		std::map<uint64_t, roaring::Roaring> page;
-		while (this->read_bitmap_page_into(*m_reader, page)) {
+		while (this->read_bitmap_page_into(*reader, page)) {
 			for (auto &iter : page) {
 				on_each_key(iter.first, iter.second);
 			}
@@ -509,15 +621,60 @@ namespace indexer {
 		}
 	}
 
+	/*
+	 * Maps the index file into memory. Falls back to reading with an ifstream if the file could not be mapped,
+	 * for example if it does not exist.
+	 * */
+	template<typename data_record>
+	void index<data_record>::open_file() {
+		m_mmap = std::make_unique<file::mmap_file>(filename());
+		if (!m_mmap->is_open()) {
+			m_mmap.reset();
+			m_default_reader = std::make_unique<std::ifstream>(filename(), std::ios::binary);
+		}
+		m_reader = m_default_reader.get();
+	}
+
+	/*
+	 * Returns a stream for the functions that scan the whole file. Opens it on the first call if we are reading
+	 * from a memory mapping. Must be called with m_lock held.
+	 * */
+	template<typename data_record>
+	std::istream *index<data_record>::stream() const {
+		if (m_reader == nullptr) {
+			m_default_reader = std::make_unique<std::ifstream>(filename(), std::ios::binary);
+			m_reader = m_default_reader.get();
+		}
+		return m_reader;
+	}
+
 	template<typename data_record>
 	void index<data_record>::read_records() {
 		size_t num_records = 0;
+		if (m_mmap) {
+			const size_t records_pos = this->hash_table_byte_size() + sizeof(uint64_t);
+			if (records_pos <= m_mmap->size()) {
+				memcpy(&num_records, &m_mmap->data()[this->hash_table_byte_size()], sizeof(uint64_t));
+			}
+			if (records_pos + num_records * sizeof(data_record) > m_mmap->size()) {
+				num_records = 0;
+			}
+			m_records.resize(num_records);
+			memcpy((char *)m_records.data(), &m_mmap->data()[records_pos], num_records * sizeof(data_record));
+			return;
+		}
 		m_reader->seekg(this->hash_table_byte_size());
 		m_reader->read((char *)&num_records, sizeof(uint64_t));
 		m_records.resize(num_records);
 		m_reader->read((char *)m_records.data(), num_records * sizeof(data_record));
-		m_scores.resize(num_records);
-		std::fill(m_scores.begin(), m_scores.end(), 0.0f);
+	}
+
+	template<typename data_record>
+	void index<data_record>::calculate_block_max() const {
+		m_block_max.assign((m_records.size() + block_size - 1) / block_size, -INFINITY);
+		for (size_t i = 0; i < m_records.size(); i++) {
+			m_block_max[i / block_size] = std::max(m_block_max[i / block_size], m_records[i].m_score);
+		}
 	}
 
 }
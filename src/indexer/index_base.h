@@ -28,12 +28,56 @@
 
 #include <vector>
 #include <memory>
+#include <cstring>
 #include "config.h"
 #include "logger/logger.h"
 #include "roaring/roaring.hh"
+#include "page_codec.h"
 
 namespace indexer {
 
+	/*
+	 * Score buffer used by find_top, indexed by internal id. Each thread keeps one buffer so concurrent queries
+	 * against the same reader don't share any state. The buffer grows to the largest index the thread has queried
+	 * and is never cleared, find_top only reads the positions it wrote in the same call.
+	 *
+	 * The buffer is taken out of the thread cache for the lifetime of the object and handed back when it is
+	 * destroyed, so a score_mod that runs find_top on the same thread gets a buffer of its own.
+	 * */
+	class score_buffer {
+
+		public:
+
+			explicit score_buffer(size_t num_records) {
+				m_scores.swap(cached());
+				if (m_scores.size() < num_records) {
+					m_scores.resize(num_records);
+				}
+			}
+
+			~score_buffer() {
+				if (m_scores.size() > cached().size()) {
+					m_scores.swap(cached());
+				}
+			}
+
+			score_buffer(const score_buffer &) = delete;
+			score_buffer &operator=(const score_buffer &) = delete;
+
+			float &operator[](size_t i) { return m_scores[i]; }
+			float operator[](size_t i) const { return m_scores[i]; }
+
+		private:
+
+			std::vector<float> m_scores;
+
+			static std::vector<float> &cached() {
+				thread_local std::vector<float> buffer;
+				return buffer;
+			}
+
+	};
+
 	template<typename data_record>
 	class index_base {
 
@@ -51,6 +95,9 @@ namespace indexer {
 
 			bool read_page_into(std::istream &reader, std::map<uint64_t, std::vector<data_record>> &into) const;
 			bool read_bitmap_page_into(std::istream &reader, std::map<uint64_t, roaring::Roaring> &into) const;
+			const char *find_mapped_data(const char *file_data, size_t file_size, uint64_t key, size_t &len,
+				bool *compressed = nullptr) const;
+			static size_t search_page_keys(const char *keys, size_t num_keys, uint64_t key);
 			size_t hash_table_byte_size() const { return m_hash_table_size * sizeof(size_t); }
 	};
 
@@ -71,6 +118,9 @@ namespace indexer {
 		reader.read((char *)&num_keys, sizeof(uint64_t));
 		if (reader.eof()) return false;
 
+		const bool compressed = num_keys & page_codec::compressed_page_flag;
+		num_keys &= ~page_codec::compressed_page_flag;
+
 		std::unique_ptr<char[]> vector_buffer_allocator;
 		try {
 			vector_buffer_allocator = std::make_unique<char[]>(num_keys * sizeof(uint64_t));
@@ -130,6 +180,15 @@ namespace indexer {
 				return false;
 			}
 
+			if (compressed) {
+				size_t num_records;
+				std::unique_ptr<data_record[]> records = page_codec::decode_records<data_record>(buffer, len, 0, num_records);
+				for (size_t j = 0; j < num_records; j++) {
+					into[keys[i]].push_back(records[j]);
+				}
+				continue;
+			}
+
 			const data_record *records = (data_record *)buffer;
 			const size_t num_records = len / sizeof(data_record);
 
@@ -213,4 +272,73 @@ namespace indexer {
 		return true;
 	}
 
+	/*
+	 * Branchless binary search in the sorted keys array of a page. Returns the position of key or SIZE_MAX if the
+	 * page does not contain it. Keys are read with memcpy since pages in a mapped file are not aligned.
+	 * */
+	template<typename data_record>
+	size_t index_base<data_record>::search_page_keys(const char *keys, size_t num_keys, uint64_t key) {
+
+		if (num_keys == 0) return SIZE_MAX;
+
+		auto key_at = [keys](size_t i) {
+			uint64_t page_key;
+			memcpy(&page_key, &keys[i * sizeof(uint64_t)], sizeof(uint64_t));
+			return page_key;
+		};
+
+		size_t base = 0;
+		size_t len = num_keys;
+		while (len > 1) {
+			const size_t half = len / 2;
+			base = (key_at(base + half) <= key) ? base + half : base;
+			len -= half;
+		}
+
+		return key_at(base) == key ? base : SIZE_MAX;
+	}
+
+	/*
+	 * Finds the data stored for key in a memory mapped index file. Returns a pointer into file_data and sets len
+	 * to the length of the data. Returns nullptr if the key is not present or the file is truncated. If compressed
+	 * is given it is set to whether the page holding the key is compressed.
+	 * */
+	template<typename data_record>
+	const char *index_base<data_record>::find_mapped_data(const char *file_data, size_t file_size, uint64_t key,
+			size_t &len, bool *compressed) const {
+
+		len = 0;
+
+		size_t key_pos = 0;
+		if (m_hash_table_size) {
+			const size_t hash_pos = key % m_hash_table_size;
+			if ((hash_pos + 1) * sizeof(size_t) > file_size) return nullptr;
+			memcpy(&key_pos, &file_data[hash_pos * sizeof(size_t)], sizeof(size_t));
+		}
+
+		if (key_pos == SIZE_MAX || key_pos + sizeof(uint64_t) > file_size) return nullptr;
+
+		uint64_t num_keys;
+		memcpy(&num_keys, &file_data[key_pos], sizeof(uint64_t));
+		if (compressed) *compressed = num_keys & page_codec::compressed_page_flag;
+		num_keys &= ~page_codec::compressed_page_flag;
+
+		const size_t keys_pos = key_pos + sizeof(uint64_t);
+		const size_t data_start = keys_pos + num_keys * sizeof(uint64_t) * 3;
+		if (data_start > file_size) return nullptr;
+
+		const size_t key_data_pos = search_page_keys(&file_data[keys_pos], num_keys, key);
+
+		if (key_data_pos == SIZE_MAX) return nullptr;
+
+		size_t pos, data_len;
+		memcpy(&pos, &file_data[keys_pos + (num_keys + key_data_pos) * sizeof(uint64_t)], sizeof(size_t));
+		memcpy(&data_len, &file_data[keys_pos + (num_keys * 2 + key_data_pos) * sizeof(uint64_t)], sizeof(size_t));
+
+		if (data_start + pos + data_len > file_size) return nullptr;
+
+		len = data_len;
+		return &file_data[data_start + pos];
+	}
+
 }
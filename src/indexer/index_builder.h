@@ -35,17 +35,19 @@
 #include <cassert>
 #include <numeric>
 #include <boost/filesystem.hpp>
-#include <sstream>
 #include "merger.h"
 #include "score_builder.h"
 #include "index_utils.h"
 #include "index_base.h"
+#include "index_generation.h"
+#include "external_sorter.h"
 #include "index.h"
 #include "algorithm/hyper_log_log.h"
 #include "config.h"
 #include "profiler/profiler.h"
 #include "logger/logger.h"
 #include "file/file.h"
+#include "file/atomic_file_writer.h"
 #include "memory/debugger.h"
 #include "roaring/roaring.hh"
 #include "URL.h"
@@ -118,6 +120,7 @@ namespace indexer {
 		const size_t m_max_results;
 
 		std::mutex m_lock;
+		std::shared_ptr<merger::appender> m_appender;
 
 		// Caches
 		std::vector<uint64_t> m_key_cache;
@@ -136,17 +139,26 @@ namespace indexer {
 			return m_record_id_map[record.m_value];
 		};
 
-		void read_append_cache();
-		void read_append_cache(std::unordered_map<uint64_t, uint32_t> &internal_id_map);
+		/*
+		 * Appended key with the internal id of its record as it is sorted by merge.
+		 * */
+		#pragma pack(4)
+		struct cache_item {
+			uint64_t m_key;
+			uint32_t m_internal_id;
+		};
+		#pragma pack()
+
+		void read_append_cache(external_sorter<cache_item> &sorter, std::unordered_map<uint64_t, uint32_t> &internal_id_map);
 		void read_data_to_cache();
+		bool read_records_to_cache(std::ifstream &reader);
 		bool read_page(std::ifstream &reader);
 		void reset_cache_variables();
 		void save_file();
-		void write_key(std::ostream &key_writer, uint64_t key, size_t page_pos);
-		size_t write_page(std::ostream &writer, const std::vector<uint64_t> &keys);
-		void reset_key_map(std::ostream &key_writer);
+		size_t write_page(file::atomic_file_writer &writer, const std::vector<uint64_t> &keys,
+			std::map<uint64_t, roaring::Roaring> &bitmaps);
 		std::vector<data_record> read_records() const;
-		void write_records(std::ostream &writer);
+		void write_records(file::atomic_file_writer &writer);
 		uint32_t default_record_to_internal_id(const data_record &record);
 
 		std::string mountpoint() const;
@@ -167,7 +179,7 @@ namespace indexer {
 		m_max_results(config::ft_max_results_per_section)
 	{
 		merger::register_merger((size_t)this, [this]() {merge();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
@@ -176,28 +188,28 @@ namespace indexer {
 		m_max_results(config::ft_max_results_per_section)
 	{
 		merger::register_merger((size_t)this, [this]() {merge();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
 	index_builder<data_record>::index_builder(const std::string &db_name, size_t id)
 	: index_base<data_record>(), m_db_name(db_name), m_id(id), m_max_results(config::ft_max_results_per_section) {
 		merger::register_merger((size_t)this, [this]() {merge();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
 	index_builder<data_record>::index_builder(const std::string &db_name, size_t id, size_t hash_table_size)
 	: index_base<data_record>(hash_table_size), m_db_name(db_name), m_id(id), m_max_results(config::ft_max_results_per_section) {
 		merger::register_merger((size_t)this, [this]() {merge();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
 	index_builder<data_record>::index_builder(const std::string &db_name, size_t id, size_t hash_table_size, size_t max_results)
 	: index_base<data_record>(hash_table_size), m_db_name(db_name), m_id(id), m_max_results(max_results) {
 		merger::register_merger((size_t)this, [this]() {merge();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
@@ -206,7 +218,7 @@ namespace indexer {
 	: index_base<data_record>(), m_db_name(db_name), m_id(id), m_max_results(config::ft_max_results_per_section) {
 		m_record_id_to_internal_id = rec_to_id;
 		merger::register_merger((size_t)this, [this]() {merge();});
-		merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
+		m_appender = merger::register_appender((size_t)this, [this]() {append();}, [this]() { return cache_size(); });
 	}
 
 	template<typename data_record>
@@ -216,7 +228,7 @@ namespace indexer {
 
 	template<typename data_record>
 	void index_builder<data_record>::add(uint64_t key, const data_record &record) {
-		indexer::merger::lock();
+		indexer::merger::lock(*m_appender);
 
 		std::lock_guard guard(m_lock);
 
@@ -259,6 +271,8 @@ namespace indexer {
 	template<typename data_record>
 	void index_builder<data_record>::append() {
 
+		std::lock_guard guard(m_lock);
+
 		assert(m_record_cache.size() == m_key_cache.size());
 
 		std::ofstream record_writer(cache_filename(), std::ios::binary | std::ios::app);
@@ -288,15 +302,102 @@ namespace indexer {
 		merge(internal_id_map);
 	}
 
+	/*
+	 * Merges the appended records into the shard without reading the bitmaps of the whole shard into memory. The
+	 * records are mapped to internal ids, the (key, internal id) pairs are sorted with external_sorter within
+	 * merger::merge_memory_budget() and merged key by key with the pages of the current file, which are stored in
+	 * the same order. The result is written to a temporary file that then replaces the shard.
+	 * */
 	template<typename data_record>
 	void index_builder<data_record>::merge(std::unordered_map<uint64_t, uint32_t> &internal_id_map) {
 
-		{
-			read_append_cache(internal_id_map);
-			save_file();
-			truncate_cache_files();
+		external_sorter<cache_item> sorter(cache_filename(), this->m_hash_table_size,
+			merger::merge_memory_budget() / (2 * sizeof(cache_item)));
+
+		std::ifstream reader(target_filename(), std::ios::binary);
+		bool has_pages = read_records_to_cache(reader);
+
+		read_append_cache(sorter, internal_id_map);
+		sorter.finish();
+
+		file::atomic_file_writer writer(target_filename());
+
+		// Page positions, written over the placeholder when all pages are written.
+		std::vector<size_t> hash_table(this->m_hash_table_size, SIZE_MAX);
+		writer.write((char *)hash_table.data(), this->hash_table_byte_size());
+		write_records(writer);
+
+		// The page of the current file we are at.
+		std::map<uint64_t, roaring::Roaring> old_page;
+		auto old_iter = old_page.end();
+
+		// The page we are writing.
+		std::map<uint64_t, roaring::Roaring> page;
+		size_t page_slot = 0;
+
+		auto write_current_page = [this, &writer, &hash_table, &page, &page_slot]() {
+			std::vector<uint64_t> keys;
+			for (const auto &iter : page) keys.push_back(iter.first);
+			const size_t page_pos = write_page(writer, keys, page);
+			if (this->m_hash_table_size) hash_table[page_slot] = page_pos;
+			page.clear();
+		};
+
+		uint64_t new_key = 0;
+		std::vector<cache_item> new_items;
+		bool has_new = sorter.next(new_key, new_items);
+
+		std::vector<uint32_t> internal_ids;
+		while (true) {
+
+			while (old_iter == old_page.end() && has_pages) {
+				old_page.clear();
+				has_pages = this->read_bitmap_page_into(reader, old_page);
+				old_iter = old_page.begin();
+			}
+			const bool has_old = old_iter != old_page.end();
+
+			if (!has_old && !has_new) break;
+
+			uint64_t key;
+			roaring::Roaring bitmap;
+			if (has_old && (!has_new || !sorter.less(new_key, old_iter->first))) {
+				key = old_iter->first;
+				bitmap = std::move(old_iter->second);
+				++old_iter;
+			} else {
+				key = new_key;
+			}
+			if (has_new && new_key == key) {
+				internal_ids.clear();
+				for (const cache_item &item : new_items) {
+					internal_ids.push_back(item.m_internal_id);
+				}
+				bitmap.addMany(internal_ids.size(), internal_ids.data());
+				has_new = sorter.next(new_key, new_items);
+			}
+
+			const size_t slot = sorter.slot(key);
+			if (page.size() && slot != page_slot) {
+				write_current_page();
+			}
+			page_slot = slot;
+			page[key] = std::move(bitmap);
+		}
+
+		if (page.size()) {
+			write_current_page();
 		}
 
+		reader.close();
+
+		writer.pwrite(0, (char *)hash_table.data(), this->hash_table_byte_size());
+		writer.commit();
+
+		// Results cached by the servers are stale now.
+		touch_index_generation();
+
+		truncate_cache_files();
 	}
 
 	template<typename data_record>
@@ -375,8 +476,11 @@ namespace indexer {
 		create_directories();
 		truncate_cache_files();
 
-		std::ofstream target_writer(target_filename(), std::ios::trunc);
-		target_writer.close();
+		// Replace the file instead of truncating it, readers may have it mapped.
+		file::atomic_file_writer target_writer(target_filename());
+		target_writer.commit();
+
+		touch_index_generation();
 	}
 
 	/*
@@ -421,20 +525,11 @@ namespace indexer {
 	}
 
 	template<typename data_record>
-	void index_builder<data_record>::read_append_cache() {
-		std::unordered_map<uint64_t, uint32_t> internal_id_map;
-		read_append_cache(internal_id_map);
-	}
-
-	template<typename data_record>
-	void index_builder<data_record>::read_append_cache(std::unordered_map<uint64_t, uint32_t> &internal_id_map) {
-
-		// Read the current file.
-		read_data_to_cache();
+	void index_builder<data_record>::read_append_cache(external_sorter<cache_item> &sorter,
+			std::unordered_map<uint64_t, uint32_t> &internal_id_map) {
 
 		//profiler::instance prof("index_builder::read_append_cache");
 
-		// Read the cache into memory.
 		std::ifstream reader(cache_filename(), std::ios::binary);
 		if (!reader.is_open()) {
 			throw LOG_ERROR_EXCEPTION("Could not open full text shard (" + cache_filename() + "). Error: " + std::string(strerror(errno)));
@@ -447,31 +542,12 @@ namespace indexer {
 
 		const size_t buffer_len = 10000;
 
-		std::unique_ptr<data_record[]> buffer_allocator;
-		try {
-			buffer_allocator = std::make_unique<data_record[]>(buffer_len);
-		} catch (std::bad_alloc &exception) {
-			std::cout << "bad_alloc detected: " << exception.what() << " file: " << __FILE__ << " line: " << __LINE__ << std::endl;
-			std::cout << "tried to allocate: " << buffer_len * sizeof(data_record) << " bytes" << std::endl;
-			return;
-		}
-
-		std::unique_ptr<uint64_t[]> key_buffer_allocator;
-		try {
-			key_buffer_allocator = std::make_unique<uint64_t[]>(buffer_len);
-		} catch (std::bad_alloc &exception) {
-			std::cout << "bad_alloc detected: " << exception.what() << " file: " << __FILE__ << " line: " << __LINE__ << std::endl;
-			std::cout << "tried to allocate: " << buffer_len * sizeof(uint64_t) << " bytes" << std::endl;
-			return;
-		}
+		std::unique_ptr<data_record[]> buffer_allocator = std::make_unique<data_record[]>(buffer_len);
+		std::unique_ptr<uint64_t[]> key_buffer_allocator = std::make_unique<uint64_t[]>(buffer_len);
 
 		data_record *buffer = buffer_allocator.get();
 		uint64_t *key_buffer = key_buffer_allocator.get();
 
-		reader.seekg(0, std::ios::beg);
-
-		std::unordered_map<uint64_t, vector<uint32_t>> bitmap_data;
-
 		while (!reader.eof()) {
 
 			reader.read((char *)buffer, buffer_len * sizeof(data_record));
@@ -485,17 +561,12 @@ namespace indexer {
 				if (map_iter == internal_id_map.end()) {
 					const uint32_t internal_id = m_record_id_to_internal_id(buffer[i]);
 					internal_id_map[buffer[i].m_value] = internal_id;
-					bitmap_data[key_buffer[i]].push_back(internal_id);
+					sorter.add(cache_item{key_buffer[i], internal_id});
 				} else {
-					bitmap_data[key_buffer[i]].push_back(map_iter->second);
+					sorter.add(cache_item{key_buffer[i], map_iter->second});
 				}
 			}
 		}
-
-		// Insert the bitmap data.
-		for (const auto &iter : bitmap_data) {
-			m_bitmaps[iter.first].addMany(iter.second.size(), iter.second.data());
-		}
 	}
 
 	/*
@@ -506,14 +577,27 @@ namespace indexer {
 
 		//profiler::instance prof("index_builder::read_data_to_cache");
 
+		std::ifstream reader(target_filename(), std::ios::binary);
+		if (!read_records_to_cache(reader)) return;
+
+		while (this->read_bitmap_page_into(reader, m_bitmaps)) {
+		}
+	}
+
+	/*
+	 * Resets the caches and reads the records of the file into m_records and m_record_id_map. Returns true if the
+	 * reader is positioned at the first page.
+	 * */
+	template<typename data_record>
+	bool index_builder<data_record>::read_records_to_cache(std::ifstream &reader) {
+
 		reset_cache_variables();
 
-		std::ifstream reader(target_filename(), std::ios::binary);
-		if (!reader.is_open()) return;
+		if (!reader.is_open()) return false;
 
 		reader.seekg(0, std::ios::end);
 		const size_t file_size = reader.tellg();
-		if (file_size <= this->hash_table_byte_size()) return;
+		if (file_size <= this->hash_table_byte_size()) return false;
 		reader.seekg(this->hash_table_byte_size(), std::ios::beg);
 
 		size_t num_records;
@@ -538,8 +622,7 @@ namespace indexer {
 			records_read += records_to_read;
 		}
 
-		while (this->read_bitmap_page_into(reader, m_bitmaps)) {
-		}
+		return true;
 	}
 
 	template<typename data_record>
@@ -549,14 +632,19 @@ namespace indexer {
 		m_bitmaps = std::map<uint64_t, roaring::Roaring>{};
 	}
 
+	/*
+	 * Streams the file to a temporary file that replaces the shard when it is complete.
+	 * */
 	template<typename data_record>
 	void index_builder<data_record>::save_file() {
 
 		//profiler::instance prof("index_builder::save_file");
 
-		std::ostringstream writer;
+		file::atomic_file_writer writer(target_filename());
 
-		reset_key_map(writer);
+		// Page positions, written over the placeholder when all pages are written.
+		std::vector<size_t> hash_table(this->m_hash_table_size, SIZE_MAX);
+		writer.write((char *)hash_table.data(), this->hash_table_byte_size());
 		write_records(writer);
 
 		std::map<uint64_t, std::vector<uint64_t>> pages;
@@ -569,37 +657,25 @@ namespace indexer {
 		}
 
 		for (const auto &iter : pages) {
-			size_t page_pos = write_page(writer, iter.second);
-			write_key(writer, iter.first, page_pos);
-			writer.flush();
+			size_t page_pos = write_page(writer, iter.second, m_bitmaps);
+			if (this->m_hash_table_size) hash_table[iter.first] = page_pos;
 		}
 
-		std::ofstream file_writer(target_filename(), std::ios::binary | std::ios::trunc);
-		if (!file_writer.is_open()) {
-			throw LOG_ERROR_EXCEPTION("Could not open full text shard. Error: " + std::string(strerror(errno)));
-		}
+		writer.pwrite(0, (char *)hash_table.data(), this->hash_table_byte_size());
+		writer.commit();
 
-		file_writer.write(writer.str().c_str(), writer.str().size());
-	}
-
-	template<typename data_record>
-	void index_builder<data_record>::write_key(std::ostream &key_writer, uint64_t key, size_t page_pos) {
-		if (this->m_hash_table_size > 0) {
-			assert(key < this->m_hash_table_size);
-			key_writer.seekp(key * sizeof(uint64_t));
-			key_writer.write((char *)&page_pos, sizeof(size_t));
-		}
+		// Results cached by the servers are stale now.
+		touch_index_generation();
 	}
 
 	/*
 	 * Writes the page with keys, appending it to the file stream writer.
 	 * */
 	template<typename data_record>
-	size_t index_builder<data_record>::write_page(std::ostream &writer, const std::vector<uint64_t> &keys) {
-
-		writer.seekp(0, ios::end);
+	size_t index_builder<data_record>::write_page(file::atomic_file_writer &writer, const std::vector<uint64_t> &keys,
+			std::map<uint64_t, roaring::Roaring> &bitmaps) {
 
-		const size_t page_pos = writer.tellp();
+		const size_t page_pos = writer.size();
 
 		size_t num_keys = keys.size();
 
@@ -613,11 +689,11 @@ namespace indexer {
 		size_t pos = 0;
 		for (uint64_t key : keys) {
 
-			m_bitmaps[key].runOptimize();
-			m_bitmaps[key].shrinkToFit();
+			bitmaps[key].runOptimize();
+			bitmaps[key].shrinkToFit();
 
 			// Store position and length
-			const size_t len = m_bitmaps[key].getSizeInBytes();
+			const size_t len = bitmaps[key].getSizeInBytes();
 
 			if (len > max_len) max_len = len;
 			
@@ -635,23 +711,14 @@ namespace indexer {
 
 		// Write data.
 		for (uint64_t key : keys) {
-			const size_t len = m_bitmaps[key].getSizeInBytes();
-			m_bitmaps[key].write(buffer);
+			const size_t len = bitmaps[key].getSizeInBytes();
+			bitmaps[key].write(buffer);
 			writer.write(buffer, len);
 		}
 
 		return page_pos;
 	}
 
-	template<typename data_record>
-	void index_builder<data_record>::reset_key_map(std::ostream &key_writer) {
-		key_writer.seekp(0);
-		uint64_t data = SIZE_MAX;
-		for (size_t i = 0; i < this->m_hash_table_size; i++) {
-			key_writer.write((char *)&data, sizeof(uint64_t));
-		}
-	}
-
 	template<typename data_record>
 	std::vector<data_record> index_builder<data_record>::read_records() const {
 		ifstream reader(target_filename(), std::ios::in);
@@ -667,7 +734,7 @@ namespace indexer {
 	}
 
 	template<typename data_record>
-	void index_builder<data_record>::write_records(std::ostream &writer) {
+	void index_builder<data_record>::write_records(file::atomic_file_writer &writer) {
 		const size_t num_records = m_records.size();
 		writer.write((char *)&num_records, sizeof(uint64_t));
 		writer.write((char *)m_records.data(), num_records * sizeof(data_record));
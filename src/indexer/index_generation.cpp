@@ -0,0 +1,99 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "index_generation.h"
+#include "config.h"
+#include "logger/logger.h"
+#include <random>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace indexer {
+
+	/*
+	 * Returns 0 if there is no generation file.
+	 * */
+	uint64_t read_index_generation() {
+		const int fd = ::open(index_generation_filename().c_str(), O_RDONLY);
+		if (fd < 0) return 0;
+
+		uint64_t generation = 0;
+		if (::pread(fd, &generation, sizeof(generation), 0) != sizeof(generation)) generation = 0;
+		::close(fd);
+
+		return generation;
+	}
+
+	std::string index_generation_filename() {
+		return config::data_path() + "/index_generation";
+	}
+
+	/*
+	 * A random value instead of a counter so builders in different processes never write the same generation, and
+	 * written in place because the modification time is too coarse to tell two quick writes apart.
+	 * */
+	void touch_index_generation() {
+		thread_local std::mt19937_64 generator(std::random_device{}());
+		uint64_t generation;
+		do {
+			generation = generator();
+		} while (generation == 0);
+
+		const std::string filename = index_generation_filename();
+		const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+		if (fd < 0) {
+			LOG_ERROR("Could not open " + filename + ". Error: " + std::string(strerror(errno)));
+			return;
+		}
+		if (::pwrite(fd, &generation, sizeof(generation), 0) != sizeof(generation)) {
+			LOG_ERROR("Could not write " + filename + ". Error: " + std::string(strerror(errno)));
+		}
+		::close(fd);
+	}
+
+	index_generation_watch::index_generation_watch(std::chrono::milliseconds interval)
+	: m_interval(interval), m_next_check((std::chrono::steady_clock::now() + m_interval).time_since_epoch().count()),
+		m_generation(read_index_generation())
+	{
+	}
+
+	bool index_generation_watch::changed() {
+		const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+		if (now < m_next_check.load(std::memory_order_relaxed)) return false;
+
+		std::lock_guard lock(m_lock);
+		if (now < m_next_check.load(std::memory_order_relaxed)) return false;
+		m_next_check = now + m_interval.count();
+
+		const uint64_t generation = read_index_generation();
+		if (generation == m_generation) return false;
+		m_generation = generation;
+
+		return true;
+	}
+
+}
@@ -0,0 +1,66 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace indexer {
+
+	/*
+	 * The index builders write a new random value to the generation file every time they rewrite an index file.
+	 * Processes that only read the indexes, like the servers, watch the file to find out when what they have
+	 * cached is stale. The file lives in the data path so the watchers see writes from other processes.
+	 * */
+	std::string index_generation_filename();
+	void touch_index_generation();
+
+	/*
+	 * Reads the generation file at most once per interval. changed() returns true the first time it sees a new
+	 * generation, concurrent callers get false.
+	 * */
+	class index_generation_watch {
+
+		public:
+
+			explicit index_generation_watch(std::chrono::milliseconds interval = std::chrono::seconds(1));
+
+			bool changed();
+
+		private:
+
+			const std::chrono::steady_clock::duration m_interval;
+			std::mutex m_lock;
+			std::atomic<int64_t> m_next_check;
+			uint64_t m_generation;
+
+	};
+
+}
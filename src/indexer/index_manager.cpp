@@ -136,6 +136,8 @@ namespace indexer {
 		size_t parsed = 0;
 		vector<string> col_values;
 		set<uint64_t> tokens;
+		string word_buffer;
+		vector<string_view> words;
 		while (getline(infile, line)) {
 
 			col_values.clear();
@@ -163,7 +165,7 @@ namespace indexer {
 			//const uint64_t link_hash = source_url.link_hash(target_url, link_text);
 			//const bool has_url = true; //urls_to_index.count(target_url.hash());
 
-			vector<string> words = text::get_expanded_full_text_words(link_text);
+			text::get_expanded_full_text_words(link_text, word_buffer, words);
 
 			text::words_to_ngram_hash(words, 3, [&tokens](const uint64_t hash) {
 				tokens.insert(hash);
@@ -233,6 +235,8 @@ namespace indexer {
 		string line;
 		std::map<uint64_t, std::string> word_index;
 		set<uint64_t> tokens;
+		string word_buffer;
+		vector<string_view> words;
 		while (getline(infile, line)) {
 			vector<string> col_values;
 			boost::algorithm::split(col_values, line, boost::is_any_of("\t"));
@@ -243,7 +247,7 @@ namespace indexer {
 
 			uint64_t domain_hash = url.host_hash();
 
-			vector<string> words = text::get_full_text_words(col_values[title_col]);
+			text::get_full_text_words(col_values[title_col], word_buffer, words);
 
 			text::words_to_ngram_hash(words, 3, [&tokens](const uint64_t hash) {
 				tokens.insert(hash);
@@ -286,6 +290,8 @@ namespace indexer {
 		string line;
 		std::map<uint64_t, std::string> word_index;
 		set<uint64_t> tokens;
+		string word_buffer;
+		vector<string_view> words;
 		while (getline(infile, line)) {
 			vector<string> col_values;
 			boost::algorithm::split(col_values, line, boost::is_any_of("\t"));
@@ -299,7 +305,7 @@ namespace indexer {
 
 			const string link_text = col_values[4].substr(0, 1000);
 
-			vector<string> words = text::get_full_text_words(link_text);
+			text::get_full_text_words(link_text, word_buffer, words);
 
 			text::words_to_ngram_hash(words, 3, [&tokens, &word_index](const uint64_t hash, const string &ngram) {
 				tokens.insert(hash);
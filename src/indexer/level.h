@@ -42,6 +42,8 @@
 #include "domain_link_record.h"
 #include "domain_record.h"
 #include "algorithm/bloom_filter.h"
+#include "algorithm/intersection.h"
+#include "algorithm/sum_sorted.h"
 #include "return_record.h"
 
 namespace indexer {
@@ -83,56 +85,33 @@ namespace indexer {
 		mutex m_lock;
 	};
 
+	/*
+	 * Intersection of record vectors sorted by m_value, the score of each result is the mean of the scores.
+	 * */
 	template<typename data_record>
 	std::vector<return_record> level::intersection(const vector<vector<data_record>> &input) const {
 
 		if (input.size() == 0) return {};
 
-		size_t shortest_vector_position = 0;
-		size_t shortest_len = SIZE_MAX;
-		size_t iter_index = 0;
-		for (const vector<data_record> &vec : input) {
-			if (shortest_len > vec.size()) {
-				shortest_len = vec.size();
-				shortest_vector_position = iter_index;
-			}
-			iter_index++;
+		size_t shortest = 0;
+		vector<::algorithm::sorted_values> values;
+		for (size_t i = 0; i < input.size(); i++) {
+			if (input[i].size() == 0) return {};
+			if (input[i].size() < input[shortest].size()) shortest = i;
+			values.push_back(::algorithm::sorted_values{(const char *)input[i].data() + offsetof(data_record, m_value),
+				input[i].size(), sizeof(data_record)});
 		}
 
-		vector<size_t> positions(input.size(), 0);
-		vector<return_record> intersection;
-
-		while (positions[shortest_vector_position] < shortest_len) {
-
-			bool all_equal = true;
-			data_record value = input[shortest_vector_position][positions[shortest_vector_position]];
+		vector<vector<size_t>> positions = ::algorithm::intersection_positions(values);
 
+		vector<return_record> intersection;
+		for (size_t i = 0; i < positions[shortest].size(); i++) {
 			float score_sum = 0.0f;
-			size_t iter_index = 0;
-			for (const vector<data_record> &vec : input) {
-				const size_t len = vec.size();
-
-				size_t *pos = &(positions[iter_index]);
-				while (*pos < len && value.m_value > vec[*pos].m_value) {
-					(*pos)++;
-				}
-				if (*pos < len && value.m_value == vec[*pos].m_value) {
-					score_sum += vec[*pos].m_score;
-				}
-				if (((*pos < len) && (value.m_value < vec[*pos].m_value)) || *pos >= len) {
-					all_equal = false;
-					break;
-				}
-				iter_index++;
-			}
-			if (all_equal) {
-				intersection.emplace_back(return_record(
-					input[shortest_vector_position][positions[shortest_vector_position]].m_value,
-					score_sum / input.size()
-					));
+			for (size_t j = 0; j < input.size(); j++) {
+				score_sum += input[j][positions[j][i]].m_score;
 			}
-
-			positions[shortest_vector_position]++;
+			intersection.emplace_back(return_record(input[shortest][positions[shortest][i]].m_value,
+				score_sum / input.size()));
 		}
 
 		return intersection;
@@ -140,25 +119,30 @@ namespace indexer {
 
 	template<typename data_record>
 	std::vector<return_record> level::summed_union(const vector<vector<data_record>> &input) const {
-		vector<return_record> records;
-		for (const vector<data_record> &vec : input) {
-			for (const data_record &rec : vec) {
-				records.push_back(return_record(rec.m_value, rec.m_score));
+		vector<vector<return_record>> sorted(input.size());
+		for (size_t i = 0; i < input.size(); i++) {
+			sorted[i].reserve(input[i].size());
+			for (const data_record &rec : input[i]) {
+				sorted[i].push_back(return_record(rec.m_value, rec.m_score));
 			}
-		}
-		sort(records.begin(), records.end());
-		// Sum equal elements.
-		for (size_t i = 0, j = 1; i < records.size() && j < records.size(); j++) {
-			if (records[i] != records[j]) {
-				i = j;
-			} else {
-				records[i] += records[j];
+			if (!is_sorted(sorted[i].begin(), sorted[i].end())) {
+				sort(sorted[i].begin(), sorted[i].end());
 			}
+			// Sum equal elements within the same input.
+			size_t last = 0;
+			for (size_t j = 1; j < sorted[i].size(); j++) {
+				if (sorted[i][last] == sorted[i][j]) {
+					sorted[i][last] += sorted[i][j];
+				} else {
+					sorted[i][++last] = sorted[i][j];
+				}
+			}
+			if (sorted[i].size()) sorted[i].resize(last + 1);
 		}
-		// Delete consecutive elements. Only keeping the first.
-		auto last = std::unique(records.begin(), records.end());
-		records.erase(last, records.end());
-		return records;		
+		// Merge and sum equal elements.
+		return ::algorithm::sum_sorted<return_record>(sorted, [](return_record &a, const return_record &b) {
+			a += b;
+		});
 	}
 
 	template<typename data_record>
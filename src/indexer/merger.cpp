@@ -27,9 +27,16 @@
 #include "merger.h"
 #include "memory/memory.h"
 #include "memory/debugger.h"
+#include "config.h"
+#include "logger/logger.h"
 #include "utils/thread_pool.hpp"
 #include <map>
-#include <chrono>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <exception>
 #include <thread>
 
 using namespace std;
@@ -38,35 +45,148 @@ namespace indexer {
 
 	namespace merger {
 
+		/*
+		 * State of one registered appender. m_flushing is set while its append function runs, threads adding to the
+		 * builder wait on m_flushed until it is done.
+		 * */
+		struct appender {
+			std::function<void()> m_append;
+			std::function<size_t()> m_size;
+			std::mutex m_lock;
+			std::condition_variable m_flushed;
+			std::atomic<bool> m_flushing = false;
+			std::atomic<size_t> m_num_locks = 0;
+			bool m_removed = false;
+			size_t m_last_size = 0;
+		};
+
 		double mem_limit = 0.4;
 
-		bool is_merging = false;
+		// Sizes that trigger flushes, SIZE_MAX while the merge thread is not running.
+		std::atomic<size_t> flush_limit = SIZE_MAX;
+		std::atomic<size_t> high_watermark = SIZE_MAX;
+
+		// Sum of the last reported sizes of all appenders.
+		std::atomic<size_t> total_size = 0;
+
+		map<size_t, std::shared_ptr<appender>> appenders;
 		map<size_t, std::function<void()>> mergers;
-		map<size_t, std::function<void()>> appenders;
-		map<size_t, std::function<size_t()>> sizes;
-		mutex merger_lock;
+		std::shared_mutex merger_lock;
+
+		bool merge_thread_is_running = false;
+		std::atomic<bool> flush_requested = false;
+		std::mutex merge_thread_lock;
+		std::condition_variable merge_thread_cv;
+		thread merge_thread_obj;
+
+		// Set while first_error holds an error, lets lock() skip error_lock.
+		std::atomic<bool> has_error = false;
+		std::mutex error_lock;
+		std::exception_ptr first_error;
 
 		void set_mem_limit(double mem_limit) {
 			::indexer::merger::mem_limit = mem_limit;
 		}
 
-		void wait_for_merges() {
-			while (is_merging) {
-				std::this_thread::sleep_for(100ms);
+		void record_error(std::exception_ptr error) {
+			std::lock_guard lock(error_lock);
+			if (!first_error) first_error = error;
+			has_error = true;
+		}
+
+		/*
+		 * Rethrows the first error recorded since the last call, the caches of the builder that failed are kept so
+		 * nothing is lost until the caller gives up.
+		 * */
+		void rethrow_error() {
+			if (!has_error) return;
+			std::exception_ptr error;
+			{
+				std::lock_guard lock(error_lock);
+				error.swap(first_error);
+				has_error = false;
+			}
+			if (error) std::rethrow_exception(error);
+		}
+
+		void update_size(appender &app) {
+			std::lock_guard lock(app.m_lock);
+			if (app.m_removed) return;
+			const size_t size = app.m_size();
+			// Unsigned wrap around makes this correct when the size shrinks.
+			total_size += size - app.m_last_size;
+			app.m_last_size = size;
+		}
+
+		/*
+		 * Runs the append function of the appender. If another thread is already flushing it we wait for that flush
+		 * instead.
+		 * */
+		void flush(appender &app) {
+			{
+				std::unique_lock lock(app.m_lock);
+				if (app.m_removed) return;
+				if (app.m_flushing) {
+					app.m_flushed.wait(lock, [&app]() { return !app.m_flushing; });
+					return;
+				}
+				app.m_flushing = true;
+			}
+
+			try {
+				app.m_append();
+			} catch (const std::exception &error) {
+				LOG_ERROR(std::string("flush failed: ") + error.what());
+				record_error(std::current_exception());
+			} catch (...) {
+				LOG_ERROR("flush failed");
+				record_error(std::current_exception());
+			}
+
+			{
+				std::lock_guard lock(app.m_lock);
+				app.m_flushing = false;
 			}
+			app.m_flushed.notify_all();
+			update_size(app);
 		}
 
-		void lock() {
-			if (is_merging) {
-				wait_for_merges();
+		void request_flush() {
+			if (flush_requested.exchange(true)) return;
+			std::lock_guard lock(merge_thread_lock);
+			merge_thread_cv.notify_one();
+		}
+
+		void lock(appender &app) {
+			rethrow_error();
+
+			if (app.m_flushing) {
+				std::unique_lock lock(app.m_lock);
+				app.m_flushed.wait(lock, [&app]() { return !app.m_flushing; });
+			}
+
+			if (app.m_num_locks.fetch_add(1, std::memory_order_relaxed) % size_report_interval != 0) return;
+
+			update_size(app);
+
+			if (app.m_last_size > high_watermark) {
+				// Back-pressure, the adding thread writes the cache of its own builder.
+				flush(app);
+				rethrow_error();
+			} else if (total_size > flush_limit) {
+				request_flush();
 			}
 		}
 
-		void register_appender(size_t id, std::function<void()> append, std::function<size_t()> size) {
+		std::shared_ptr<appender> register_appender(size_t id, std::function<void()> append,
+				std::function<size_t()> size) {
 			std::lock_guard lock(merger_lock);
 
-			appenders[id] = append;
-			sizes[id] = size;
+			auto app = std::make_shared<appender>();
+			app->m_append = append;
+			app->m_size = size;
+			appenders[id] = app;
+			return app;
 		}
 
 		void register_merger(size_t id, std::function<void()> merge) {
@@ -76,63 +196,75 @@ namespace indexer {
 		}
 
 		void deregister_merger(size_t id) {
-			std::lock_guard lock(merger_lock);
+			std::shared_ptr<appender> app;
+			{
+				std::lock_guard lock(merger_lock);
+
+				auto iter = appenders.find(id);
+				if (iter != appenders.end()) {
+					app = iter->second;
+					appenders.erase(iter);
+				}
+				mergers.erase(id);
+			}
 
-			appenders.erase(id);
-			mergers.erase(id);
-			sizes.erase(id);
+			if (app) {
+				// The builder is being destroyed, wait for a running flush and make sure no new one starts.
+				std::unique_lock lock(app->m_lock);
+				app->m_flushed.wait(lock, [&app]() { return !app->m_flushing; });
+				app->m_removed = true;
+				total_size -= app->m_last_size;
+			}
 		}
 
-		bool merge_thread_is_running = true;
-		thread merge_thread_obj;
-
 		void append_all() {
-			is_merging = true;
-			this_thread::sleep_for(1000ms);
-
-			size_t available_memory = memory::get_total_memory();
+			std::vector<std::shared_ptr<appender>> all;
+			{
+				std::shared_lock lock(merger_lock);
+				for (auto &iter : appenders) {
+					all.push_back(iter.second);
+				}
+			}
 
-			std::cout << "APPENDING ALL: " << appenders.size() << " mergers allocated memory: " << memory::allocated_memory() << " limit is: " <<
-				(available_memory * mem_limit) << std::endl;
-			
-			utils::thread_pool pool(32);
+			std::cout << "APPENDING ALL: " << all.size() << " mergers allocated memory: " << memory::allocated_memory() << " limit is: " <<
+				flush_limit << std::endl;
 
-			merger_lock.lock();
-			for (auto &iter : appenders) {
-				pool.enqueue([iter]() {
-					try {
-						iter.second();
-					} catch (...) {
+			utils::thread_pool pool(num_merge_threads);
 
-					}
+			for (auto &app : all) {
+				pool.enqueue([app]() {
+					flush(*app);
 				});
 			}
 
 			pool.run_all();
 
 			cout << "done... allocated memory: " << memory::allocated_memory() << endl;
-
-			merger_lock.unlock();
-			is_merging = false;
 		}
 
 		void merge_all() {
-			is_merging = true;
-			this_thread::sleep_for(1000ms);
+			std::vector<std::function<void()>> all;
+			{
+				std::shared_lock lock(merger_lock);
+				for (auto &iter : mergers) {
+					all.push_back(iter.second);
+				}
+			}
 
-			size_t available_memory = memory::get_total_memory();
+			std::cout << "MERGING ALL: " << all.size() << " mergers allocated memory: " << memory::allocated_memory() << std::endl;
 
-			std::cout << "MERGING ALL: " << mergers.size() << " mergers allocated memory: " << memory::allocated_memory() << " limit is: " <<
-				(available_memory * mem_limit) << std::endl;
-			
-			utils::thread_pool pool(32);
+			utils::thread_pool pool(num_merge_threads);
 
-			for (auto &iter : mergers) {
-				pool.enqueue([iter]() {
+			for (auto &merge : all) {
+				pool.enqueue([merge]() {
 					try {
-					      iter.second();
+						merge();
+					} catch (const std::exception &error) {
+						LOG_ERROR(std::string("merge failed: ") + error.what());
+						record_error(std::current_exception());
 					} catch (...) {
-					      
+						LOG_ERROR("merge failed");
+						record_error(std::current_exception());
 					}
 				});
 			}
@@ -140,55 +272,76 @@ namespace indexer {
 			pool.run_all();
 
 			cout << "done... allocated memory: " << memory::allocated_memory() << endl;
-
-			is_merging = false;
 		}
 
-		size_t total_sizes() {
-			std::lock_guard lock(merger_lock);
-			size_t sum = 0;
-			for (const auto &iter : sizes) {
-				sum += iter.second();
+		/*
+		 * Sleeps until lock() requests a flush because the total size crossed the limit. Errors are kept for
+		 * lock() and stop_merge_thread() to rethrow.
+		 * */
+		void merge_thread() {
+			std::unique_lock lock(merge_thread_lock);
+			while (true) {
+				merge_thread_cv.wait(lock, []() { return flush_requested || !merge_thread_is_running; });
+				if (!merge_thread_is_running) break;
+
+				lock.unlock();
+				append_all();
+				lock.lock();
+
+				flush_requested = total_size > flush_limit;
 			}
-			return sum;
 		}
 
-		void merge_thread() {
+		void start_merge_thread() {
 			memory::update();
-			size_t available_memory = memory::get_total_memory();
-			while (merge_thread_is_running) {
-				if (total_sizes() > available_memory * mem_limit) {
-					append_all();
-				}
-				this_thread::sleep_for(200ms);
+			const size_t limit = memory::get_total_memory() * mem_limit;
+
+			{
+				std::lock_guard lock(merge_thread_lock);
+				merge_thread_is_running = true;
+				flush_requested = false;
 			}
+			flush_limit = limit;
+			high_watermark = limit * appender_high_watermark;
+			merge_thread_obj = std::move(thread(merge_thread));
 		}
 
-		void start_merge_thread() {
-			merge_thread_is_running = true;
-			merge_thread_obj = std::move(thread(merge_thread));
+		void join_merge_thread() {
+			{
+				std::lock_guard lock(merge_thread_lock);
+				merge_thread_is_running = false;
+			}
+			merge_thread_cv.notify_one();
+			if (merge_thread_obj.joinable()) merge_thread_obj.join();
+			flush_limit = SIZE_MAX;
+			high_watermark = SIZE_MAX;
 		}
 
 		void stop_merge_thread() {
-			merge_thread_is_running = false;
-			merge_thread_obj.join();
+			join_merge_thread();
 			append_all();
+			rethrow_error();
 			merge_all();
+			rethrow_error();
 		}
 
 		void stop_merge_thread_only_append() {
-			merge_thread_is_running = false;
-			merge_thread_obj.join();
+			join_merge_thread();
 			append_all();
+			rethrow_error();
 		}
 
 		void terminate_merge_thread() {
-			merge_thread_is_running = false;
-			merge_thread_obj.join();
+			join_merge_thread();
 		}
 
 		void force_append() {
 			append_all();
+			rethrow_error();
+		}
+
+		size_t merge_memory_budget() {
+			return config::index_merge_memory_mb * 1024 * 1024 / num_merge_threads;
 		}
 	}
 
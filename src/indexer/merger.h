@@ -28,16 +28,44 @@
 
 #include <iostream>
 #include <functional>
+#include <memory>
 
 using namespace std;
 
 namespace indexer {
 
 	namespace merger {
+
+		/*
+		 * Number of shards merged concurrently by merge_all.
+		 * */
+		const size_t num_merge_threads = 32;
+
+		/*
+		 * A builder whose cache grows over this share of the memory limit is flushed by the thread that adds to it.
+		 * */
+		const double appender_high_watermark = 0.25;
+
+		/*
+		 * The size of a builder is read on every size_report_interval call to lock().
+		 * */
+		const size_t size_report_interval = 1024;
+
+		/*
+		 * State the merger keeps for a builder, returned by register_appender.
+		 * */
+		struct appender;
+
 		void set_mem_limit(double mem_limit);
-		void lock();
+
+		/*
+		 * Called by builders before adding to their cache. Blocks while the builder is flushing and starts the flushes
+		 * when the memory limits are crossed. Rethrows the error of a failed background flush.
+		 * */
+		void lock(appender &app);
 		void register_merger(size_t id, std::function<void()> merge);
-		void register_appender(size_t id, std::function<void()> append, std::function<size_t()> size);
+		std::shared_ptr<appender> register_appender(size_t id, std::function<void()> append,
+			std::function<size_t()> size);
 		void deregister_merger(size_t id);
 
 		void start_merge_thread();
@@ -45,6 +73,11 @@ namespace indexer {
 		void stop_merge_thread_only_append();
 		void terminate_merge_thread();
 		void force_append();
+
+		/*
+		 * Bytes one shard merge may use for sorting, config::index_merge_memory_mb split over the merge threads.
+		 * */
+		size_t merge_memory_budget();
 	};
 
 }
@@ -0,0 +1,153 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "page_codec.h"
+#include <algorithm>
+
+namespace indexer {
+
+	namespace page_codec {
+
+		void write_varint(std::string &out, uint64_t value) {
+			while (value >= 0x80) {
+				out.push_back((char)(value | 0x80));
+				value >>= 7;
+			}
+			out.push_back((char)value);
+		}
+
+		bool read_varint(const char *&p, const char *end, uint64_t &value) {
+			value = 0;
+			for (size_t shift = 0; shift < 64 && p < end; shift += 7) {
+				const uint8_t byte = *p++;
+				value |= (uint64_t)(byte & 0x7f) << shift;
+				if ((byte & 0x80) == 0) return true;
+			}
+			return false;
+		}
+
+		static size_t bit_width(uint64_t value) {
+			return value ? 64 - __builtin_clzll(value) : 0;
+		}
+
+		static size_t packed_bytes(size_t num_values, size_t bits) {
+			return (num_values * bits + 7) / 8;
+		}
+
+		void pack_values(const uint64_t *values, size_t num_values, std::string &out) {
+
+			uint64_t prev = 0;
+			for (size_t start = 0; start < num_values; start += block_size) {
+				const size_t len = std::min(block_size, num_values - start);
+
+				write_varint(out, values[start] - prev);
+
+				uint64_t max_delta = 0;
+				for (size_t i = start + 1; i < start + len; i++) {
+					max_delta |= values[i] - values[i - 1];
+				}
+				const size_t bits = bit_width(max_delta);
+				out.push_back((char)bits);
+
+				unsigned __int128 acc = 0;
+				size_t acc_bits = 0;
+				for (size_t i = start + 1; i < start + len; i++) {
+					acc |= (unsigned __int128)(values[i] - values[i - 1]) << acc_bits;
+					acc_bits += bits;
+					while (acc_bits >= 8) {
+						out.push_back((char)(uint8_t)acc);
+						acc >>= 8;
+						acc_bits -= 8;
+					}
+				}
+				if (acc_bits) out.push_back((char)(uint8_t)acc);
+
+				prev = values[start + len - 1];
+			}
+		}
+
+		const char *unpack_values(const char *p, const char *end, size_t num_values, size_t limit, uint64_t *out) {
+
+			uint64_t prev = 0;
+			for (size_t start = 0; start < num_values; start += block_size) {
+				const size_t len = std::min(block_size, num_values - start);
+
+				uint64_t first_delta;
+				if (!read_varint(p, end, first_delta)) return nullptr;
+				if (p == end) return nullptr;
+				const size_t bits = (uint8_t)*p++;
+				if (bits > 64) return nullptr;
+
+				const size_t num_bytes = packed_bytes(len - 1, bits);
+				if ((size_t)(end - p) < num_bytes) return nullptr;
+
+				if (start < limit) {
+					const uint64_t mask = bits == 64 ? UINT64_MAX : (1ull << bits) - 1;
+					const char *bp = p;
+					unsigned __int128 acc = 0;
+					size_t acc_bits = 0;
+					uint64_t value = prev + first_delta;
+					out[start] = value;
+					const size_t decode_len = std::min(len, limit - start);
+					for (size_t i = 1; i < decode_len; i++) {
+						while (acc_bits < bits) {
+							acc |= (unsigned __int128)(uint8_t)*bp++ << acc_bits;
+							acc_bits += 8;
+						}
+						value += (uint64_t)acc & mask;
+						acc >>= bits;
+						acc_bits -= bits;
+						out[i + start] = value;
+					}
+					prev = value;
+				}
+
+				p += num_bytes;
+			}
+
+			return p;
+		}
+
+		uint16_t quantize_score(float score) {
+			uint32_t bits;
+			memcpy(&bits, &score, sizeof(float));
+			// Round to nearest even, leave NaN alone.
+			if ((bits & 0x7fffffff) <= 0x7f800000) {
+				bits += 0x7fff + ((bits >> 16) & 1);
+			}
+			return (uint16_t)(bits >> 16);
+		}
+
+		float dequantize_score(uint16_t quantized) {
+			const uint32_t bits = (uint32_t)quantized << 16;
+			float score;
+			memcpy(&score, &bits, sizeof(float));
+			return score;
+		}
+
+	}
+
+}
@@ -0,0 +1,227 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <array>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+
+/*
+ * Encoding of the records stored for one key in a compressed counted_index page. See
+ * documentation/index_file_format.md for the layout.
+ * */
+
+namespace indexer {
+
+	namespace page_codec {
+
+		/*
+		 * Set in the num-keys field of a page when the data of the page is compressed. Files written before the
+		 * compressed format never have this bit set so they load as before.
+		 * */
+		const uint64_t compressed_page_flag = 1ull << 63;
+
+		const size_t block_size = 128;
+
+		const char mode_raw = 0;
+		const char mode_packed = 1;
+
+		void write_varint(std::string &out, uint64_t value);
+		bool read_varint(const char *&p, const char *end, uint64_t &value);
+
+		/*
+		 * Writes values as blocks of block_size. Each block stores the delta of its first value to the last value
+		 * of the previous block as a varint followed by the remaining deltas bit packed with the width of the
+		 * largest one. Values must be sorted ascending.
+		 * */
+		void pack_values(const uint64_t *values, size_t num_values, std::string &out);
+
+		/*
+		 * Decodes the first limit values into out and skips the rest. Returns the position after the values or
+		 * nullptr if the data is truncated.
+		 * */
+		const char *unpack_values(const char *p, const char *end, size_t num_values, size_t limit, uint64_t *out);
+
+		/*
+		 * Scores are stored as the 16 high bits of the float, rounded to nearest.
+		 * */
+		uint16_t quantize_score(float score);
+		float dequantize_score(uint16_t quantized);
+
+		template<typename data_record>
+		concept has_count = requires(data_record rec) { rec.m_count; };
+
+		template<typename data_record>
+		concept has_score = requires(data_record rec) { rec.m_score; };
+
+		/*
+		 * Marks the bytes of a record that are stored in a column of their own. The remaining bytes are stored as
+		 * they are.
+		 * */
+		template<typename data_record>
+		constexpr std::array<bool, sizeof(data_record)> encoded_bytes() {
+			std::array<bool, sizeof(data_record)> mask{};
+			for (size_t i = 0; i < sizeof(uint64_t); i++) mask[offsetof(data_record, m_value) + i] = true;
+			if constexpr (has_count<data_record>) {
+				for (size_t i = 0; i < sizeof(data_record::m_count); i++) mask[offsetof(data_record, m_count) + i] = true;
+			}
+			if constexpr (has_score<data_record>) {
+				for (size_t i = 0; i < sizeof(float); i++) mask[offsetof(data_record, m_score) + i] = true;
+			}
+			return mask;
+		}
+
+		template<typename data_record>
+		constexpr size_t residual_size() {
+			size_t size = 0;
+			for (bool encoded : encoded_bytes<data_record>()) {
+				if (!encoded) size++;
+			}
+			return size;
+		}
+
+		template<typename data_record>
+		void encode_records(const data_record *records, size_t num_records, std::string &out) {
+
+			const char *bytes = (const char *)records;
+
+			std::unique_ptr<uint64_t[]> values = std::make_unique<uint64_t[]>(num_records);
+			bool sorted = true;
+			for (size_t i = 0; i < num_records; i++) {
+				memcpy(&values[i], bytes + i * sizeof(data_record) + offsetof(data_record, m_value), sizeof(uint64_t));
+				if (i && values[i] < values[i - 1]) sorted = false;
+			}
+
+			if (!sorted) {
+				out.push_back(mode_raw);
+				out.append(bytes, num_records * sizeof(data_record));
+				return;
+			}
+
+			out.push_back(mode_packed);
+			write_varint(out, num_records);
+			pack_values(values.get(), num_records, out);
+
+			if constexpr (has_count<data_record>) {
+				for (size_t i = 0; i < num_records; i++) {
+					write_varint(out, records[i].m_count);
+				}
+			}
+
+			if constexpr (has_score<data_record>) {
+				for (size_t i = 0; i < num_records; i++) {
+					const uint16_t quantized = quantize_score(records[i].m_score);
+					out.append((const char *)&quantized, sizeof(uint16_t));
+				}
+			}
+
+			constexpr auto mask = encoded_bytes<data_record>();
+			if constexpr (residual_size<data_record>() > 0) {
+				for (size_t i = 0; i < num_records; i++) {
+					const char *rec = bytes + i * sizeof(data_record);
+					for (size_t j = 0; j < sizeof(data_record); j++) {
+						if (!mask[j]) out.push_back(rec[j]);
+					}
+				}
+			}
+		}
+
+		/*
+		 * Decodes at most limit records (all if limit is 0). Throws if the data is corrupt.
+		 * */
+		template<typename data_record>
+		std::unique_ptr<data_record[]> decode_records(const char *data, size_t len, size_t limit, size_t &num_records) {
+
+			const char *p = data;
+			const char *end = data + len;
+
+			if (p == end) throw std::runtime_error("Empty compressed record list");
+
+			const char mode = *p++;
+			if (mode == mode_raw) {
+				num_records = (len - 1) / sizeof(data_record);
+				if (limit && num_records > limit) num_records = limit;
+				std::unique_ptr<data_record[]> ret = std::make_unique<data_record[]>(num_records);
+				memcpy((char *)ret.get(), p, num_records * sizeof(data_record));
+				return ret;
+			}
+			if (mode != mode_packed) throw std::runtime_error("Unknown record list encoding");
+
+			uint64_t total;
+			if (!read_varint(p, end, total)) throw std::runtime_error("Corrupt compressed record list");
+
+			num_records = (limit && total > limit) ? limit : total;
+			std::unique_ptr<data_record[]> ret = std::make_unique<data_record[]>(num_records);
+			char *bytes = (char *)ret.get();
+
+			std::unique_ptr<uint64_t[]> values = std::make_unique<uint64_t[]>(num_records);
+			p = unpack_values(p, end, total, num_records, values.get());
+			if (p == nullptr) throw std::runtime_error("Corrupt compressed record list");
+			for (size_t i = 0; i < num_records; i++) {
+				memcpy(bytes + i * sizeof(data_record) + offsetof(data_record, m_value), &values[i], sizeof(uint64_t));
+			}
+
+			if constexpr (has_count<data_record>) {
+				for (size_t i = 0; i < total; i++) {
+					uint64_t count;
+					if (!read_varint(p, end, count)) throw std::runtime_error("Corrupt compressed record list");
+					if (i < num_records) ret[i].m_count = count;
+				}
+			}
+
+			if constexpr (has_score<data_record>) {
+				if ((size_t)(end - p) < total * sizeof(uint16_t)) throw std::runtime_error("Corrupt compressed record list");
+				for (size_t i = 0; i < num_records; i++) {
+					uint16_t quantized;
+					memcpy(&quantized, p + i * sizeof(uint16_t), sizeof(uint16_t));
+					ret[i].m_score = dequantize_score(quantized);
+				}
+				p += total * sizeof(uint16_t);
+			}
+
+			constexpr auto mask = encoded_bytes<data_record>();
+			if constexpr (residual_size<data_record>() > 0) {
+				if ((size_t)(end - p) < total * residual_size<data_record>()) {
+					throw std::runtime_error("Corrupt compressed record list");
+				}
+				for (size_t i = 0; i < num_records; i++) {
+					char *rec = bytes + i * sizeof(data_record);
+					for (size_t j = 0; j < sizeof(data_record); j++) {
+						if (!mask[j]) rec[j] = *p++;
+					}
+				}
+			}
+
+			return ret;
+		}
+
+	}
+
+}
@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include "file/file.h"
+
+namespace indexer {
+
+	/*
+	 * Bounded LRU cache of open shard readers keyed by shard id. Readers are handed out as shared_ptr so a reader
+	 * that gets evicted stays valid until the last query using it is done. With capacity 0 nothing is cached.
+	 *
+	 * Every get stats the file of the shard and opens it again if it has been replaced or changed since the reader
+	 * was opened, the builders can run in another process.
+	 * */
+	template<typename reader_type>
+	class reader_cache {
+
+	public:
+
+		explicit reader_cache(size_t capacity);
+
+		std::shared_ptr<reader_type> get(size_t shard_id, const std::string &filename, std::function<reader_type *()> open);
+		void clear();
+
+	private:
+
+		struct entry {
+			size_t shard_id;
+			file::file_version version;
+			std::shared_ptr<reader_type> reader;
+		};
+
+		size_t m_capacity;
+		std::mutex m_lock;
+		std::list<entry> m_lru;
+		std::unordered_map<size_t, typename std::list<entry>::iterator> m_entries;
+
+	};
+
+	template<typename reader_type>
+	reader_cache<reader_type>::reader_cache(size_t capacity)
+	: m_capacity(capacity) {
+	}
+
+	template<typename reader_type>
+	std::shared_ptr<reader_type> reader_cache<reader_type>::get(size_t shard_id, const std::string &filename,
+			std::function<reader_type *()> open) {
+
+		if (m_capacity == 0) {
+			return std::shared_ptr<reader_type>(open());
+		}
+
+		// Stat before opening so a file replaced while we open it is noticed on the next lookup.
+		const file::file_version version = file::version(filename);
+
+		{
+			std::lock_guard lock(m_lock);
+
+			auto iter = m_entries.find(shard_id);
+			if (iter != m_entries.end()) {
+				if (iter->second->version == version) {
+					m_lru.splice(m_lru.begin(), m_lru, iter->second);
+					return iter->second->reader;
+				}
+				m_lru.erase(iter->second);
+				m_entries.erase(iter);
+			}
+		}
+
+		// Open outside the lock so lookups on other shards don't wait for the file system.
+		std::shared_ptr<reader_type> reader(open());
+
+		std::lock_guard lock(m_lock);
+
+		if (m_entries.count(shard_id)) {
+			// Another thread opened the same shard while we were waiting.
+			return reader;
+		}
+
+		m_lru.push_front(entry{shard_id, version, reader});
+		m_entries[shard_id] = m_lru.begin();
+
+		if (m_lru.size() > m_capacity) {
+			m_entries.erase(m_lru.back().shard_id);
+			m_lru.pop_back();
+		}
+
+		return reader;
+	}
+
+	template<typename reader_type>
+	void reader_cache<reader_type>::clear() {
+		std::lock_guard lock(m_lock);
+		m_lru.clear();
+		m_entries.clear();
+	}
+
+}
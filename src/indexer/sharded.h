@@ -30,6 +30,7 @@
 #include <vector>
 #include <memory>
 #include "config.h"
+#include "reader_cache.h"
 #include "algorithm/sum_sorted.h"
 #include "algorithm/intersection.h"
 #include "utils/thread_pool.hpp"
@@ -76,6 +77,9 @@ namespace indexer {
 		size_t m_num_shards;
 		size_t m_hash_table_size;
 
+		mutable reader_cache<index_type<data_record>> m_readers;
+
+		std::shared_ptr<index_type<data_record>> open_shard(size_t shard_id) const;
 		void read_meta();
 		std::string filename() const;
 
@@ -83,14 +87,16 @@ namespace indexer {
 
 	template<template<typename> typename index_type, typename data_record>
 	sharded<index_type, data_record>::sharded(const std::string &db_name, size_t num_shards)
-	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(config::shard_hash_table_size)
+	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(config::shard_hash_table_size),
+		m_readers(config::index_reader_cache_size)
 	{
 		read_meta();
 	}
 
 	template<template<typename> typename index_type, typename data_record>
 	sharded<index_type, data_record>::sharded(const std::string &db_name, size_t num_shards, size_t hash_table_size)
-	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(hash_table_size)
+	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(hash_table_size),
+		m_readers(config::index_reader_cache_size)
 	{
 		read_meta();
 	}
@@ -103,18 +109,18 @@ namespace indexer {
 	std::vector<data_record> sharded<index_type, data_record>::find(uint64_t key) const {
 
 		const size_t shard_id = key % m_num_shards;
-		index_type<data_record> idx(m_db_name, shard_id, m_hash_table_size);
+		auto idx = open_shard(shard_id);
 
-		return idx.find(key);
+		return idx->find(key);
 	}
 
 	template<template<typename> typename index_type, typename data_record>
 	std::vector<data_record> sharded<index_type, data_record>::find(uint64_t key, size_t limit) const {
 
 		const size_t shard_id = key % m_num_shards;
-		index_type<data_record> idx(m_db_name, shard_id, m_hash_table_size);
+		auto idx = open_shard(shard_id);
 
-		return idx.find(key, limit);
+		return idx->find(key, limit);
 	}
 
 	template<template<typename> typename index_type, typename data_record>
@@ -125,15 +131,15 @@ namespace indexer {
 		for (uint64_t key : keys) {
 
 			const size_t shard_id = key % m_num_shards;
-			index_type<data_record> idx(m_db_name, shard_id, m_hash_table_size);
+			auto idx = open_shard(shard_id);
 			
 			size_t num_records;
-			std::unique_ptr<data_record[]> res = idx.find_ptr(key, num_records);
+			std::unique_ptr<data_record[]> res = idx->find_ptr(key, num_records);
 			results.emplace_back(std::move(res));
 			num_results.push_back(num_records);
 		}
 
-		std::vector<data_record> ret = ::algorithm::intersection(results, num_results);
+		std::vector<data_record> ret = ::algorithm::value_intersection(results, num_results);
 
 		return ret;
 	}
@@ -145,9 +151,9 @@ namespace indexer {
 		std::vector<std::vector<data_record>> results;
 		for (uint64_t key : keys) {
 			const size_t shard_id = key % m_num_shards;
-			index_type<data_record> idx(m_db_name, shard_id, m_hash_table_size);
+			auto idx = open_shard(shard_id);
 
-			std::vector<data_record> res = idx.find(key, limit);
+			std::vector<data_record> res = idx->find(key, limit);
 
 			sort(res.begin(), res.end());
 
@@ -180,6 +186,17 @@ namespace indexer {
 		pool.run_all();
 	}
 
+	/*
+	 * Returns a reader for the shard from the reader cache. Full scans like for_each don't use this since they
+	 * would push out the shards used by queries.
+	 * */
+	template<template<typename> typename index_type, typename data_record>
+	std::shared_ptr<index_type<data_record>> sharded<index_type, data_record>::open_shard(size_t shard_id) const {
+		return m_readers.get(shard_id, index_type<data_record>::shard_filename(m_db_name, shard_id), [this, shard_id]() {
+			return new index_type<data_record>(m_db_name, shard_id, m_hash_table_size);
+		});
+	}
+
 	template<template<typename> typename index_type, typename data_record>
 	void sharded<index_type, data_record>::read_meta() {
 		std::ifstream meta_file(filename(), std::ios::binary);
@@ -27,6 +27,7 @@
 #pragma once
 
 #include "index.h"
+#include "reader_cache.h"
 #include "algorithm/intersection.h"
 #include "algorithm/top_k.h"
 #include "utils/thread_pool.hpp"
@@ -66,6 +67,7 @@ namespace indexer {
 		 * Find intersection of multiple keys applying lambda function score_mod to the scores before.
 		 * Returns n records with highest score.
 		 * score_mod is applied in storage_order of data_record.
+		 * Scores are kept in a per thread buffer so this can be called from several threads at once.
 		 * */
 		std::vector<data_record> find_top(size_t &total_num_results, const std::vector<uint64_t> &keys, size_t n, 
 				std::function<float(const data_record &)> score_mod = [](const data_record &) { return 0.0f; }) const;
@@ -113,9 +115,11 @@ namespace indexer {
 		size_t m_hash_table_size;
 
 		std::vector<data_record> m_records;
-		mutable std::vector<float> m_scores;
 		std::map<uint64_t, uint32_t> m_record_id_map;
 
+		mutable reader_cache<index<data_record>> m_readers;
+
+		std::shared_ptr<index<data_record>> open_shard(size_t shard_id) const;
 		void read_meta();
 		std::string filename() const;
 
@@ -123,14 +127,16 @@ namespace indexer {
 
 	template<typename data_record>
 	sharded_index<data_record>::sharded_index(const std::string &db_name, size_t num_shards)
-	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(config::shard_hash_table_size)
+	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(config::shard_hash_table_size),
+		m_readers(config::index_reader_cache_size)
 	{
 		read_meta();
 	}
 
 	template<typename data_record>
 	sharded_index<data_record>::sharded_index(const std::string &db_name, size_t num_shards, size_t hash_table_size)
-	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(hash_table_size)
+	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(hash_table_size),
+		m_readers(config::index_reader_cache_size)
 	{
 		read_meta();
 	}
@@ -143,9 +149,9 @@ namespace indexer {
 	std::vector<data_record> sharded_index<data_record>::find(uint64_t key) const {
 
 		const size_t shard_id = key % m_num_shards;
-		index<data_record> idx(m_db_name, shard_id, m_hash_table_size);
+		auto idx = open_shard(shard_id);
 
-		roaring::Roaring rr = idx.find_bitmap(key);
+		roaring::Roaring rr = idx->find_bitmap(key);
 
 		std::function<data_record(uint32_t id)> id_to_rec = [this](uint32_t id) {
 			return m_records[id];
@@ -163,9 +169,9 @@ namespace indexer {
 	roaring::Roaring sharded_index<data_record>::find_bitmap(uint64_t key) const {
 
 		const size_t shard_id = key % m_num_shards;
-		index<data_record> idx(m_db_name, shard_id, m_hash_table_size);
+		auto idx = open_shard(shard_id);
 
-		return idx.find_bitmap(key);
+		return idx->find_bitmap(key);
 	}
 
 	template<typename data_record>
@@ -175,9 +181,9 @@ namespace indexer {
 		for (uint64_t key : keys) {
 
 			const size_t shard_id = key % m_num_shards;
-			index<data_record> idx(m_db_name, shard_id, m_hash_table_size);
+			auto idx = open_shard(shard_id);
 			
-			roaring::Roaring res = idx.find_bitmap(key);
+			roaring::Roaring res = idx->find_bitmap(key);
 			results.emplace_back(std::move(res));
 		}
 
@@ -199,15 +205,13 @@ namespace indexer {
 	std::vector<data_record> sharded_index<data_record>::find_top(size_t &total_num_results, const std::vector<uint64_t> &keys, size_t n,
 			std::function<float(const data_record &)> score_mod) const {
 
-		std::fill(m_scores.begin(), m_scores.end(), 0.0f);
-
 		std::vector<roaring::Roaring> results;
 		for (uint64_t key : keys) {
 
 			const size_t shard_id = key % m_num_shards;
-			index<data_record> idx(m_db_name, shard_id, m_hash_table_size);
+			auto idx = open_shard(shard_id);
 			
-			roaring::Roaring res = idx.find_bitmap(key);
+			roaring::Roaring res = idx->find_bitmap(key);
 			results.emplace_back(std::move(res));
 		}
 
@@ -215,15 +219,17 @@ namespace indexer {
 
 		total_num_results = rr.cardinality();
 
+		score_buffer scores(m_records.size());
+
 		// Apply score modifications.
 		std::vector<uint32_t> ids;
 		for (uint32_t internal_id : rr) {
 			ids.push_back(internal_id);
-			m_scores[internal_id] = m_records[internal_id].m_score * score_mod(m_records[internal_id].m_value);
+			scores[internal_id] = m_records[internal_id].m_score * score_mod(m_records[internal_id].m_value);
 		}
 
-		auto ordered = [this](const uint32_t &a, const uint32_t &b) {
-			return m_scores[a] < m_scores[b];
+		auto ordered = [&scores](const uint32_t &a, const uint32_t &b) {
+			return scores[a] < scores[b];
 		};
 
 		std::vector<uint32_t> top_ids = ::algorithm::top_k<uint32_t>(ids, n, ordered);
@@ -231,7 +237,7 @@ namespace indexer {
 		std::vector<data_record> ret;
 		for (uint32_t internal_id : top_ids) {
 			ret.push_back(m_records[internal_id]);
-			ret.back().m_score = m_scores[internal_id];
+			ret.back().m_score = scores[internal_id];
 		}
 
 		sort(ret.begin(), ret.end(), typename data_record::score_order());
@@ -255,9 +261,9 @@ namespace indexer {
 		for (uint64_t key : keys) {
 
 			const size_t shard_id = key % m_num_shards;
-			index<data_record> idx(m_db_name, shard_id, m_hash_table_size);
+			auto idx = open_shard(shard_id);
 			
-			roaring::Roaring res = idx.find_bitmap(key);
+			roaring::Roaring res = idx->find_bitmap(key);
 			results.emplace_back(std::move(res));
 		}
 
@@ -332,6 +338,17 @@ namespace indexer {
 		}
 	}
 
+	/*
+	 * Returns a reader for the shard from the reader cache. get_keys and for_each open their own readers since
+	 * they touch every shard once.
+	 * */
+	template<typename data_record>
+	std::shared_ptr<index<data_record>> sharded_index<data_record>::open_shard(size_t shard_id) const {
+		return m_readers.get(shard_id, index<data_record>::shard_filename(m_db_name, shard_id), [this, shard_id]() {
+			return new index<data_record>(m_db_name, shard_id, m_hash_table_size);
+		});
+	}
+
 	template<typename data_record>
 	void sharded_index<data_record>::read_meta() {
 		std::ifstream meta_file(filename(), std::ios::binary);
@@ -347,7 +364,6 @@ namespace indexer {
 
 				m_record_id_map[rec.m_value] = m_records.size();
 				m_records.push_back(rec);
-				m_scores.push_back(0.0f);
 			}
 		}
 	}
@@ -109,6 +109,8 @@ namespace indexer {
 		string line;
 		vector<string> col_values;
 		set<uint64_t> tokens;
+		string word_buffer;
+		vector<string_view> words;
 		unordered_map<uint64_t, index_builder<link_record> *> builders;
 		size_t num_parsed = 0;
 		size_t num_existed = 0;
@@ -137,7 +139,7 @@ namespace indexer {
 			}
 			index_builder<link_record> *builder = builders[domain_hash];
 
-			vector<string> words = text::get_expanded_full_text_words(link_text);
+			text::get_expanded_full_text_words(link_text, word_buffer, words);
 
 			text::words_to_ngram_hash(words, 3, [&tokens](const uint64_t hash) {
 				tokens.insert(hash);
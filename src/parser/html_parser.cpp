@@ -30,6 +30,9 @@
 #include "config.h"
 #include "text/text.h"
 #include <curl/curl.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -38,6 +41,26 @@ namespace parser {
 	const vector<string> non_content_tags{"script", "noscript", "style", "embed", "label", "form", "input",
 		"iframe", "head", "meta", "link", "object", "aside", "channel", "img"};
 
+	/*
+	 * Position of the first '<' or '>' in data[pos, len), len if there is none. Compares 16 bytes at a time with
+	 * SSE2, which every x86-64 cpu has.
+	 * */
+	inline size_t find_tag_delimiter(const char *data, size_t pos, size_t len) {
+#ifdef __SSE2__
+		const __m128i lt = _mm_set1_epi8('<');
+		const __m128i gt = _mm_set1_epi8('>');
+		for (; pos + 16 <= len; pos += 16) {
+			const __m128i chunk = _mm_loadu_si128((const __m128i *)(data + pos));
+			const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, lt), _mm_cmpeq_epi8(chunk, gt)));
+			if (mask) return pos + __builtin_ctz(mask);
+		}
+#endif
+		for (; pos < len; pos++) {
+			if (data[pos] == '<' || data[pos] == '>') return pos;
+		}
+		return len;
+	}
+
 	html_parser::html_parser()
 	: m_long_text_len(100000)
 	{
@@ -57,11 +80,11 @@ namespace parser {
 	html_parser::~html_parser() {
 	}
 
-	void html_parser::parse(const string &html) {
+	void html_parser::parse(string_view html) {
 		parse(html, "");
 	}
 
-	void html_parser::parse(const string &html, const string &url) {
+	void html_parser::parse(string_view html, const string &url) {
 
 		m_should_insert = false;
 		m_should_insert = false;
@@ -82,14 +105,11 @@ namespace parser {
 			return;
 		}
 
-		find_scripts(html);
-		find_styles(html);
-		sort_invisible();
-		find_links(html, url);
+		m_url_hash = URL(m_host, m_path).hash();
+		scan_tags(html, url);
 
-		m_title = get_tag_content(html, "<title", "</title>");
-		m_h1 = get_tag_content(html, "<h1", "</h1>");
-		m_meta = get_meta_tag(html);
+		m_title = get_tag_content(html, m_title_pos, "</title>");
+		m_h1 = get_tag_content(html, m_h1_pos, "</h1>");
 		m_text = get_text_content(html);
 
 		if (m_encoding == ENC_ISO_8859_1) {
@@ -113,41 +133,63 @@ namespace parser {
 		}
 	}
 
-	void html_parser::find_scripts(const string &html) {
-		size_t pos = 0;
-		pair<size_t, size_t> tag(0, 0);
-		while (pos != string::npos) {
-			tag = find_tag(html, "<script", "</script>", tag.second);
-			if (tag.second == string::npos) {
-				break;
-			}
-			m_invisible_pos.push_back(tag);
-		}
-	}
-
-	void html_parser::find_styles(const string &html) {
-		size_t pos = 0;
-		pair<size_t, size_t> tag(0, 0);
-		while (pos != string::npos) {
-			tag = find_tag(html, "<style", "</style>", tag.second);
-			if (tag.second == string::npos) {
-				break;
+	/*
+	 * Finds the tags we need in one pass over the '<' of the html. Links are only matched after the end of the previous
+	 * link and the links and the meta description are parsed when they are found. A script or style starting inside
+	 * another one is text to the browser and is skipped, so the invisible intervals come out sorted and disjoint.
+	 * */
+	void html_parser::scan_tags(string_view html, const string &base_url) {
+		m_title_pos = m_h1_pos = m_h1_end_pos = m_body_pos = string::npos;
+
+		size_t next_invisible = 0;
+		bool scripts_closed = true;
+		bool styles_closed = true;
+		size_t next_link = 0;
+		bool has_meta = false;
+
+		const char *data = html.data();
+		const char *data_end = data + html.size();
+		for (const char *tag = html.empty() ? nullptr : (const char *)memchr(data, '<', html.size()); tag != nullptr;
+				tag = (const char *)memchr(tag + 1, '<', data_end - tag - 1)) {
+			const size_t pos = tag - data;
+			const string_view name = html.substr(pos + 1);
+			if (name.starts_with("script")) {
+				if (pos >= next_invisible && scripts_closed) scripts_closed = add_invisible(html, pos, "</script>", next_invisible);
+			} else if (name.starts_with("style")) {
+				if (pos >= next_invisible && styles_closed) styles_closed = add_invisible(html, pos, "</style>", next_invisible);
+			} else if (name.starts_with("a ")) {
+				if (pos >= next_link) {
+					const size_t pos_end = html.find("</a>", pos);
+					next_link = pos_end == string::npos ? string::npos : pos_end + 4;
+					if (pos_end != string::npos) {
+						parse_link(string(html.substr(pos, next_link - pos)), base_url);
+					}
+				}
+			} else if (name.starts_with("title")) {
+				if (m_title_pos == string::npos) m_title_pos = pos;
+			} else if (name.starts_with("h1")) {
+				if (m_h1_pos == string::npos) m_h1_pos = pos;
+			} else if (name.starts_with("/h1>")) {
+				if (m_h1_end_pos == string::npos) m_h1_end_pos = pos;
+			} else if (name.starts_with("body")) {
+				if (m_body_pos == string::npos) m_body_pos = pos;
+			} else if (name.starts_with("meta")) {
+				// A meta tag first in the html has never been used for the description.
+				if (!has_meta && pos > 0) has_meta = get_meta_description(html, pos, m_meta);
 			}
-			m_invisible_pos.push_back(tag);
 		}
 	}
 
-	void html_parser::find_links(const string &html, const string &base_url) {
-		size_t pos = 0;
-		pair<size_t, size_t> tag(0, 0);
-		while (pos != string::npos) {
-			tag = find_tag(html, "<a ", "</a>", tag.second);
-			if (tag.second == string::npos) {
-				break;
-			}
-
-			parse_link(html.substr(tag.first, tag.second - tag.first), base_url);
-		}
+	/*
+	 * Adds the interval from pos_start to the end of tag_end as invisible and sets next_invisible to the end of it.
+	 * Returns false if the tag is not closed.
+	 * */
+	bool html_parser::add_invisible(string_view html, size_t pos_start, string_view tag_end, size_t &next_invisible) {
+		const size_t pos_end = html.find(tag_end, pos_start);
+		if (pos_end == string::npos) return false;
+		next_invisible = pos_end + tag_end.size();
+		m_invisible_pos.emplace_back(pos_start, next_invisible);
+		return true;
 	}
 
 	int html_parser::parse_link(const string &link, const string &base_url) {
@@ -177,7 +219,7 @@ namespace parser {
 		if (host == m_host) {
 			// Ignore internal links for now.
 			if (!nofollow) {
-				m_internal_links.emplace_back(std::make_pair(URL(m_host, m_path).hash(), URL(host, path).hash()));
+				m_internal_links.emplace_back(std::make_pair(m_url_hash, URL(host, path).hash()));
 			}
 			return ::parser::OK;
 		}
@@ -256,12 +298,13 @@ namespace parser {
 		text::trim_inplace(path);
 	}
 
-	void html_parser::parse_encoding(const string &html) {
+	void html_parser::parse_encoding(string_view html) {
 		m_encoding = ENC_UTF_8;
-		const size_t pos_start = html.find("charset=");
-		if (pos_start == string::npos || pos_start > 1024) return;
+		// Only the start of the html is searched.
+		const size_t pos_start = html.substr(0, 1024 + 8).find("charset=");
+		if (pos_start == string::npos) return;
 
-		string encoding = html.substr(pos_start, 40);
+		string encoding(html.substr(pos_start, 40));
 		encoding = text::lower_case(encoding);
 
 		const size_t utf8_start = encoding.find("utf-8");
@@ -346,18 +389,7 @@ namespace parser {
 		return response;
 	}
 
-	inline pair<size_t, size_t> html_parser::find_tag(const string &html, const string &tag_start, const string &tag_end,
-		size_t pos) {
-		size_t pos_start = html.find(tag_start, pos);
-		if (pos_start == string::npos) return pair<size_t, size_t>(string::npos, string::npos);
-
-		const size_t pos_end = html.find(tag_end, pos_start);
-		if (pos_end == string::npos) return pair<size_t, size_t>(string::npos, string::npos);
-		return pair<size_t, size_t>(pos_start, pos_end + tag_end.size());
-	}
-
-	string html_parser::get_tag_content(const string &html, const string &tag_start, const string &tag_end) {
-		size_t pos_start = html.find(tag_start);
+	string html_parser::get_tag_content(string_view html, size_t pos_start, string_view tag_end) {
 		if (pos_start == string::npos || is_invisible(pos_start)) return "";
 		pos_start = html.find(">", pos_start);
 
@@ -367,23 +399,25 @@ namespace parser {
 		return (string)html.substr(pos_start + 1, len - 1);
 	}
 
-	string html_parser::get_meta_tag(const string &html) {
-		size_t pos_start = 0;
-		while ((pos_start = html.find("<meta", pos_start + 1)) != string::npos)  {
-			const size_t pos_end = html.find(">", pos_start);
-			const size_t pos_description = html.find("description\"", pos_start);
-			if (pos_description < pos_end) {
-				const size_t pos_end_tag = html.find(">", pos_description);
-				const size_t pos_start_tag = html.rfind("<", pos_description);
-
-				const string s = "content=";
-				const size_t content_start = html.find(s, pos_start_tag);
-				if (content_start != string::npos && content_start <= pos_end_tag) {
-					return (string)html.substr(content_start + s.size(), pos_end_tag - content_start - s.size() - 1);
-				}
-			}
-		}
-		return "";
+	/*
+	 * Reads the content of the meta tag at pos_start into meta if it is the description.
+	 * */
+	bool html_parser::get_meta_description(string_view html, size_t pos_start, string &meta) {
+		// The attributes are only searched up to the end of the tag.
+		const size_t pos_end_tag = html.find(">", pos_start);
+		const string_view tag = html.substr(0, pos_end_tag);
+
+		const size_t pos_description = tag.find("description\"", pos_start);
+		if (pos_description == string::npos) return false;
+
+		const size_t pos_start_tag = html.rfind("<", pos_description);
+
+		const string_view s = "content=";
+		const size_t content_start = tag.find(s, pos_start_tag);
+		if (content_start == string::npos) return false;
+
+		meta = html.substr(content_start + s.size(), pos_end_tag - content_start - s.size() - 1);
+		return true;
 	}
 
 	void html_parser::clean_text(string &str) {
@@ -402,6 +436,11 @@ namespace parser {
 		int i = 0, j = 0;
 		const char *html_s = html.c_str();
 		for (; i < len; i++) {
+			if (!copy) {
+				// Nothing inside a tag is kept, jump to the next delimiter.
+				i = find_tag_delimiter(html_s, i, len);
+				if (i == len) break;
+			}
 			if (html_s[i] == '<') copy = false;
 			if (isspace(html_s[i])) {
 				html[j] = ' ';
@@ -440,12 +479,12 @@ namespace parser {
 	 * This function returns the text content of the html by first trying to fetch content after the first <h1>...</h1> tag. If no h1 tag is present
 	 * it tries to fetch content from the start of the <body>
 	 * */
-	string html_parser::get_text_content(const string &html) {
-		size_t pos_start = html.find("</h1>");
+	string html_parser::get_text_content(string_view html) {
+		size_t pos_start = m_h1_end_pos;
 
 		// Start from body if no h1 is present
 		if (pos_start == string::npos || is_invisible(pos_start)) {
-			pos_start = html.find("<body");
+			pos_start = m_body_pos;
 		}
 		if (pos_start == string::npos || is_invisible(pos_start)) {
 			return "";
@@ -463,9 +502,14 @@ namespace parser {
 			interval++;
 		}
 
-		const char *html_s = html.c_str();
+		const char *html_s = html.data();
 
 		for (; i < len && j < m_long_text_len; i++) {
+			if (!copy) {
+				// Nothing inside a tag is kept, jump to the next delimiter.
+				i = find_tag_delimiter(html_s, i, len);
+				if (i == len) break;
+			}
 			if (html_s[i] == '<') {
 				if (interval != invisible_end && interval->first == i) {
 					// Skip the whole invisible tag.
@@ -565,17 +609,16 @@ namespace parser {
 		return false;
 	}
 
-	void html_parser::sort_invisible() {
-		sort(m_invisible_pos.begin(), m_invisible_pos.end(), [](const pair<int, int>& lhs, const pair<int, int>& rhs) {
-			return lhs.first < rhs.first;
-		});
-	}
-
-	inline bool html_parser::is_invisible(size_t pos) {
-		for (const auto &interval : m_invisible_pos) {
-			if (interval.first <= pos && pos < interval.second) return true;
-		}
-		return false;
+	/*
+	 * The invisible intervals are sorted and disjoint, find the last one starting at or before pos.
+	 * */
+	bool html_parser::is_invisible(size_t pos) const {
+		auto interval = upper_bound(m_invisible_pos.begin(), m_invisible_pos.end(), pos,
+			[](size_t pos, const pair<size_t, size_t> &interval) {
+				return pos < interval.first;
+			});
+		if (interval == m_invisible_pos.begin()) return false;
+		return pos < prev(interval)->second;
 	}
 
 }
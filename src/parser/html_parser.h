@@ -27,6 +27,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <iostream>
@@ -56,8 +57,8 @@ namespace parser {
 		html_parser(size_t long_text_len);
 		~html_parser();
 
-		void parse(const std::string &html, const std::string &url);
-		void parse(const std::string &html);
+		void parse(std::string_view html, const std::string &url);
+		void parse(std::string_view html);
 
 		std::string title() const;
 		std::string meta() const;
@@ -93,26 +94,33 @@ namespace parser {
 		std::string m_host;
 		std::string m_path;
 
-		void find_scripts(const std::string &html);
-		void find_styles(const std::string &html);
-		void find_links(const std::string &html, const std::string &base_url);
+		/*
+		 * Positions of the first <title, <h1, </h1> and <body tags, string::npos if the html does not have them.
+		 * */
+		size_t m_title_pos = std::string::npos;
+		size_t m_h1_pos = std::string::npos;
+		size_t m_h1_end_pos = std::string::npos;
+		size_t m_body_pos = std::string::npos;
+
+		// Hash of the parsed url, the source of all internal links.
+		uint64_t m_url_hash = 0;
+
+		void scan_tags(std::string_view html, const std::string &base_url);
+		bool add_invisible(std::string_view html, size_t pos_start, std::string_view tag_end, size_t &next_invisible);
 
 		int parse_link(const std::string &link, const std::string &base_url);
 		int parse_url(const std::string &url, std::string &host, std::string &path, const std::string &base_url);
 		inline void remove_www(std::string &path);
-		void parse_encoding(const std::string &html);
+		void parse_encoding(std::string_view html);
 		void iso_to_utf8(std::string &text);
 
-		inline std::pair<size_t, size_t> find_tag(const std::string &html, const std::string &tag_start, const std::string &tag_end,
-			size_t pos);
-		std::string get_tag_content(const std::string &html, const std::string &tag_start, const std::string &tag_end);
-		std::string get_meta_tag(const std::string &html);
+		std::string get_tag_content(std::string_view html, size_t pos_start, std::string_view tag_end);
+		bool get_meta_description(std::string_view html, size_t pos_start, std::string &meta);
 		void clean_text(std::string &str);
 		void strip_whitespace(std::string &html);
 		void strip_tags(std::string &html);
-		std::string get_text_content(const std::string &html);
-		void sort_invisible();
-		inline bool is_invisible(size_t pos);
+		std::string get_text_content(std::string_view html);
+		bool is_invisible(size_t pos) const;
 
 	};
 
@@ -27,6 +27,7 @@
 #pragma once
 
 #include <iostream>
+#include <string_view>
 
 #define IS_MULTIBYTE_CODEPOINT(ch) (((unsigned char)ch >> 7) && !(((unsigned char)ch >> 6) & 0x1))
 #define IS_UTF8_START_1(ch) (((unsigned char)ch >> 5) == 0b00000110 && ((unsigned char)ch & 0b00011111) >= 0b00000010)
@@ -41,7 +42,7 @@ namespace parser {
 		public:
 			
 			static std::string encode(const std::string &str);
-			static bool is_valid(const std::string &str);
+			static bool is_valid(std::string_view str);
 
 	};
 
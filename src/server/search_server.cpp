@@ -32,16 +32,41 @@
 #include "indexer/domain_level.h"
 #include "indexer/url_record.h"
 #include "hash_table2/hash_table.h"
-#include "transfer/transfer.h"
+#include "server/url_server_client.h"
 #include "parser/parser.h"
 #include "parser/unicode.h"
 #include "api/result_with_snippet.h"
 #include "api/api_response.h"
 #include "full_text/search_metric.h"
+#include "indexer/index_generation.h"
+#include "text/text.h"
+#include "utils/sharded_lru_cache.h"
+#include "config.h"
 #include "json.hpp"
+#include <chrono>
 
 namespace server {
 
+	/*
+	 * A response body in the result cache, served until it expires.
+	 * */
+	struct cached_result {
+		std::string m_body;
+		std::chrono::steady_clock::time_point m_expires;
+	};
+
+	/*
+	 * Queries with the same words, after lower casing and trimming, give the same result.
+	 * */
+	std::string result_cache_key(const std::string &q) {
+		std::string key;
+		for (const std::string &word : text::get_full_text_words(q)) {
+			if (key.size()) key += ' ';
+			key += word;
+		}
+		return key;
+	}
+
 	void search_server() {
 
 		indexer::index_manager idx_manager;
@@ -52,9 +77,26 @@ namespace server {
 		hash_table2::hash_table ht("index_manager");
 		hash_table2::hash_table url_ht("snippets");
 
+		// Decoded snippet lines by url hash. The size of an entry is the line plus the overhead of the list node and
+		// the map entry.
+		utils::sharded_lru_cache<uint64_t, std::string> snippet_cache(config::search_snippet_cache_mb * 1024 * 1024,
+			64, [](const std::string &line) { return line.size() + 96; });
+
+		// Complete responses by normalized query. Cleared when the index builders write a new index generation,
+		// otherwise entries live for search_result_cache_ttl seconds.
+		utils::sharded_lru_cache<std::string, cached_result> result_cache(config::search_result_cache_mb * 1024 * 1024,
+			16, [](const cached_result &result) { return result.m_body.size() + 256; });
+		indexer::index_generation_watch index_generation;
+
+		// Domains are split over the url servers by domain_hash % nodes. Without configured nodes the single url
+		// server we have always used is queried.
+		url_server_client url_servers(config::url_servers.size() ? config::url_servers :
+			std::vector<std::string>{"65.108.132.103"}, config::url_server_timeout_ms);
+
 		cout << "starting server..." << endl;
 
-		::http::server srv([&idx_manager, &ht, &url_ht](const http::request &req) {
+		::http::server srv([&idx_manager, &ht, &url_ht, &snippet_cache, &result_cache, &index_generation,
+				&url_servers](const http::request &req) {
 			http::response res;
 
 			URL url = req.url();
@@ -74,9 +116,52 @@ namespace server {
 
 			stringstream body;
 
+			if (url.path() == "/stats") {
+				const auto stats = snippet_cache.get_stats();
+				const size_t lookups = stats.m_hits + stats.m_misses;
+
+				nlohmann::ordered_json message;
+				message["status"] = "success";
+				message["snippet_cache"]["hits"] = stats.m_hits;
+				message["snippet_cache"]["misses"] = stats.m_misses;
+				message["snippet_cache"]["hit_rate"] = lookups ? (double)stats.m_hits / lookups : 0.0;
+				message["snippet_cache"]["entries"] = stats.m_entries;
+				message["snippet_cache"]["size"] = stats.m_size;
+				message["snippet_cache"]["capacity"] = stats.m_capacity;
+
+				const auto result_stats = result_cache.get_stats();
+				const size_t result_lookups = result_stats.m_hits + result_stats.m_misses;
+				message["result_cache"]["hits"] = result_stats.m_hits;
+				message["result_cache"]["misses"] = result_stats.m_misses;
+				message["result_cache"]["hit_rate"] = result_lookups ? (double)result_stats.m_hits / result_lookups : 0.0;
+				message["result_cache"]["entries"] = result_stats.m_entries;
+				message["result_cache"]["size"] = result_stats.m_size;
+				message["result_cache"]["capacity"] = result_stats.m_capacity;
+
+				res.code(200);
+				res.content_type("application/json");
+				res.body(message.dump());
+				return res;
+			}
+
 			if (query.find("q") != query.end()) {
 				std::string q = query["q"];
 
+				if (index_generation.changed()) {
+					result_cache.clear();
+				}
+
+				profiler::instance cache_prof("result cache");
+				const std::string cache_key = result_cache_key(q);
+				cached_result cached;
+				if (result_cache.get(cache_key, cached) && cached.m_expires > std::chrono::steady_clock::now()) {
+					// time_ms is the time of this request, not of the one that filled the cache.
+					res.code(200);
+					res.body(api::api_response::with_time_ms(cached.m_body, cache_prof.get()));
+					return res;
+				}
+				cache_prof.stop();
+
 				size_t total_num_domains = 0;
 				size_t len = 5;
 				std::vector<indexer::return_record> domain_records;
@@ -113,35 +198,16 @@ namespace server {
 
 				profiler::instance prof2("url searches");
 
-				const std::string post_data((char *)domain_hashes.data(), domain_hashes.size() * sizeof(uint64_t));
-				http::response http_res = transfer::post("http://65.108.132.103/?q=" + parser::urlencode(q) + "&len=" + std::to_string(len), post_data);
-
 				size_t all_total_num_results = 0;
+				std::map<uint64_t, std::vector<indexer::url_record>> domain_results;
+				const bool complete_results = url_servers.find(q, len, domain_hashes, all_total_num_results,
+					domain_results);
 
 				std::vector<indexer::url_record> results;
-				if (http_res.code() == 200) {
-
-					const string url_res = http_res.body();
-
-					stringstream ss(url_res);
-
-					ss.read((char *)&all_total_num_results, sizeof(size_t));
-
-					while (!ss.eof()) {
-						uint64_t incoming_domain_hash;
-						ss.read((char *)&incoming_domain_hash, sizeof(uint64_t));
-						if (ss.eof()) break;
-						size_t num_records;
-						ss.read((char *)&num_records, sizeof(size_t));
-						for (size_t i = 0; i < num_records; i++) {
-							uint64_t value;
-							float score;
-							ss.read((char *)&value, sizeof(uint64_t));
-							ss.read((char *)&score, sizeof(float));
-							indexer::url_record url_rec(value, score + domain_scores[incoming_domain_hash]);
-							results.push_back(url_rec);
-							url_to_domain[value] = incoming_domain_hash;
-						}
+				for (const auto &[domain_hash, records] : domain_results) {
+					for (const indexer::url_record &record : records) {
+						results.emplace_back(record.m_value, record.m_score + domain_scores[domain_hash]);
+						url_to_domain[record.m_value] = domain_hash;
 					}
 				}
 
@@ -158,9 +224,27 @@ namespace server {
 
 				prof.stop();
 
+				// Lines that are not cached are read from the hash table in one batch and cached, also if they are empty.
+				std::vector<std::string> lines(results.size());
+				std::vector<uint64_t> missing_hashes;
+				std::vector<size_t> missing_indexes;
+				for (size_t i = 0; i < results.size(); i++) {
+					if (!snippet_cache.get(results[i].m_value, lines[i])) {
+						missing_hashes.push_back(results[i].m_value);
+						missing_indexes.push_back(i);
+					}
+				}
+
+				const std::vector<std::string> found_lines = url_ht.find_many(missing_hashes);
+				for (size_t i = 0; i < missing_indexes.size(); i++) {
+					lines[missing_indexes[i]] = found_lines[i];
+					snippet_cache.put(missing_hashes[i], found_lines[i]);
+				}
+
 				vector<api::result_with_snippet> results_with_snippets;
-				for (const auto &url_record : results) {
-					const std::string line = url_ht.find(url_record.m_value);
+				for (size_t i = 0; i < results.size(); i++) {
+					const auto &url_record = results[i];
+					const std::string &line = lines[i];
 
 					indexer::return_record ft_rec;
 					ft_rec.m_value = url_record.m_value;
@@ -175,6 +259,12 @@ namespace server {
 				api::api_response response(results_with_snippets, metric, prof.get());
 
 				body << response;
+
+				// Results are not cached if a url server failed.
+				if (complete_results) {
+					result_cache.put(cache_key, cached_result{body.str(),
+						std::chrono::steady_clock::now() + std::chrono::seconds(config::search_result_cache_ttl)});
+				}
 			} else if (query.find("u") != query.end()) {
 				URL url(query["u"]);
 
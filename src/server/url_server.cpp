@@ -27,25 +27,138 @@
 #include "url_server.h"
 
 #include <iostream>
+#include <filesystem>
 #include "http/server.h"
 #include "indexer/index_manager.h"
 #include "indexer/domain_level.h"
 #include "indexer/url_record.h"
+#include "indexer/index_generation.h"
+#include "utils/sharded_lru_cache.h"
+#include "common/ThreadPool.h"
+#include "config.h"
+#include "logger/logger.h"
+#include "server/url_server_protocol.h"
+#include <condition_variable>
 
 namespace server {
+
+	/*
+	 * The url and url_links indexes of a domain. The indexes are memory mapped, m_size is the size of the mapped
+	 * files plus the records copied into memory. Pointers are null for domains without an index file.
+	 * */
+	struct domain_indexes {
+		std::shared_ptr<indexer::index<indexer::url_record>> m_urls;
+		std::shared_ptr<indexer::index<indexer::link_record>> m_links;
+		size_t m_size = 0;
+	};
+
+	template<typename data_record>
+	std::shared_ptr<indexer::index<data_record>> open_domain_index(const std::string &db_name, uint64_t dom_hash,
+			size_t &size) {
+		const std::string file = config::data_path() + "/" + to_string(dom_hash % 8) + "/full_text/" + db_name + "/" +
+			to_string(dom_hash) + ".data";
+		std::error_code ec;
+		const size_t file_size = std::filesystem::file_size(file, ec);
+		if (ec || file_size == 0) return nullptr;
+
+		auto idx = std::make_shared<indexer::index<data_record>>(db_name, dom_hash, 1000);
+		size += file_size + idx->records().size() * sizeof(data_record);
+		return idx;
+	}
+
+	domain_indexes open_domain_indexes(uint64_t dom_hash) {
+		domain_indexes indexes;
+		indexes.m_size = 256;
+		indexes.m_urls = open_domain_index<indexer::url_record>("url", dom_hash, indexes.m_size);
+		indexes.m_links = open_domain_index<indexer::link_record>("url_links", dom_hash, indexes.m_size);
+		return indexes;
+	}
+
+	/*
+	 * Top len urls of the domain for the tokens. The score of a url is boosted by the links to it that match the
+	 * tokens.
+	 * */
+	std::vector<indexer::url_record> search_domain(const domain_indexes &indexes, const std::vector<uint64_t> &tokens,
+			size_t len, size_t &total_num_results) {
+
+		std::vector<indexer::url_record> res;
+
+		vector<indexer::link_record> links;
+		float max_link_score = 0.0f;
+		if (indexes.m_links) {
+			auto no_mod = [](const indexer::link_record &) { return 0.0f; };
+			auto no_mod_bound = [](float) { return 0.0f; };
+			size_t total_num_links = 0;
+
+			links = indexes.m_links->find_top(total_num_links, tokens, 1000, no_mod, no_mod_bound);
+
+			std::sort(links.begin(), links.end(), indexer::link_record::storage_order());
+
+			auto link_formula = [](float score) {
+				return expm1(20.0f * score) / 10.0f;
+			};
+
+			std::vector<indexer::link_record> grouped;
+			for (auto rec : links) {
+				if (grouped.size() && grouped.back().storage_equal(rec)) {
+					grouped.back().m_score += link_formula(rec.m_score);
+				} else {
+					grouped.emplace_back(rec);
+					grouped.back().m_score = link_formula(rec.m_score);
+				}
+			}
+
+			links = grouped;
+
+			for (const auto &rec : links) {
+				max_link_score = std::max(max_link_score, rec.m_score);
+			}
+		}
+
+		size_t mod_incr = 0;
+		auto score_mod = [&mod_incr, &links](const indexer::url_record &record) {
+			while (mod_incr < links.size() && links[mod_incr].m_target_hash < record.m_value) {
+				mod_incr++;
+			}
+			float link_score = 0.0f;
+			if (mod_incr < links.size() && links[mod_incr].m_target_hash == record.m_value) {
+				link_score += links[mod_incr].m_score;
+			}
+			return record.m_score + ((1000.0f - record.url_length()) / 500.0f) + link_score;
+		};
+
+		// Upper bound of score_mod for records with m_score <= max_score, lets find_top skip blocks.
+		auto score_mod_bound = [max_link_score](float max_score) {
+			return max_score + 2.0f + max_link_score;
+		};
+
+		if (indexes.m_urls) {
+			res = indexes.m_urls->find_top(total_num_results, tokens, len, score_mod, score_mod_bound);
+		}
+
+		return res;
+	}
+
 	void url_server() {
 
 		cout << "starting server..." << endl;
 
-		::http::server srv([](const http::request &req) {
+		// Opened indexes of the most recently queried domains, bounded by bytes and by entries since every entry holds
+		// up to two memory mappings and the process can only have vm.max_map_count of them. Cleared when the index
+		// builders write a new index generation.
+		utils::sharded_lru_cache<uint64_t, domain_indexes> index_cache(config::url_server_cache_mb * 1024 * 1024, 16,
+			[](const domain_indexes &indexes) { return indexes.m_size; }, config::url_server_cache_entries);
+		indexer::index_generation_watch index_generation;
+
+		ThreadPool pool(config::url_server_threads);
+
+		::http::server srv([&index_cache, &index_generation, &pool](const http::request &req) {
 			http::response res;
 
 			URL url = req.url();
 
 			auto query = url.query();
 
-			stringstream body;
-
 			if (req.request_method() == "POST") {
 				const string req_body = req.request_body();
 
@@ -57,120 +170,89 @@ namespace server {
 
 				size_t len = std::stoull(query["len"]);
 
-				std::map<uint64_t, std::vector<indexer::url_record>> results;
+				if (index_generation.changed()) {
+					index_cache.clear();
+				}
 
-				utils::thread_pool pool(32);
-				std::mutex result_lock;
 				cout << "received " << domain_hashes.size() << " hashes" << endl;
-				size_t all_total_num_results = 0;
-				for (auto dom_hash : domain_hashes) {
-					pool.enqueue([dom_hash, tokens, &query, &result_lock, &results, &all_total_num_results, len]() {
-						std::vector<indexer::url_record> res;
-
-						vector<indexer::link_record> links;
-						{
-							// read links
-							const string file = config::data_path() + "/" + to_string(dom_hash % 8) +
-								"/full_text/url_links/" + to_string(dom_hash) + ".data";
-							indexer::index_reader_file reader(file);
-
-							if (reader.size()) {
-								if (reader.size() > 10 * 1024* 1024) {
-									indexer::index<indexer::link_record> idx("url_links", dom_hash, 1000);
-									links = idx.find_top(tokens, 1000);
-								} else {
-									const size_t size = reader.size();
-									std::unique_ptr<char[]> buffer = std::make_unique<char[]>(size);
-									reader.seek(0);
-									reader.read(buffer.get(), size);
-									std::istringstream ram_reader(string(buffer.get(), size));
-									indexer::index<indexer::link_record> idx(&ram_reader, 1000);
-									links = idx.find_top(tokens, 1000);
-								}
-							}
 
-							std::sort(links.begin(), links.end(), indexer::link_record::storage_order());
-
-							auto link_formula = [](float score) {
-								return expm1(20.0f * score) / 10.0f;
-							};
-
-							std::vector<indexer::link_record> grouped;
-							for (auto rec : links) {
-								if (grouped.size() && grouped.back().storage_equal(rec)) {
-									grouped.back().m_score += link_formula(rec.m_score);
-								} else {
-									grouped.emplace_back(rec);
-									grouped.back().m_score = link_formula(rec.m_score);
+				// Every domain is sent as a frame as soon as it is searched, see url_server_protocol.h.
+				res.content_type("application/octet-stream");
+				res.body_writer([domain_hashes, tokens, len, &index_cache, &pool](
+						const http::response::write_function &write) {
+
+					std::mutex frames_lock;
+					std::condition_variable frames_cv;
+					std::vector<std::string> frames;
+					std::atomic<bool> cancelled = false;
+					std::atomic<bool> failed = false;
+
+					// Every task adds exactly one frame, empty if the domain was skipped or failed.
+					std::vector<std::future<void>> tasks;
+					for (auto dom_hash : domain_hashes) {
+						tasks.emplace_back(pool.enqueue([dom_hash, &tokens, len, &index_cache, &frames_lock, &frames_cv,
+								&frames, &cancelled, &failed]() {
+							std::string frame;
+							if (!cancelled) {
+								try {
+									domain_indexes indexes;
+									if (!index_cache.get(dom_hash, indexes)) {
+										indexes = open_domain_indexes(dom_hash);
+										index_cache.put(dom_hash, indexes);
+									}
+									size_t total_num_results = 0;
+									const auto records = search_domain(indexes, tokens, len, total_num_results);
+									frame = url_domain_frame(dom_hash, total_num_results, records);
+								} catch (const std::exception &error) {
+									LOG_ERROR("Search in domain " + to_string(dom_hash) + " failed: " + error.what());
+									failed = true;
 								}
 							}
+							std::lock_guard lock(frames_lock);
+							frames.push_back(std::move(frame));
+							frames_cv.notify_one();
+						}));
+					}
 
-							links = grouped;
+					bool connected = write(url_protocol_header());
+					size_t num_received = 0;
+					size_t num_domain_frames = 0;
+					while (num_received < domain_hashes.size()) {
+						std::vector<std::string> ready;
+						{
+							std::unique_lock lock(frames_lock);
+							frames_cv.wait(lock, [&frames]() { return frames.size() > 0; });
+							ready.swap(frames);
 						}
-
-						const string file = config::data_path() + "/" + to_string(dom_hash % 8) + "/full_text/url/" +
-							to_string(dom_hash) + ".data";
-						indexer::index_reader_file reader(file);
-
-						size_t mod_incr = 0;
-						auto score_mod = [&mod_incr, &links](const indexer::url_record &record) {
-							while (mod_incr < links.size() && links[mod_incr].m_target_hash < record.m_value) {
-								mod_incr++;
-							}
-							float link_score = 0.0f;
-							if (mod_incr < links.size() && links[mod_incr].m_target_hash == record.m_value) {
-								link_score += links[mod_incr].m_score;
-							}
-							return record.m_score + ((1000.0f - record.url_length()) / 500.0f) + link_score;
-						};
-
-						size_t total_num_results = 0;
-
-						if (reader.size()) {
-							if (reader.size() > 10 * 1024* 1024) {
-								indexer::index<indexer::url_record> idx("url", dom_hash, 1000);
-								res = idx.find_top(total_num_results, tokens, len, score_mod);
-							} else {
-								const size_t size = reader.size();
-								std::unique_ptr<char[]> buffer = std::make_unique<char[]>(size);
-								reader.seek(0);
-								reader.read(buffer.get(), size);
-								std::istringstream ram_reader(std::string(buffer.get(), size));
-								indexer::index<indexer::url_record> idx(&ram_reader, 1000);
-								res = idx.find_top(total_num_results, tokens, len, score_mod);
-							}
+						num_received += ready.size();
+
+						// Frames that finished together are sent together.
+						std::string data;
+						for (const std::string &frame : ready) {
+							if (frame.empty()) continue;
+							data += frame;
+							num_domain_frames++;
 						}
+						if (connected && data.size()) {
+							connected = write(data);
+						}
+						if (!connected) cancelled = true;
+					}
 
-						std::lock_guard lock(result_lock);
-						all_total_num_results += total_num_results;
-						results[dom_hash] = res;
-					});
-				}
-
-				pool.run_all();
-
-				// Output result.
-				body.write((char *)&all_total_num_results, sizeof(size_t));
-				for (auto domain_hash : domain_hashes) {
-					body.write((char *)&domain_hash, sizeof(uint64_t));
-					size_t num_records = results[domain_hash].size();
-					body.write((char *)&num_records, sizeof(size_t));
-
-					for (const auto &record : results[domain_hash]) {
-						body.write((char *)&(record.m_value), sizeof(uint64_t));
-						body.write((char *)&(record.m_score), sizeof(float));
+					// The tasks reference this writer, so all of them must be done before we return.
+					for (auto &task : tasks) {
+						task.wait();
 					}
-				}
 
-				res.content_type("application/octet-stream");
+					// Without the end frame the search server knows the response is incomplete.
+					if (connected && !failed) {
+						write(url_end_frame(num_domain_frames));
+					}
+				});
 			}
 
 			res.code(200);
 
-			const string res_str = body.str();
-			cout << "outputting: " << res_str.size() << endl;
-			res.body(res_str);
-
 			return res;
 		});
 	}
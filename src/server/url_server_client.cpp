@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "url_server_client.h"
+#include "url_server_protocol.h"
+#include "parser/parser.h"
+#include <memory>
+
+namespace server {
+
+	url_server_client::url_server_client(const std::vector<std::string> &nodes, long timeout_ms)
+	: m_nodes(nodes), m_client(timeout_ms) {
+	}
+
+	bool url_server_client::find(const std::string &q, size_t len, const std::vector<uint64_t> &domain_hashes,
+			size_t &total_num_results, std::map<uint64_t, std::vector<indexer::url_record>> &results) {
+
+		std::vector<std::vector<uint64_t>> node_hashes(m_nodes.size());
+		for (uint64_t domain_hash : domain_hashes) {
+			node_hashes[domain_hash % m_nodes.size()].push_back(domain_hash);
+		}
+
+		const std::string query_string = "/?q=" + parser::urlencode(q) + "&len=" + std::to_string(len);
+
+		total_num_results = 0;
+		std::vector<std::unique_ptr<url_frame_reader>> readers;
+		std::vector<transfer::client::request> requests;
+		for (size_t node = 0; node < m_nodes.size(); node++) {
+			if (node_hashes[node].empty()) continue;
+			const std::vector<uint64_t> &hashes = node_hashes[node];
+			readers.push_back(std::make_unique<url_frame_reader>(results, total_num_results));
+			url_frame_reader *reader = readers.back().get();
+			requests.push_back(transfer::client::request{"http://" + m_nodes[node] + query_string,
+				std::string((const char *)hashes.data(), hashes.size() * sizeof(uint64_t)), true,
+				[reader](const char *data, size_t len) { return reader->consume(data, len); }});
+		}
+
+		const std::vector<http::response> responses = m_client.perform_many(requests);
+
+		bool complete = true;
+		for (size_t i = 0; i < responses.size(); i++) {
+			if (responses[i].code() != 200 || !readers[i]->done()) {
+				complete = false;
+			}
+		}
+
+		return complete;
+	}
+
+}
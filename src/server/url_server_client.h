@@ -0,0 +1,68 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "indexer/url_record.h"
+#include "transfer/client.h"
+
+namespace server {
+
+	/*
+		Client for the url servers used by search_server.
+
+		The domains of a query are split over the url server nodes by domain_hash % nodes, every node gets one
+		request with its share of the domain hashes and all requests run in parallel over pooled connections. The
+		nodes stream one frame per domain (see url_server_protocol.h) that is merged into the results as it arrives,
+		so when the timeout cuts off a slow node the domains it already finished are still used.
+	*/
+	class url_server_client {
+
+		public:
+
+			url_server_client(const std::vector<std::string> &nodes, long timeout_ms);
+
+			/*
+			 * Finds the top len urls of each domain for the query. Results are merged into results by domain hash and
+			 * total_num_results is the sum of the totals of the domains. Returns false if a node failed or did not
+			 * finish before the timeout, the domains that were received are still returned.
+			 * */
+			bool find(const std::string &q, size_t len, const std::vector<uint64_t> &domain_hashes,
+				size_t &total_num_results, std::map<uint64_t, std::vector<indexer::url_record>> &results);
+
+			size_t num_nodes() const { return m_nodes.size(); }
+
+		private:
+
+			std::vector<std::string> m_nodes;
+			transfer::client m_client;
+
+	};
+
+}
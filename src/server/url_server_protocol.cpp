@@ -0,0 +1,145 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "url_server_protocol.h"
+#include <cstring>
+
+namespace server {
+
+	const char url_protocol_magic[4] = {'A', 'L', 'X', 'U'};
+
+	template<typename value_type>
+	void append_value(std::string &out, value_type value) {
+		out.append((const char *)&value, sizeof(value_type));
+	}
+
+	template<typename value_type>
+	value_type read_value(const char *data) {
+		value_type value;
+		memcpy(&value, data, sizeof(value_type));
+		return value;
+	}
+
+	std::string url_frame(uint8_t type, const std::string &payload) {
+		std::string frame;
+		frame.reserve(payload.size() + 5);
+		append_value<uint8_t>(frame, type);
+		append_value<uint32_t>(frame, payload.size());
+		frame += payload;
+		return frame;
+	}
+
+	std::string url_protocol_header() {
+		std::string header(url_protocol_magic, sizeof(url_protocol_magic));
+		append_value<uint32_t>(header, url_protocol_version);
+		return header;
+	}
+
+	std::string url_domain_frame(uint64_t domain_hash, size_t total_num_results,
+			const std::vector<indexer::url_record> &records) {
+		std::string payload;
+		payload.reserve(20 + records.size() * 12);
+		append_value<uint64_t>(payload, domain_hash);
+		append_value<uint64_t>(payload, total_num_results);
+		append_value<uint32_t>(payload, records.size());
+		for (const indexer::url_record &record : records) {
+			append_value<uint64_t>(payload, record.m_value);
+			append_value<float>(payload, record.m_score);
+		}
+		return url_frame(url_frame_domain, payload);
+	}
+
+	std::string url_end_frame(size_t num_domain_frames) {
+		std::string payload;
+		append_value<uint32_t>(payload, num_domain_frames);
+		return url_frame(url_frame_end, payload);
+	}
+
+	url_frame_reader::url_frame_reader(std::map<uint64_t, std::vector<indexer::url_record>> &results,
+			size_t &total_num_results)
+	: m_results(results), m_total_num_results(total_num_results) {
+	}
+
+	bool url_frame_reader::consume(const char *data, size_t len) {
+		if (m_error) return false;
+		m_buffer.append(data, len);
+
+		size_t pos = 0;
+		if (!m_header_read) {
+			if (m_buffer.size() < 8) return true;
+			if (memcmp(m_buffer.data(), url_protocol_magic, sizeof(url_protocol_magic)) != 0 ||
+					read_value<uint32_t>(m_buffer.data() + 4) != url_protocol_version) {
+				m_error = true;
+				return false;
+			}
+			m_header_read = true;
+			pos = 8;
+		}
+
+		while (m_buffer.size() - pos >= 5) {
+			const uint8_t type = read_value<uint8_t>(m_buffer.data() + pos);
+			const size_t frame_len = read_value<uint32_t>(m_buffer.data() + pos + 1);
+			if (frame_len > url_max_frame_len || m_done) {
+				m_error = true;
+				return false;
+			}
+			if (m_buffer.size() - pos - 5 < frame_len) break;
+			if (!read_frame(type, m_buffer.data() + pos + 5, frame_len)) {
+				m_error = true;
+				return false;
+			}
+			pos += 5 + frame_len;
+		}
+
+		m_buffer.erase(0, pos);
+		return true;
+	}
+
+	bool url_frame_reader::read_frame(uint8_t type, const char *payload, size_t len) {
+		if (type == url_frame_domain) {
+			if (len < 20) return false;
+			const uint64_t domain_hash = read_value<uint64_t>(payload);
+			const size_t total_num_results = read_value<uint64_t>(payload + 8);
+			const size_t num_records = read_value<uint32_t>(payload + 16);
+			if (len != 20 + num_records * 12) return false;
+
+			std::vector<indexer::url_record> &records = m_results[domain_hash];
+			records.reserve(records.size() + num_records);
+			for (size_t i = 0; i < num_records; i++) {
+				const char *record = payload + 20 + i * 12;
+				records.emplace_back(read_value<uint64_t>(record), read_value<float>(record + 8));
+			}
+			m_total_num_results += total_num_results;
+			m_num_domain_frames++;
+		} else if (type == url_frame_end) {
+			if (len < 4) return false;
+			if (read_value<uint32_t>(payload) != m_num_domain_frames) return false;
+			m_done = true;
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,96 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "indexer/url_record.h"
+
+namespace server {
+
+	/*
+		Wire format of the responses from url_server to search_server.
+
+		A response starts with the 4 byte magic "ALXU" and a uint32 protocol version, followed by frames. Every frame
+		is a uint8 frame type, the uint32 length of the payload and the payload. Readers skip frame types they don't
+		know, so new frame types can be added without a new version.
+
+		domain frame: uint64 domain hash, uint64 total number of results in the domain, uint32 number of records and
+			the records as uint64 value and float score.
+		end frame: uint32 number of domain frames sent. Always the last frame of a complete response.
+
+		url_server sends a domain frame as soon as the domain is searched, so the frames come in the order the
+		domains finish. All integers are little endian.
+	*/
+	const uint32_t url_protocol_version = 1;
+	const uint8_t url_frame_domain = 1;
+	const uint8_t url_frame_end = 2;
+	const size_t url_max_frame_len = 64 * 1024 * 1024;
+
+	std::string url_protocol_header();
+	std::string url_domain_frame(uint64_t domain_hash, size_t total_num_results,
+		const std::vector<indexer::url_record> &records);
+	std::string url_end_frame(size_t num_domain_frames);
+
+	/*
+	 * Parses a response as it arrives and merges the domain frames into results. Data can be given in pieces of any
+	 * size.
+	 * */
+	class url_frame_reader {
+
+		public:
+
+			url_frame_reader(std::map<uint64_t, std::vector<indexer::url_record>> &results,
+				size_t &total_num_results);
+
+			/*
+			 * Returns false if the data is not a valid response, the reader then ignores everything that follows.
+			 * */
+			bool consume(const char *data, size_t len);
+
+			/*
+			 * True when the end frame has been read and all domain frames before it were received.
+			 * */
+			bool done() const { return m_done; }
+			bool error() const { return m_error; }
+
+		private:
+
+			std::map<uint64_t, std::vector<indexer::url_record>> &m_results;
+			size_t &m_total_num_results;
+			std::string m_buffer;
+			bool m_header_read = false;
+			bool m_done = false;
+			bool m_error = false;
+			size_t m_num_domain_frames = 0;
+
+			bool read_frame(uint8_t type, const char *payload, size_t len);
+
+	};
+
+}
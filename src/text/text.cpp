@@ -30,6 +30,54 @@ using namespace std;
 
 namespace text {
 
+	inline bool is_word_boundary(char ch) {
+		return ch == ' ' || ch == '\t' || ch == ',' || ch == '|' || ch == '!';
+	}
+
+	inline bool is_blend_char(char ch) {
+		return ch == '.' || ch == '-' || ch == ':';
+	}
+
+	/*
+	 * Same as trim_both_inplace and trim_punct_inplace but on a view.
+	 * */
+	inline std::string_view trim_both_view(std::string_view s) {
+		auto is_trimmed = [](int ch) {
+			return isspace(ch) || my_ispunct(ch);
+		};
+		size_t start = 0, end = s.size();
+		while (start < end && is_trimmed(s[start])) start++;
+		while (end > start && is_trimmed(s[end - 1])) end--;
+		return s.substr(start, end - start);
+	}
+
+	inline std::string_view trim_punct_view(std::string_view s) {
+		size_t start = 0, end = s.size();
+		while (start < end && my_ispunct(s[start])) start++;
+		while (end > start && my_ispunct(s[end - 1])) end--;
+		return s.substr(start, end - start);
+	}
+
+	inline void lower_case(std::string_view str, std::string &buffer) {
+		buffer.resize(str.size());
+		transform(str.begin(), str.end(), buffer.begin(), [](unsigned char c){ return tolower(c); });
+	}
+
+	/*
+	 * Calls callback with every word of the lower cased buffer split on the word boundaries, the same words as
+	 * boost::split gives. Stops if callback returns false.
+	 * */
+	template<typename callback_type>
+	inline void split_words(std::string_view buffer, callback_type &&callback) {
+		size_t word_start = 0;
+		for (size_t i = 0; i <= buffer.size(); i++) {
+			if (i == buffer.size() || is_word_boundary(buffer[i])) {
+				if (!callback(buffer.substr(word_start, i - word_start))) return;
+				word_start = i + 1;
+			}
+		}
+	}
+
 	bool is_clean_char(const char *ch, size_t multibyte_len) {
 		if (multibyte_len == 1) {
 			return (ch[0] >= 'a' && ch[0] <= 'z') || (ch[0] >= '0' && ch[0] <= '9');
@@ -110,62 +158,82 @@ namespace text {
 	*/
 	vector<string> get_full_text_words(const string &str, size_t limit) {
 
-		const string word_boundary = " \t,|!";
+		string buffer;
+		vector<string_view> word_views;
+		get_full_text_words(str, buffer, word_views, limit);
 
-		string str_lc = lower_case(str);
+		return vector<string>(word_views.begin(), word_views.end());
+	}
 
-		vector<string> raw_words, words;
-		boost::split(raw_words, str_lc, boost::is_any_of(word_boundary));
+	void get_full_text_words(string_view str, string &buffer, vector<string_view> &words, size_t limit) {
 
-		for (string &word : raw_words) {
-			if (parser::unicode::is_valid(word)) {
-				trim_both_inplace(word);
+		words.clear();
+		lower_case(str, buffer);
+
+		split_words(buffer, [&words, limit](string_view raw_word) {
+			if (parser::unicode::is_valid(raw_word)) {
+				const string_view word = trim_both_view(raw_word);
 				if (word.size() <= CC_MAX_WORD_LEN && word.size() > 0) {
 					words.push_back(word);
 				}
-				if (limit && words.size() == limit) break;
+				if (limit && words.size() == limit) return false;
 			}
-			
-		}
-
-		return words;
+			return true;
+		});
 	}
 
 	/*
 		This should be the fast way of getting tokens out of a string. It should just read the whole string and
 		store tokens using the str2token hash function.
 	*/
-	vector<uint64_t> get_tokens(const string &str, std::function<uint64_t(std::string)> str2token) {
-		const char *word_boundary = " \t,|!";
-		string cur_token;
+	/*
+		Tokens are split on the word boundaries, all other whitespace is removed and the punctuation is trimmed. The
+		tokens are collected in one buffer instead of a string per token.
+	*/
+	template<typename hash_function>
+	vector<uint64_t> tokenize(const string &str, hash_function &&str2token) {
+		string buffer;
+		buffer.reserve(str.size());
+		size_t token_start = 0;
 		std::vector<uint64_t> tokens;
+
+		auto end_token = [&]() {
+			const string_view token = string_view(buffer).substr(token_start);
+			if (token.size() && parser::unicode::is_valid(token)) {
+				tokens.push_back(str2token(trim_punct_view(token)));
+			}
+			token_start = buffer.size();
+		};
+
 		for (const char &ch : str) {
-			// If is word boundary.
-			if (strchr(word_boundary, ch)) {
-				if (cur_token.size() && parser::unicode::is_valid(cur_token)) {
-					trim_punct_inplace(cur_token);
-					tokens.push_back(str2token(cur_token));
-				}
-				cur_token.clear();
+			// NUL also ends a token here, tokens have always been split with strchr which matches it. split_words
+			// keeps it inside words.
+			if (is_word_boundary(ch) || ch == '\0') {
+				end_token();
 			} else {
 				// This if statement trims the token.
 				if (!isspace(ch)) {
-					cur_token.insert(cur_token.end(), tolower(ch));
+					buffer.push_back(tolower(ch));
 				}
 			}
 		}
 
 		// Remember the last token.
-		if (cur_token.size() && parser::unicode::is_valid(cur_token)) {
-			trim_punct_inplace(cur_token);
-			tokens.push_back(str2token(cur_token));
-		}
+		end_token();
 
 		return tokens;
 	}
 
+	vector<uint64_t> get_tokens(const string &str, std::function<uint64_t(std::string)> str2token) {
+		return tokenize(str, [&str2token](string_view token) {
+			return str2token(string(token));
+		});
+	}
+
 	vector<uint64_t> get_tokens(const string &str) {
-		return get_tokens(str, algorithm::hash);
+		return tokenize(str, [](string_view token) {
+			return algorithm::hash(token);
+		});
 	}
 
 	vector<string> get_snippets(const string &str) {
@@ -217,36 +285,41 @@ namespace text {
 	*/
 	vector<string> get_expanded_full_text_words(const string &str, size_t limit) {
 
-		const string word_boundary = " \t,|!";
-		const string blend_chars = ".-:";
+		string buffer;
+		vector<string_view> word_views;
+		get_expanded_full_text_words(str, buffer, word_views, limit);
 
-		string str_lc = lower_case(str);
+		return vector<string>(word_views.begin(), word_views.end());
+	}
 
-		vector<string> raw_words, words, blended;
-		boost::split(raw_words, str_lc, boost::is_any_of(word_boundary));
+	void get_expanded_full_text_words(string_view str, string &buffer, vector<string_view> &words, size_t limit) {
 
-		for (string &word : raw_words) {
-			if (parser::unicode::is_valid(word)) {
-				trim_both_inplace(word);
+		words.clear();
+		lower_case(str, buffer);
+
+		split_words(buffer, [&words, limit](string_view raw_word) {
+			if (parser::unicode::is_valid(raw_word)) {
+				const string_view word = trim_both_view(raw_word);
 				if (word.size() <= CC_MAX_WORD_LEN && word.size() > 0) {
 					words.push_back(word);
 
-					if (limit && words.size() == limit) break;
-
-					boost::split(blended, word, boost::is_any_of(blend_chars));
-					if (blended.size() > 1) {
-						for (string &blended_word : blended) {
-							trim_both_inplace(blended_word);
-							words.push_back(blended_word);
-							if (limit && words.size() == limit) break;
+					if (limit && words.size() == limit) return false;
+
+					// Also add the parts of words like "a.b" or "a-b", trimmed the same way.
+					if (std::find_if(word.begin(), word.end(), is_blend_char) != word.end()) {
+						size_t part_start = 0;
+						for (size_t i = 0; i <= word.size(); i++) {
+							if (i == word.size() || is_blend_char(word[i])) {
+								words.push_back(trim_both_view(word.substr(part_start, i - part_start)));
+								part_start = i + 1;
+								if (limit && words.size() == limit) break;
+							}
 						}
 					}
 				}
 			}
-			
-		}
-
-		return words;
+			return true;
+		});
 	}
 
 	vector<string> get_expanded_full_text_words(const string &str) {
@@ -283,51 +356,6 @@ namespace text {
 		return get_words_without_stopwords(str, 0);
 	}
 
-	void words_to_ngram_hash(const std::vector<std::string> &words, size_t n_grams, const std::function<void(uint64_t)> &ins) {
-		
-		const size_t word_iter_max = words.size();
-
-		for (size_t i = 0; i < word_iter_max; i++) {
-			for (size_t j = 0; j < n_grams && (j + i) < word_iter_max; j++) {
-				std::string n_gram = words[i];
-				for (size_t k = i + 1; k <= i + j; k++) {
-					n_gram += " " + words[k];
-				}
-				ins(algorithm::hash(n_gram));
-			}
-		}
-	}
-
-	void words_to_ngram_hash(const std::vector<std::string> &words, size_t n_grams, const std::function<void(uint64_t, const std::string &)> &ins) {
-		
-		const size_t word_iter_max = words.size();
-
-		for (size_t i = 0; i < word_iter_max; i++) {
-			for (size_t j = 0; j < n_grams && (j + i) < word_iter_max; j++) {
-				std::string n_gram = words[i];
-				for (size_t k = i + 1; k <= i + j; k++) {
-					n_gram += " " + words[k];
-				}
-				ins(algorithm::hash(n_gram), n_gram);
-			}
-		}
-	}
-
-	void words_to_ngram_hash(const std::vector<std::string> &words, size_t n_grams, const std::function<void(uint64_t, const std::string &, size_t)> &ins) {
-		
-		const size_t word_iter_max = words.size();
-
-		for (size_t i = 0; i < word_iter_max; i++) {
-			for (size_t j = 0; j < n_grams && (j + i) < word_iter_max; j++) {
-				std::string n_gram = words[i];
-				for (size_t k = i + 1; k <= i + j; k++) {
-					n_gram += " " + words[k];
-				}
-				ins(algorithm::hash(n_gram), n_gram, j + 1);
-			}
-		}
-	}
-
 	std::map<std::string, size_t> get_word_counts(const string &text) {
 		vector<string> words = get_full_text_words(text);
 		map<string, size_t> counts;
@@ -30,6 +30,8 @@
 
 #include <vector>
 #include <map>
+#include <string_view>
+#include <type_traits>
 #include <iostream>
 #include <algorithm>
 #include <boost/algorithm/string.hpp>
@@ -179,6 +181,13 @@ namespace text {
 	std::vector<std::string> get_full_text_words(const std::string &str, size_t limit);
 	std::vector<std::string> get_full_text_words(const std::string &str);
 
+	/*
+		The same words as get_full_text_words without allocating. str is lower cased into buffer and words is
+		filled with views into buffer, they are valid until buffer is changed. Both can be reused between calls.
+	*/
+	void get_full_text_words(std::string_view str, std::string &buffer, std::vector<std::string_view> &words,
+		size_t limit = 0);
+
 	std::vector<uint64_t> get_tokens(const std::string &str, std::function<uint64_t(std::string)> str2token);
 	std::vector<uint64_t> get_tokens(const std::string &str);
 
@@ -190,6 +199,8 @@ namespace text {
 	*/
 	std::vector<std::string> get_expanded_full_text_words(const std::string &str, size_t limit);
 	std::vector<std::string> get_expanded_full_text_words(const std::string &str);
+	void get_expanded_full_text_words(std::string_view str, std::string &buffer, std::vector<std::string_view> &words,
+		size_t limit = 0);
 
 	/*
 		Returns a vector of words lower case, punctuation trimmed and less or equal than CC_MAX_WORD_LEN length.
@@ -197,9 +208,40 @@ namespace text {
 	std::vector<std::string> get_words_without_stopwords(const std::string &str, size_t limit);
 	std::vector<std::string> get_words_without_stopwords(const std::string &str);
 
-	void words_to_ngram_hash(const std::vector<std::string> &words, size_t n_grams, const std::function<void(uint64_t)> &ins);
-	void words_to_ngram_hash(const std::vector<std::string> &words, size_t n_grams, const std::function<void(uint64_t, const std::string &)> &ins);
-	void words_to_ngram_hash(const std::vector<std::string> &words, size_t n_grams, const std::function<void(uint64_t, const std::string &, size_t)> &ins);
+	/*
+		Calls ins for every n-gram of 1 to n_grams words with the hash of the words joined by spaces. ins is called
+		with (hash), (hash, n_gram) or (hash, n_gram, number of words) depending on what it accepts. Every n-gram
+		extends the previous one in the same buffer so nothing is allocated per n-gram.
+	*/
+	template<typename word_type, typename callback_type>
+	void words_to_ngram_hash(const std::vector<word_type> &words, size_t n_grams, callback_type &&ins) {
+
+		const size_t word_iter_max = words.size();
+
+		std::string n_gram;
+		for (size_t i = 0; i < word_iter_max; i++) {
+			n_gram.assign(words[i]);
+			for (size_t j = 0; j < n_grams && (j + i) < word_iter_max; j++) {
+				if (j > 0) {
+					n_gram += ' ';
+					n_gram.append(words[i + j]);
+				}
+				const uint64_t hash = algorithm::hash(n_gram);
+				if constexpr (std::is_invocable_v<callback_type, uint64_t, const std::string &, size_t>) {
+					ins(hash, n_gram, j + 1);
+				} else if constexpr (std::is_invocable_v<callback_type, uint64_t, const std::string &>) {
+					ins(hash, n_gram);
+				} else {
+					ins(hash);
+				}
+			}
+		}
+	}
+
+	template<typename callback_type>
+	void words_to_ngram_hash(std::initializer_list<std::string> words, size_t n_grams, callback_type &&ins) {
+		words_to_ngram_hash(std::vector<std::string>(words), n_grams, std::forward<callback_type>(ins));
+	}
 
 	std::map<std::string, size_t> get_word_counts(const std::string &text);
 	std::map<std::string, float> get_word_frequency(const std::string &text);
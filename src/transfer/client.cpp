@@ -0,0 +1,160 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "client.h"
+#include "logger/logger.h"
+#include <algorithm>
+
+namespace transfer {
+
+	static size_t append_to_string(void *ptr, size_t size, size_t nmemb, std::string *str) {
+		str->append((char *)ptr, size * nmemb);
+		return size * nmemb;
+	}
+
+	static size_t pass_to_callback(void *ptr, size_t size, size_t nmemb,
+			const std::function<bool(const char *, size_t)> *on_data) {
+		return (*on_data)((const char *)ptr, size * nmemb) ? size * nmemb : 0;
+	}
+
+	client::client(long timeout_ms, long connect_timeout_ms)
+	: m_timeout_ms(timeout_ms), m_connect_timeout_ms(connect_timeout_ms) {
+		m_share = curl_share_init();
+		curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+		curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, lock_share);
+		curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, unlock_share);
+		curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+	}
+
+	client::~client() {
+		for (CURL *handle : m_handles) {
+			curl_easy_cleanup(handle);
+		}
+		curl_share_cleanup(m_share);
+	}
+
+	http::response client::get(const std::string &url) {
+		return perform_many({request{url, "", false}})[0];
+	}
+
+	http::response client::post(const std::string &url, const std::string &data) {
+		return perform_many({request{url, data, true}})[0];
+	}
+
+	std::vector<http::response> client::perform_many(const std::vector<request> &requests) {
+
+		std::vector<http::response> responses(requests.size());
+		std::vector<std::string> bodies(requests.size());
+		std::vector<CURL *> handles(requests.size());
+
+		// Without this curl waits for a 100 Continue before sending larger POST bodies.
+		struct curl_slist *header_list = curl_slist_append(NULL, "Expect:");
+
+		CURLM *multi = curl_multi_init();
+		for (size_t i = 0; i < requests.size(); i++) {
+			CURL *handle = handles[i] = acquire_handle();
+			curl_easy_setopt(handle, CURLOPT_URL, requests[i].m_url.c_str());
+			curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, m_timeout_ms);
+			curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, m_connect_timeout_ms);
+			curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+			curl_easy_setopt(handle, CURLOPT_HTTPHEADER, header_list);
+			if (requests[i].m_on_data) {
+				curl_easy_setopt(handle, CURLOPT_WRITEDATA, &requests[i].m_on_data);
+				curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, pass_to_callback);
+			} else {
+				curl_easy_setopt(handle, CURLOPT_WRITEDATA, &bodies[i]);
+				curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, append_to_string);
+			}
+			if (requests[i].m_post) {
+				curl_easy_setopt(handle, CURLOPT_POSTFIELDS, requests[i].m_data.data());
+				curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)requests[i].m_data.size());
+			}
+			responses[i].code(0);
+			curl_multi_add_handle(multi, handle);
+		}
+
+		int running = 0;
+		do {
+			if (curl_multi_perform(multi, &running) != CURLM_OK) break;
+			if (running) curl_multi_poll(multi, NULL, 0, 100, NULL);
+		} while (running);
+
+		CURLMsg *msg;
+		int msgs_left;
+		while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+			if (msg->msg != CURLMSG_DONE) continue;
+			const size_t i = std::find(handles.begin(), handles.end(), msg->easy_handle) - handles.begin();
+			if (msg->data.result == CURLE_OK) {
+				long code = 0;
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+				responses[i].code(code);
+				responses[i].body(bodies[i]);
+			} else {
+				LOG_INFO("request to " + requests[i].m_url + " failed: " + curl_easy_strerror(msg->data.result));
+			}
+		}
+
+		for (CURL *handle : handles) {
+			curl_multi_remove_handle(multi, handle);
+			release_handle(handle);
+		}
+		curl_multi_cleanup(multi);
+		curl_slist_free_all(header_list);
+
+		return responses;
+	}
+
+	CURL *client::acquire_handle() {
+		{
+			std::lock_guard lock(m_handles_lock);
+			if (m_handles.size()) {
+				CURL *handle = m_handles.back();
+				m_handles.pop_back();
+				return handle;
+			}
+		}
+		CURL *handle = curl_easy_init();
+		curl_easy_setopt(handle, CURLOPT_SHARE, m_share);
+		return handle;
+	}
+
+	void client::release_handle(CURL *handle) {
+		// Reset keeps the share handle, so the connections stay in the shared cache.
+		curl_easy_reset(handle);
+		std::lock_guard lock(m_handles_lock);
+		m_handles.push_back(handle);
+	}
+
+	void client::lock_share(CURL *, curl_lock_data data, curl_lock_access, void *userptr) {
+		static_cast<client *>(userptr)->m_share_locks[data].lock();
+	}
+
+	void client::unlock_share(CURL *, curl_lock_data data, void *userptr) {
+		static_cast<client *>(userptr)->m_share_locks[data].unlock();
+	}
+
+}
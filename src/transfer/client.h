@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <curl/curl.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "http/response.h"
+
+namespace transfer {
+
+	/*
+		HTTP client that keeps connections open between requests.
+
+		All requests share one connection and DNS cache (a curl share handle), so a request to a host that was
+		recently contacted reuses an idle connection instead of opening a new one. Easy handles are pooled and
+		reused as well. Requests given to perform_many run in parallel on one multi handle and the call returns
+		when all of them are done or have timed out.
+
+		The client is thread safe, one instance is meant to live as long as the process.
+	*/
+	class client {
+
+		public:
+
+			/*
+			 * With m_on_data set the response body is passed to it as it arrives instead of being collected in the
+			 * response, returning false from it aborts the request.
+			 * */
+			struct request {
+				std::string m_url;
+				std::string m_data;
+				bool m_post = false;
+				std::function<bool(const char *data, size_t len)> m_on_data;
+			};
+
+			explicit client(long timeout_ms = 5000, long connect_timeout_ms = 1000);
+			~client();
+
+			client(const client &) = delete;
+			client &operator=(const client &) = delete;
+
+			/*
+			 * Requests that fail or time out get response code 0.
+			 * */
+			http::response get(const std::string &url);
+			http::response post(const std::string &url, const std::string &data);
+			std::vector<http::response> perform_many(const std::vector<request> &requests);
+
+		private:
+
+			long m_timeout_ms;
+			long m_connect_timeout_ms;
+			CURLSH *m_share;
+			std::mutex m_share_locks[CURL_LOCK_DATA_LAST];
+			std::mutex m_handles_lock;
+			std::vector<CURL *> m_handles;
+
+			CURL *acquire_handle();
+			void release_handle(CURL *handle);
+
+			static void lock_share(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr);
+			static void unlock_share(CURL *handle, curl_lock_data data, void *userptr);
+
+	};
+
+}
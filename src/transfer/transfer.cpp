@@ -287,6 +287,40 @@ namespace transfer {
 		}
 	}
 
+	void url_range_to_string(const string &url, size_t offset, size_t len, string &buffer, int &error) {
+		CURL *curl = curl_easy_init();
+		error = ERROR;
+		const size_t original_buffer_size = buffer.size();
+		if (curl) {
+			CURLcode res;
+			const string range = to_string(offset) + "-" + to_string(offset + len - 1);
+			curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+			curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+			curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 5000);
+			curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 5);
+
+			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+			curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_string_writer);
+
+			res = curl_easy_perform(curl);
+
+			long response_code = 0;
+			if (res == CURLE_OK) {
+				curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+			}
+
+			// Only a partial content response with the whole range is accepted, a server ignoring the range header
+			// would give us the full file.
+			if (response_code == 206 && buffer.size() - original_buffer_size == len) {
+				error = OK;
+			} else {
+				buffer.resize(original_buffer_size);
+			}
+
+			curl_easy_cleanup(curl);
+		}
+	}
+
 	string run_gz_download_thread(const string &file_path) {
 		size_t hsh = algorithm::hash(file_path);
 		const string target_filename = config::data_path() + "/" + to_string(hsh % 8) + "/tmp/tmp_" + to_string(hsh);
@@ -54,6 +54,9 @@ namespace transfer {
 
 	void url_to_string(const std::string &url, std::string &buffer, int &error);
 
+	// Download len bytes starting at offset with a http range request and append them to buffer.
+	void url_range_to_string(const std::string &url, size_t offset, size_t len, std::string &buffer, int &error);
+
 	std::vector<std::string> download_gz_files_to_disk(const std::vector<std::string> &files_to_download);
 	void delete_downloaded_files(const std::vector<std::string> &files);
 
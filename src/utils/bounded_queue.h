@@ -0,0 +1,105 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <deque>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+
+namespace utils {
+
+	/*
+	 * Queue between threads with a maximum length. push blocks while the queue is full so a slow consumer holds back
+	 * the producers instead of letting the queue grow. After close() pop returns false once the queue is empty.
+	 * */
+	template<typename value_type>
+	class bounded_queue {
+
+	public:
+
+		struct stats {
+			size_t m_len;
+			size_t m_max_len_seen;
+			size_t m_pushed;
+		};
+
+		explicit bounded_queue(size_t max_len)
+		: m_max_len(max_len) {
+		}
+
+		void push(value_type &&value) {
+			std::unique_lock lock(m_lock);
+			m_not_full.wait(lock, [this] { return m_queue.size() < m_max_len; });
+			m_queue.push_back(std::move(value));
+			m_pushed++;
+			m_max_len_seen = std::max(m_max_len_seen, m_queue.size());
+			lock.unlock();
+			m_not_empty.notify_one();
+		}
+
+		bool pop(value_type &value) {
+			std::unique_lock lock(m_lock);
+			m_not_empty.wait(lock, [this] { return !m_queue.empty() || m_closed; });
+			if (m_queue.empty()) return false;
+			value = std::move(m_queue.front());
+			m_queue.pop_front();
+			lock.unlock();
+			m_not_full.notify_one();
+			return true;
+		}
+
+		/*
+		 * No more values will be pushed, wakes up the consumers waiting in pop.
+		 * */
+		void close() {
+			{
+				std::lock_guard lock(m_lock);
+				m_closed = true;
+			}
+			m_not_empty.notify_all();
+		}
+
+		stats get_stats() const {
+			std::lock_guard lock(m_lock);
+			return stats{m_queue.size(), m_max_len_seen, m_pushed};
+		}
+
+	private:
+
+		mutable std::mutex m_lock;
+		std::condition_variable m_not_empty;
+		std::condition_variable m_not_full;
+		std::deque<value_type> m_queue;
+		const size_t m_max_len;
+		size_t m_max_len_seen = 0;
+		size_t m_pushed = 0;
+		bool m_closed = false;
+
+	};
+
+}
@@ -0,0 +1,179 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <list>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+namespace utils {
+
+	/*
+	 * Size bounded LRU cache split into shards by key hash so threads looking up different keys rarely wait for the
+	 * same lock. size_of gives the size of an entry in the unit of the capacity, which is split evenly over the
+	 * shards. With capacity 0 nothing is cached. max_entries limits the number of entries as well, split over the
+	 * shards the same way, 0 means no limit.
+	 * */
+	template<typename key_type, typename value_type>
+	class sharded_lru_cache {
+
+	public:
+
+		struct stats {
+			size_t m_hits;
+			size_t m_misses;
+			size_t m_entries;
+			size_t m_size;
+			size_t m_capacity;
+		};
+
+		sharded_lru_cache(size_t capacity, size_t num_shards = 16,
+			std::function<size_t(const value_type &)> size_of = [](const value_type &) { return 1; },
+			size_t max_entries = 0);
+
+		/*
+		 * Copies the value to 'value' and returns true if the key is in the cache.
+		 * */
+		bool get(const key_type &key, value_type &value);
+		void put(const key_type &key, const value_type &value);
+		void clear();
+		stats get_stats();
+
+	private:
+
+		struct shard {
+			std::mutex m_lock;
+			std::list<std::pair<key_type, value_type>> m_lru;
+			std::unordered_map<key_type, typename std::list<std::pair<key_type, value_type>>::iterator> m_entries;
+			size_t m_size = 0;
+		};
+
+		size_t m_capacity;
+		size_t m_shard_capacity;
+		size_t m_shard_max_entries;
+		std::function<size_t(const value_type &)> m_size_of;
+		std::vector<std::unique_ptr<shard>> m_shards;
+		std::atomic<size_t> m_hits = 0;
+		std::atomic<size_t> m_misses = 0;
+
+		shard &shard_for(const key_type &key);
+
+	};
+
+	template<typename key_type, typename value_type>
+	sharded_lru_cache<key_type, value_type>::sharded_lru_cache(size_t capacity, size_t num_shards,
+			std::function<size_t(const value_type &)> size_of, size_t max_entries)
+	: m_capacity(capacity), m_shard_capacity(capacity / std::max(num_shards, (size_t)1)),
+		m_shard_max_entries(max_entries ? std::max(max_entries / std::max(num_shards, (size_t)1), (size_t)1) : 0),
+		m_size_of(size_of) {
+		for (size_t i = 0; i < std::max(num_shards, (size_t)1); i++) {
+			m_shards.push_back(std::make_unique<shard>());
+		}
+	}
+
+	template<typename key_type, typename value_type>
+	bool sharded_lru_cache<key_type, value_type>::get(const key_type &key, value_type &value) {
+		if (m_capacity == 0) {
+			m_misses++;
+			return false;
+		}
+
+		shard &s = shard_for(key);
+		std::lock_guard lock(s.m_lock);
+
+		auto iter = s.m_entries.find(key);
+		if (iter == s.m_entries.end()) {
+			m_misses++;
+			return false;
+		}
+
+		s.m_lru.splice(s.m_lru.begin(), s.m_lru, iter->second);
+		value = iter->second->second;
+		m_hits++;
+
+		return true;
+	}
+
+	template<typename key_type, typename value_type>
+	void sharded_lru_cache<key_type, value_type>::put(const key_type &key, const value_type &value) {
+		const size_t size = m_size_of(value);
+		if (size > m_shard_capacity) return;
+
+		shard &s = shard_for(key);
+		std::lock_guard lock(s.m_lock);
+
+		auto iter = s.m_entries.find(key);
+		if (iter != s.m_entries.end()) {
+			s.m_size -= m_size_of(iter->second->second);
+			s.m_lru.erase(iter->second);
+			s.m_entries.erase(iter);
+		}
+
+		s.m_lru.emplace_front(key, value);
+		s.m_entries[key] = s.m_lru.begin();
+		s.m_size += size;
+
+		while (s.m_size > m_shard_capacity || (m_shard_max_entries && s.m_entries.size() > m_shard_max_entries)) {
+			s.m_size -= m_size_of(s.m_lru.back().second);
+			s.m_entries.erase(s.m_lru.back().first);
+			s.m_lru.pop_back();
+		}
+	}
+
+	template<typename key_type, typename value_type>
+	void sharded_lru_cache<key_type, value_type>::clear() {
+		for (auto &s : m_shards) {
+			std::lock_guard lock(s->m_lock);
+			s->m_lru.clear();
+			s->m_entries.clear();
+			s->m_size = 0;
+		}
+	}
+
+	template<typename key_type, typename value_type>
+	typename sharded_lru_cache<key_type, value_type>::stats sharded_lru_cache<key_type, value_type>::get_stats() {
+		stats ret{m_hits, m_misses, 0, 0, m_capacity};
+		for (auto &s : m_shards) {
+			std::lock_guard lock(s->m_lock);
+			ret.m_entries += s->m_entries.size();
+			ret.m_size += s->m_size;
+		}
+		return ret;
+	}
+
+	template<typename key_type, typename value_type>
+	typename sharded_lru_cache<key_type, value_type>::shard &sharded_lru_cache<key_type, value_type>::shard_for(
+			const key_type &key) {
+		return *m_shards[std::hash<key_type>{}(key) % m_shards.size()];
+	}
+
+}
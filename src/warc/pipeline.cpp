@@ -0,0 +1,290 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pipeline.h"
+#include "warc.h"
+#include "logger/logger.h"
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "zlib.h"
+
+namespace warc {
+
+	struct pipeline::file_state {
+		size_t m_index;
+		std::string m_path;
+		size_t m_size = 0;
+
+		/*
+		 * Downloaded ranges waiting for the inflater. m_failed is set under m_lock by a downloader that gives up so
+		 * the inflater waiting for the range wakes up.
+		 * */
+		std::mutex m_lock;
+		std::condition_variable m_range_ready;
+		std::map<size_t, std::string> m_ranges;
+		std::atomic<bool> m_failed = false;
+
+		/*
+		 * Records that are parsed or written right now plus one for the inflater, file_done is called when it
+		 * reaches zero.
+		 * */
+		std::atomic<size_t> m_pending = 1;
+	};
+
+	pipeline::pipeline(source &src, const options &opts)
+	: m_source(src), m_options(opts), m_download_queue(opts.m_queue_len), m_parse_queue(opts.m_queue_len),
+		m_write_queue(opts.m_queue_len) {
+	}
+
+	pipeline::~pipeline() {
+	}
+
+	void pipeline::run(const std::vector<std::string> &paths, const page_writer &writer, const file_done &done) {
+
+		m_file_done = done;
+		for (size_t i = 0; i < paths.size(); i++) {
+			m_files.emplace_back(std::make_unique<file_state>());
+			m_files.back()->m_index = i;
+			m_files.back()->m_path = paths[i];
+		}
+
+		std::vector<std::thread> downloaders, inflaters, parsers, writers;
+		for (size_t i = 0; i < m_options.m_download_threads; i++) downloaders.emplace_back([this] { download_ranges(); });
+		for (size_t i = 0; i < m_options.m_inflate_threads; i++) inflaters.emplace_back([this] { inflate_files(); });
+		for (size_t i = 0; i < m_options.m_parse_threads; i++) parsers.emplace_back([this] { parse_records(); });
+		for (size_t i = 0; i < m_options.m_write_threads; i++) {
+			writers.emplace_back([this, i, &writer] { write_pages(i, writer); });
+		}
+
+		std::mutex monitor_lock;
+		std::condition_variable monitor_cv;
+		bool finished = false;
+		std::thread monitor([this, &monitor_lock, &monitor_cv, &finished] {
+			std::unique_lock lock(monitor_lock);
+			while (!monitor_cv.wait_for(lock, std::chrono::seconds(m_options.m_stats_interval_s), [&finished] { return finished; })) {
+				log_stats();
+			}
+		});
+
+		// Shut down one stage at a time, every stage has drained its input when the threads of the stage before it
+		// have finished.
+		for (auto &thread : inflaters) thread.join();
+		m_download_queue.close();
+		for (auto &thread : downloaders) thread.join();
+		m_parse_queue.close();
+		for (auto &thread : parsers) thread.join();
+		m_write_queue.close();
+		for (auto &thread : writers) thread.join();
+
+		{
+			std::lock_guard lock(monitor_lock);
+			finished = true;
+		}
+		monitor_cv.notify_one();
+		monitor.join();
+
+		log_stats();
+	}
+
+	std::vector<pipeline::stage_stats> pipeline::get_stats() const {
+		const auto download = m_download_queue.get_stats();
+		const auto parse = m_parse_queue.get_stats();
+		const auto write = m_write_queue.get_stats();
+		return {
+			{"download", download.m_len, download.m_max_len_seen, m_downloaded},
+			{"inflate", m_ranges_waiting, m_max_ranges_waiting, m_inflated},
+			{"parse", parse.m_len, parse.m_max_len_seen, m_parsed},
+			{"write", write.m_len, write.m_max_len_seen, m_written}
+		};
+	}
+
+	void pipeline::download_ranges() {
+		range_job job = {};
+		while (m_download_queue.pop(job)) {
+			file_state &file = *job.m_file;
+			const size_t offset = job.m_range * m_options.m_range_size;
+			const size_t len = std::min(m_options.m_range_size, file.m_size - offset);
+
+			std::string data;
+			bool success = false;
+			for (size_t retry = 0; retry < m_options.m_max_retries && !success && !file.m_failed; retry++) {
+				success = m_source.read(file.m_path, offset, len, data);
+			}
+			m_downloaded++;
+
+			{
+				std::lock_guard lock(file.m_lock);
+				if (file.m_failed) {
+					success = false;
+				} else if (success) {
+					file.m_ranges.emplace(job.m_range, std::move(data));
+				} else {
+					LOG_INFO("could not download range " + std::to_string(job.m_range) + " of " + file.m_path);
+					file.m_failed = true;
+				}
+			}
+			if (success) {
+				const size_t waiting = ++m_ranges_waiting;
+				size_t max_waiting = m_max_ranges_waiting;
+				while (waiting > max_waiting && !m_max_ranges_waiting.compare_exchange_weak(max_waiting, waiting));
+			}
+			file.m_range_ready.notify_one();
+		}
+	}
+
+	void pipeline::inflate_files() {
+		while (true) {
+			const size_t index = m_next_file++;
+			if (index >= m_files.size()) break;
+			inflate_file(*m_files[index]);
+		}
+	}
+
+	void pipeline::inflate_file(file_state &file) {
+
+		file.m_size = m_source.size(file.m_path);
+		if (file.m_size == 0) {
+			LOG_INFO("could not get size of " + file.m_path);
+			file.m_failed = true;
+		}
+
+		const size_t num_ranges = (file.m_size + m_options.m_range_size - 1) / m_options.m_range_size;
+
+		z_stream stream = {};
+		if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+			LOG_ERROR("inflateInit2 failed");
+			file.m_failed = true;
+		}
+
+		// The record is inflated straight into the string that is handed to the parsers.
+		std::string record;
+		size_t next_job = 0;
+		for (size_t range = 0; range < num_ranges && !file.m_failed; range++) {
+
+			for (; next_job < num_ranges && next_job <= range + m_options.m_ranges_ahead; next_job++) {
+				m_download_queue.push(range_job{&file, next_job});
+			}
+
+			std::string data;
+			{
+				std::unique_lock lock(file.m_lock);
+				file.m_range_ready.wait(lock, [&file, range] { return file.m_ranges.count(range) || file.m_failed; });
+				if (file.m_failed) break;
+				auto iter = file.m_ranges.find(range);
+				data = std::move(iter->second);
+				file.m_ranges.erase(iter);
+			}
+			m_ranges_waiting--;
+
+			stream.next_in = (Bytef *)data.data();
+			stream.avail_in = data.size();
+			while (stream.avail_in > 0) {
+				const size_t used = record.size();
+				record.resize(used + std::max(used, (size_t)65536));
+				stream.next_out = (Bytef *)record.data() + used;
+				stream.avail_out = record.size() - used;
+
+				const int ret = inflate(&stream, Z_NO_FLUSH);
+				record.resize(record.size() - stream.avail_out);
+
+				if (ret == Z_STREAM_END) {
+					// Every gzip member is one warc record.
+					m_inflated++;
+					file.m_pending++;
+					m_parse_queue.push(record_job{&file, std::move(record)});
+					record = std::string();
+					inflateReset(&stream);
+				} else if (ret != Z_OK) {
+					LOG_ERROR("inflate failed with " + std::to_string(ret) + " in " + file.m_path);
+					file.m_failed = true;
+					break;
+				}
+			}
+		}
+
+		if (!file.m_failed && (stream.total_in > 0 || record.size())) {
+			LOG_ERROR("truncated gzip member at the end of " + file.m_path);
+			file.m_failed = true;
+		}
+
+		inflateEnd(&stream);
+
+		if (file.m_failed) {
+			m_failed_files++;
+			std::lock_guard lock(file.m_lock);
+			m_ranges_waiting -= file.m_ranges.size();
+			file.m_ranges.clear();
+		}
+
+		finish_record(file);
+	}
+
+	void pipeline::parse_records() {
+		::parser::html_parser html_parser;
+		record_job job = {};
+		while (m_parse_queue.pop(job)) {
+			m_parsed++;
+			page p;
+			if (parse_record(job.m_record, html_parser, p.m_url, p.m_ip, p.m_date)) {
+				p.m_file = job.m_file->m_index;
+				p.m_title = html_parser.title();
+				p.m_h1 = html_parser.h1();
+				p.m_meta = html_parser.meta();
+				p.m_text = html_parser.text();
+				p.m_links = html_parser.links();
+				p.m_internal_links = html_parser.internal_links();
+				m_write_queue.push(page_job{job.m_file, std::move(p)});
+			} else {
+				finish_record(*job.m_file);
+			}
+		}
+	}
+
+	void pipeline::write_pages(size_t writer_id, const page_writer &writer) {
+		page_job job = {};
+		while (m_write_queue.pop(job)) {
+			writer(writer_id, job.m_page);
+			m_written++;
+			finish_record(*job.m_file);
+		}
+	}
+
+	void pipeline::finish_record(file_state &file) {
+		if (--file.m_pending == 0) {
+			m_file_done(file.m_index);
+		}
+	}
+
+	void pipeline::log_stats() const {
+		for (const auto &stage : get_stats()) {
+			LOG_INFO("warc pipeline " + stage.m_name + " queue: " + std::to_string(stage.m_queue_len) + " max queue: " +
+				std::to_string(stage.m_max_queue_len) + " processed: " + std::to_string(stage.m_processed));
+		}
+	}
+
+}
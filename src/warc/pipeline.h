@@ -0,0 +1,165 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include "source.h"
+#include "parser/html_link.h"
+#include "utils/bounded_queue.h"
+
+namespace warc {
+
+	/*
+	 * A parsed page handed to the writers of the pipeline. m_file is the index of the warc file in the path list.
+	 * */
+	struct page {
+		size_t m_file;
+		std::string m_url;
+		std::string m_ip;
+		std::string m_date;
+		std::string m_title;
+		std::string m_h1;
+		std::string m_meta;
+		std::string m_text;
+		std::vector<::parser::html_link> m_links;
+		std::vector<std::pair<uint64_t, uint64_t>> m_internal_links;
+	};
+
+	/*
+	 * Processes warc files in stages connected by bounded queues so the network, zlib, the html parser and the
+	 * writers all work at the same time:
+	 *
+	 * download: m_download_threads threads fetch ranges of the files from the source.
+	 * inflate: m_inflate_threads files are inflated at the same time, one thread per file. The ranges of a file are
+	 *          inflated in order, every gzip member is a warc record that is passed on as soon as it is complete.
+	 * parse: m_parse_threads threads parse the records with their own html_parser.
+	 * write: m_write_threads threads call the page writer.
+	 *
+	 * A full queue blocks the stage before it so memory stays bounded by the queue lengths and the number of ranges
+	 * each file is allowed to download ahead of the inflater.
+	 * */
+	class pipeline {
+
+	public:
+
+		struct options {
+			size_t m_download_threads = 16;
+			size_t m_inflate_threads = 8;
+			size_t m_parse_threads = 16;
+			size_t m_write_threads = 4;
+			size_t m_range_size = 1024*1024*16;
+			size_t m_ranges_ahead = 4;
+			size_t m_queue_len = 1000;
+			size_t m_max_retries = 3;
+			size_t m_stats_interval_s = 60;
+		};
+
+		struct stage_stats {
+			std::string m_name;
+			size_t m_queue_len;
+			size_t m_max_queue_len;
+			size_t m_processed;
+		};
+
+		/*
+		 * page_writer is called with the id of the writer thread [0, m_write_threads) so writers can keep thread
+		 * local state. file_done is called once all pages of the file are written, failed files included.
+		 * */
+		typedef std::function<void(size_t writer_id, const page &)> page_writer;
+		typedef std::function<void(size_t file)> file_done;
+
+		pipeline(source &src, const options &opts);
+		~pipeline();
+
+		/*
+		 * Processes all the files and returns when the last page is written.
+		 * */
+		void run(const std::vector<std::string> &paths, const page_writer &writer, const file_done &done);
+
+		/*
+		 * Queue length, longest queue and number of processed items for each stage. The queue of the inflate stage
+		 * is the downloaded ranges waiting to be inflated.
+		 * */
+		std::vector<stage_stats> get_stats() const;
+
+		size_t num_failed_files() const { return m_failed_files; }
+
+	private:
+
+		struct file_state;
+
+		struct range_job {
+			file_state *m_file;
+			size_t m_range;
+		};
+
+		struct record_job {
+			file_state *m_file;
+			std::string m_record;
+		};
+
+		struct page_job {
+			file_state *m_file;
+			page m_page;
+		};
+
+		source &m_source;
+		const options m_options;
+
+		utils::bounded_queue<range_job> m_download_queue;
+		utils::bounded_queue<record_job> m_parse_queue;
+		utils::bounded_queue<page_job> m_write_queue;
+
+		std::vector<std::unique_ptr<file_state>> m_files;
+		std::atomic<size_t> m_next_file = 0;
+		std::atomic<size_t> m_failed_files = 0;
+
+		std::atomic<size_t> m_ranges_waiting = 0;
+		std::atomic<size_t> m_max_ranges_waiting = 0;
+		std::atomic<size_t> m_downloaded = 0;
+		std::atomic<size_t> m_inflated = 0;
+		std::atomic<size_t> m_parsed = 0;
+		std::atomic<size_t> m_written = 0;
+
+		file_done m_file_done;
+
+		void download_ranges();
+		void inflate_files();
+		void inflate_file(file_state &file);
+		void parse_records();
+		void write_pages(size_t writer_id, const page_writer &writer);
+
+		void finish_record(file_state &file);
+		void log_stats() const;
+
+	};
+
+}
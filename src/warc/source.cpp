@@ -0,0 +1,75 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "source.h"
+#include "transfer/transfer.h"
+#include <fstream>
+#include <filesystem>
+
+namespace warc {
+
+	http_source::http_source(const std::string &base_url)
+	: m_base_url(base_url) {
+	}
+
+	size_t http_source::size(const std::string &path) {
+		int error;
+		const size_t content_len = transfer::head_content_length(m_base_url + path, error);
+		return error == transfer::OK ? content_len : 0;
+	}
+
+	bool http_source::read(const std::string &path, size_t offset, size_t len, std::string &buffer) {
+		int error;
+		transfer::url_range_to_string(m_base_url + path, offset, len, buffer, error);
+		return error == transfer::OK;
+	}
+
+	directory_source::directory_source(const std::string &directory)
+	: m_directory(directory) {
+	}
+
+	size_t directory_source::size(const std::string &path) {
+		std::error_code error;
+		const size_t file_size = std::filesystem::file_size(m_directory + "/" + path, error);
+		return error ? 0 : file_size;
+	}
+
+	bool directory_source::read(const std::string &path, size_t offset, size_t len, std::string &buffer) {
+		std::ifstream file(m_directory + "/" + path, std::ios::binary);
+		if (!file.is_open()) return false;
+		file.seekg(offset);
+
+		const size_t original_size = buffer.size();
+		buffer.resize(original_size + len);
+		file.read(buffer.data() + original_size, len);
+		if ((size_t)file.gcount() != len) {
+			buffer.resize(original_size);
+			return false;
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,91 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace warc {
+
+	/*
+	 * Where the warc files are read from. Files are read in ranges so several parts of the same file can be
+	 * fetched at the same time. Implementations have to be safe to call from multiple threads.
+	 * */
+	class source {
+
+	public:
+
+		virtual ~source() = default;
+
+		/*
+		 * Size of the file in bytes, 0 if it can not be read.
+		 * */
+		virtual size_t size(const std::string &path) = 0;
+
+		/*
+		 * Appends len bytes starting at offset to buffer. Returns false on failure.
+		 * */
+		virtual bool read(const std::string &path, size_t offset, size_t len, std::string &buffer) = 0;
+
+	};
+
+	/*
+	 * Reads the files with http range requests, paths are relative to base_url.
+	 * */
+	class http_source : public source {
+
+	public:
+
+		explicit http_source(const std::string &base_url);
+
+		size_t size(const std::string &path) override;
+		bool read(const std::string &path, size_t offset, size_t len, std::string &buffer) override;
+
+	private:
+
+		const std::string m_base_url;
+
+	};
+
+	/*
+	 * Reads the files from a local directory, paths are relative to the directory.
+	 * */
+	class directory_source : public source {
+
+	public:
+
+		explicit directory_source(const std::string &directory);
+
+		size_t size(const std::string &path) override;
+		bool read(const std::string &path, size_t offset, size_t len, std::string &buffer) override;
+
+	private:
+
+		const std::string m_directory;
+
+	};
+
+}
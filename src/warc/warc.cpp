@@ -4,6 +4,7 @@
 #include "text/text.h"
 #include "logger/logger.h"
 #include "transfer/transfer.h"
+#include <charconv>
 
 using namespace std;
 
@@ -201,6 +202,17 @@ namespace warc {
 		return 0;
 	}
 
+	/*
+	 * Value of the header with the given key, the same as ::parser::get_http_header but without copying.
+	 * */
+	std::string_view header_value(std::string_view header, std::string_view key) {
+		const size_t pos = header.find(key);
+		if (pos == std::string_view::npos) return {};
+		const size_t pos_end = header.find('\n', pos);
+		if (pos_end == std::string_view::npos) return header.substr(pos + key.size());
+		return header.substr(pos + key.size(), pos_end - pos - key.size() - 1);
+	}
+
 	/*
 	 * Handles unzipped data. The data pointer is either pointing to a new warc record or it is the continuation of a previous warc record.
 	 * */
@@ -210,62 +222,65 @@ namespace warc {
 		m_num_handled++;
 
 		if (len > 8 && strncmp(data, "WARC/1.0", 8) == 0) {
-			// data is the start of a warc record
-			string record(data, len);
+			// data is the start of a warc record, assign keeps the capacity of the buffer.
 			m_current_record.assign(data, len);
+			m_scan_pos = 0;
+			m_header_end = string::npos;
 		} else {
 			m_current_record.append(data, len);
 		}
 
-		if (m_current_record.find("\r\n\r\n") != string::npos) {
-
-			const string warc_header = get_warc_header(m_current_record);
-			const string content_len_str = ::parser::get_http_header(warc_header, "Content-Length: ");
-
-			size_t content_len = stoull(content_len_str);
-			size_t received_content = m_current_record.size() - (warc_header.size() + 8);
+		if (m_header_end == string::npos) {
+			// Only search the new data, back up 3 bytes in case the separator is split between two chunks.
+			m_header_end = m_current_record.find("\r\n\r\n", m_scan_pos);
+			if (m_header_end == string::npos) {
+				m_scan_pos = m_current_record.size() >= 3 ? m_current_record.size() - 3 : 0;
+				return;
+			}
 
-			if (content_len == received_content) {
-				const string type = ::parser::get_http_header(warc_header, "WARC-Type: ");
+			const std::string_view warc_header(m_current_record.data(), m_header_end);
+			const std::string_view content_len_str = header_value(warc_header, "Content-Length: ");
+			if (std::from_chars(content_len_str.data(), content_len_str.data() + content_len_str.size(),
+					m_content_len).ec != std::errc()) {
+				m_content_len = SIZE_MAX;
+			}
+			m_is_response = header_value(warc_header, "WARC-Type: ") == "response";
+		}
 
-				if (type == "response") {
-					parse_record(warc_header, m_current_record);
-				}
+		// The record is complete when we have the header, the content and the \r\n\r\n after each of them.
+		if (m_content_len != SIZE_MAX && m_current_record.size() == m_header_end + 8 + m_content_len) {
+			string url, ip, date;
+			if (m_is_response && parse_record(m_current_record, m_html_parser, url, ip, date)) {
+				m_callback(url, m_html_parser, ip, date);
 			}
 		}
 
 	}
 
-	void parser::parse_record(const string &warc_header, const string &warc_record) {
+	bool parse_record(std::string_view warc_record, ::parser::html_parser &html_parser, string &url, string &ip,
+			string &date) {
 
-		const string url = ::parser::get_http_header(warc_header, "WARC-Target-URI: ");
-		const string tld = m_html_parser.url_tld(url);
+		const size_t warc_header_end = warc_record.find("\r\n\r\n");
+		if (warc_header_end == std::string_view::npos) return false;
 
-		if (tlds.count(tld) == 0) return;
+		const std::string_view warc_header = warc_record.substr(0, warc_header_end);
+		if (header_value(warc_header, "WARC-Type: ") != "response") return false;
 
-		const string ip = ::parser::get_http_header(warc_header, "WARC-IP-Address: ");
-		const string date = ::parser::get_http_header(warc_header, "WARC-Date: ");
+		url = header_value(warc_header, "WARC-Target-URI: ");
+		const string tld = html_parser.url_tld(url);
 
-		const size_t warc_response_start = warc_record.find("\r\n\r\n");
-		const size_t response_body_start = warc_record.find("\r\n\r\n", warc_response_start + 4);
+		if (tlds.count(tld) == 0) return false;
 
-		string http_header = warc_record.substr(warc_response_start + 4, response_body_start - warc_response_start - 4);
-		text::lower_case(http_header);
+		ip = header_value(warc_header, "WARC-IP-Address: ");
+		date = header_value(warc_header, "WARC-Date: ");
 
-		//const size_t http_code = http_response_code(http_header);
-		//const string location = ::parser::get_http_header(warc_header, "location: ");
+		const size_t response_body_start = warc_record.find("\r\n\r\n", warc_header_end + 4);
+		if (response_body_start == std::string_view::npos) return false;
 
-		string html = warc_record.substr(response_body_start + 4);
-		m_html_parser.parse(html, url);
-
-		if (m_html_parser.should_insert()) {
-			m_callback(url, m_html_parser, ip, date);
-		}
-	}
+		// The html is parsed straight from the record buffer.
+		html_parser.parse(warc_record.substr(response_body_start + 4), url);
 
-	string parser::get_warc_header(const string &record) {
-		const size_t pos = record.find("\r\n\r\n");
-		return record.substr(0, pos);
+		return html_parser.should_insert();
 	}
 
 	size_t parser::http_response_code(const string &http_header) {
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <iostream>
+#include <string_view>
 #include "parser/html_parser.h"
 #include "parser/parser.h"
 #include "zlib.h"
@@ -46,18 +47,33 @@ namespace warc {
 
 			size_t m_handled = 0;
 			size_t m_num_handled = 0;
+
+			/*
+			 * The record being received. The buffer is reused for every record so it only grows to the size of the
+			 * largest record. m_scan_pos is where the search for the end of the warc header continues when more data
+			 * arrives, m_header_end is set when it is found.
+			 * */
 			string m_current_record;
+			size_t m_scan_pos = 0;
+			size_t m_header_end = string::npos;
+			size_t m_content_len = 0;
+			bool m_is_response = false;
 
 			int unzip_record(char *data, int size);
 			int unzip_chunk(int bytes_in);
 
 			void handle_record_chunk(char *data, int len);
-			void parse_record(const std::string &warc_header, const std::string &warc_record);
-			std::string get_warc_header(const std::string &record);
 			size_t http_response_code(const string &http_header);
 
 	};
 
+	/*
+	 * Parses one complete and inflated warc record with html_parser. Returns true if the record is a response that
+	 * should be inserted, url, ip and date are then read from the warc header and html_parser holds the page.
+	 * */
+	bool parse_record(std::string_view warc_record, ::parser::html_parser &html_parser, string &url, string &ip,
+		string &date);
+
 	void multipart_download(const string &url, const std::function<void(const string &chunk)> &callback);
 
 	string get_result_path(const string &warc_path);
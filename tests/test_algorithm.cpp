@@ -108,6 +108,68 @@ BOOST_AUTO_TEST_CASE(intersection_test) {
 	}
 }
 
+BOOST_AUTO_TEST_CASE(intersection_positions) {
+
+	// Random sorted arrays of very different lengths so both the galloping and the block paths are used.
+	srand(42);
+	for (size_t test = 0; test < 50; test++) {
+		vector<vector<uint64_t>> arrays;
+		const size_t num_arrays = 2 + rand() % 3;
+		for (size_t i = 0; i < num_arrays; i++) {
+			const size_t len = (i == 0 && test % 2) ? rand() % 20 : rand() % 5000;
+			set<uint64_t> values;
+			while (values.size() < len) values.insert(rand() % 10000);
+			arrays.emplace_back(values.begin(), values.end());
+		}
+
+		vector<algorithm::sorted_values> input;
+		for (const auto &arr : arrays) {
+			input.push_back(algorithm::sorted_values{(const char *)arr.data(), arr.size(), sizeof(uint64_t)});
+		}
+
+		set<uint64_t> expected(arrays[0].begin(), arrays[0].end());
+		for (const auto &arr : arrays) {
+			set<uint64_t> next;
+			for (uint64_t v : arr) if (expected.count(v)) next.insert(v);
+			expected = next;
+		}
+
+		auto positions = algorithm::intersection_positions(input);
+
+		BOOST_REQUIRE_EQUAL(positions.size(), arrays.size());
+		for (size_t i = 0; i < arrays.size(); i++) {
+			BOOST_REQUIRE_EQUAL(positions[i].size(), expected.size());
+			size_t j = 0;
+			for (uint64_t v : expected) {
+				BOOST_CHECK_EQUAL(arrays[i][positions[i][j]], v);
+				j++;
+			}
+		}
+	}
+
+	{
+		// Values read from an array of records.
+		#pragma pack(4)
+		struct rec {
+			uint64_t m_value;
+			float m_score;
+		};
+		#pragma pack()
+
+		std::unique_ptr<rec[]> a(new rec[4]{{1, 1.0f}, {3, 1.0f}, {5, 1.0f}, {7, 1.0f}});
+		std::unique_ptr<rec[]> b(new rec[6]{{2, 2.0f}, {3, 2.0f}, {4, 2.0f}, {5, 2.0f}, {6, 2.0f}, {8, 2.0f}});
+		vector<std::unique_ptr<rec[]>> input;
+		input.push_back(std::move(a));
+		input.push_back(std::move(b));
+
+		auto result = algorithm::value_intersection(input, {4, 6});
+		BOOST_REQUIRE_EQUAL(result.size(), 2);
+		BOOST_CHECK_EQUAL(result[0].m_value, 3);
+		BOOST_CHECK_EQUAL(result[1].m_value, 5);
+		BOOST_CHECK_EQUAL(result[1].m_score, 1.0f);
+	}
+}
+
 BOOST_AUTO_TEST_CASE(incremental_partitions) {
 
 	{
@@ -29,6 +29,8 @@
 #include "warc/warc.h"
 #include "URL.h"
 #include "parser/cc_parser.h"
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
 
 using namespace std;
 
@@ -168,4 +170,60 @@ BOOST_AUTO_TEST_CASE(parse_cc_batch_301) {
 
 }
 
+/*
+ * Every record is its own gzip member, like in the common crawl files.
+ * */
+string gzip_warc_record(const string &type, const string &url, const string &content) {
+	const string record = "WARC/1.0\r\nWARC-Type: " + type + "\r\nWARC-Date: 2021-01-01T00:00:00Z\r\n"
+		"WARC-IP-Address: 1.2.3.4\r\nWARC-Target-URI: " + url + "\r\nContent-Length: " + to_string(content.size()) +
+		"\r\n\r\n" + content + "\r\n\r\n";
+
+	stringstream compressed;
+	{
+		boost::iostreams::filtering_ostream out;
+		out.push(boost::iostreams::gzip_compressor());
+		out.push(compressed);
+		out << record;
+	}
+	return compressed.str();
+}
+
+BOOST_AUTO_TEST_CASE(parse_synthetic_warc) {
+
+	auto response = [](const string &title, const string &body) {
+		return "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n<html><head><title>" + title +
+			"</title></head><body><h1>Heading</h1>" + body + "</body></html>";
+	};
+
+	// The large record is inflated in more than one chunk.
+	const string large_body = "<p>" + string(20 * 1024 * 1024, 'a') + "</p>";
+
+	stringstream warc;
+	warc << gzip_warc_record("warcinfo", "", "software: test\r\n");
+	warc << gzip_warc_record("request", "https://www.example.com/first", "GET /first HTTP/1.1\r\n\r\n");
+	warc << gzip_warc_record("response", "https://www.example.com/first", response("First page", "The first text"));
+	warc << gzip_warc_record("response", "https://www.example.unknowntld/page", response("Unknown tld", "text"));
+	warc << gzip_warc_record("response", "https://www.example.com/large", response("Large page", large_body));
+	warc << gzip_warc_record("response", "https://www.example.com/second", response("Second page", "More text"));
+
+	vector<string> urls;
+	vector<string> titles;
+	warc::parser pp;
+	pp.parse_stream(warc, [&urls, &titles](const string &url, const ::parser::html_parser &html, const string &ip,
+			const string &date) {
+		urls.push_back(url);
+		titles.push_back(html.title());
+		BOOST_CHECK_EQUAL(ip, "1.2.3.4");
+		BOOST_CHECK_EQUAL(date, "2021-01-01T00:00:00Z");
+	});
+
+	BOOST_REQUIRE_EQUAL(urls.size(), 3);
+	BOOST_CHECK_EQUAL(urls[0], "https://www.example.com/first");
+	BOOST_CHECK_EQUAL(titles[0], "First page");
+	BOOST_CHECK_EQUAL(urls[1], "https://www.example.com/large");
+	BOOST_CHECK_EQUAL(titles[1], "Large page");
+	BOOST_CHECK_EQUAL(urls[2], "https://www.example.com/second");
+	BOOST_CHECK_EQUAL(titles[2], "Second page");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
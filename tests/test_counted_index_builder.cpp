@@ -30,6 +30,8 @@
 #include "indexer/counted_record.h"
 #include "indexer/sharded_builder.h"
 #include "indexer/sharded.h"
+#include "indexer/reader_cache.h"
+#include "file/file.h"
 
 using namespace indexer;
 
@@ -143,4 +145,236 @@ BOOST_AUTO_TEST_CASE(test_case_4) {
 
 }
 
+BOOST_AUTO_TEST_CASE(test_mmap_reader) {
+
+	{
+		counted_index_builder<counted_record> idx("test_index", 0);
+
+		idx.truncate();
+
+		for (uint64_t key = 100; key < 200; key++) {
+			for (uint64_t value = 0; value < key % 7 + 1; value++) {
+				idx.add(key, counted_record(1000 + value));
+			}
+		}
+
+		idx.append();
+		idx.merge();
+	}
+
+	{
+		// Opening by name maps the file, compare with reading the same file through an ifstream.
+		counted_index<counted_record> mapped("test_index", 0);
+
+		std::ifstream reader(config::data_path() + "/0/full_text/test_index/0.data", std::ios::binary);
+		counted_index<counted_record> streamed(&reader, config::shard_hash_table_size);
+
+		for (uint64_t key = 99; key < 201; key++) {
+			std::vector<counted_record> res1 = mapped.find(key);
+			std::vector<counted_record> res2 = streamed.find(key);
+			BOOST_REQUIRE_EQUAL(res1.size(), res2.size());
+			for (size_t i = 0; i < res1.size(); i++) {
+				BOOST_CHECK_EQUAL(res1[i].m_value, res2[i].m_value);
+				BOOST_CHECK_EQUAL(res1[i].m_count, res2[i].m_count);
+			}
+		}
+
+		BOOST_CHECK_EQUAL(mapped.find(106).size(), 2);
+		BOOST_CHECK_EQUAL(mapped.find(106, 1).size(), 1);
+		BOOST_CHECK_EQUAL(mapped.find(99).size(), 0);
+	}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_reader_cache) {
+
+	{
+		sharded_builder<counted_index_builder, counted_record> idx("test_index", 10);
+
+		idx.truncate();
+
+		idx.add(101, indexer::counted_record(1000));
+
+		idx.append();
+		idx.merge();
+	}
+
+	sharded<counted_index, counted_record> idx("test_index", 10);
+
+	BOOST_REQUIRE_EQUAL(idx.find(101).size(), 1);
+
+	{
+		// Rewriting the shard must reopen the reader held by idx.
+		sharded_builder<counted_index_builder, counted_record> builder("test_index", 10);
+
+		builder.add(101, indexer::counted_record(1001));
+
+		builder.append();
+		builder.merge();
+	}
+
+	std::vector<counted_record> res = idx.find(101);
+	BOOST_REQUIRE_EQUAL(res.size(), 2);
+	BOOST_CHECK_EQUAL(res[0].m_value, 1000);
+	BOOST_CHECK_EQUAL(res[1].m_value, 1001);
+
+}
+
+BOOST_AUTO_TEST_CASE(test_reader_cache_file_version) {
+
+	const std::string file_a = "/tmp/alexandria_test_reader_cache_a";
+	const std::string file_b = "/tmp/alexandria_test_reader_cache_b";
+	auto write_file = [](const std::string &filename, const std::string &content) {
+		std::ofstream outfile(filename, std::ios::binary | std::ios::trunc);
+		outfile << content;
+	};
+	write_file(file_a, "a");
+	write_file(file_b, "b");
+
+	size_t num_opened = 0;
+	auto open = [&num_opened]() {
+		num_opened++;
+		return new std::string("reader");
+	};
+
+	reader_cache<std::string> cache(10);
+
+	auto a1 = cache.get(1, file_a, open);
+	BOOST_CHECK(cache.get(1, file_a, open) == a1);
+	auto b1 = cache.get(2, file_b, open);
+	BOOST_CHECK_EQUAL(num_opened, 2);
+
+	// Replaced by rename like the builders do, possibly from another process.
+	write_file(file_a + ".tmp", "a");
+	file::rename(file_a + ".tmp", file_a);
+
+	BOOST_CHECK(cache.get(1, file_a, open) != a1);
+	BOOST_CHECK(cache.get(2, file_b, open) == b1);
+	BOOST_CHECK_EQUAL(num_opened, 3);
+
+	// Written in place.
+	write_file(file_b, "bb");
+	BOOST_CHECK(cache.get(2, file_b, open) != b1);
+	BOOST_CHECK_EQUAL(num_opened, 4);
+
+	file::delete_file(file_a);
+	file::delete_file(file_b);
+}
+
+BOOST_AUTO_TEST_CASE(test_compressed_pages) {
+
+	{
+		// Uncompressed file written in the old format.
+		counted_index_builder<counted_record> idx("test_index", 0);
+
+		idx.truncate();
+
+		for (uint64_t key = 100; key < 150; key++) {
+			idx.add(key, counted_record(key * 1000000007ull, 0.5f));
+		}
+
+		idx.append();
+		idx.merge();
+	}
+
+	config::index_compress_pages = true;
+
+	{
+		// Merging reads the old pages and writes compressed ones.
+		counted_index_builder<counted_record> idx("test_index", 0);
+
+		for (uint64_t key = 100; key < 200; key++) {
+			for (uint64_t value = 0; value < (key % 3) * 200; value++) {
+				idx.add(key, counted_record(value * value + 7, (float)value / 3.0f));
+			}
+		}
+		idx.add(101, counted_record(7));
+
+		idx.append();
+		idx.merge();
+	}
+
+	config::index_compress_pages = false;
+
+	counted_index<counted_record> mapped("test_index", 0);
+
+	std::ifstream reader(config::data_path() + "/0/full_text/test_index/0.data", std::ios::binary);
+	counted_index<counted_record> streamed(&reader, config::shard_hash_table_size);
+
+	for (uint64_t key = 100; key < 200; key++) {
+		const size_t num_values = (key % 3) * 200 + (key < 150 ? 1 : 0);
+		std::vector<counted_record> res1 = mapped.find(key);
+		std::vector<counted_record> res2 = streamed.find(key);
+		BOOST_REQUIRE_EQUAL(res1.size(), num_values);
+		BOOST_REQUIRE_EQUAL(res2.size(), num_values);
+		for (size_t i = 0; i < res1.size(); i++) {
+			BOOST_CHECK_EQUAL(res1[i].m_value, res2[i].m_value);
+			BOOST_CHECK_EQUAL(res1[i].m_score, res2[i].m_score);
+			if (i) BOOST_CHECK(res1[i - 1].m_value < res1[i].m_value);
+		}
+	}
+
+	std::vector<counted_record> res = mapped.find(101);
+	BOOST_REQUIRE_EQUAL(res.size(), 401);
+	BOOST_CHECK_EQUAL(res[0].m_value, 7);
+	BOOST_CHECK_EQUAL(res[0].m_count, 2);
+	BOOST_CHECK_EQUAL(res[1].m_value, 8);
+	BOOST_CHECK_CLOSE(res[9].m_score, 3.0f, 0.5);
+
+	res = mapped.find(101, 130);
+	BOOST_REQUIRE_EQUAL(res.size(), 130);
+	BOOST_CHECK_EQUAL(res[129].m_value, 129 * 129 + 7);
+	BOOST_CHECK_EQUAL(streamed.find(101, 130)[129].m_value, 129 * 129 + 7);
+
+	size_t num_keys = 0;
+	mapped.for_each([&num_keys](uint64_t key, std::vector<counted_record> &recs) {
+		num_keys++;
+		BOOST_CHECK_EQUAL(recs.size(), (key % 3) * 200 + (key < 150 ? 1 : 0));
+	});
+	BOOST_CHECK_EQUAL(num_keys, 83);
+
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_external_runs) {
+
+	// Small enough to spill several sorted runs.
+	const size_t budget = config::index_merge_memory_mb;
+	config::index_merge_memory_mb = 1;
+
+	std::map<uint64_t, std::map<uint64_t, uint64_t>> expected;
+
+	{
+		counted_index_builder<counted_record> idx("test_index", 0);
+		idx.truncate();
+	}
+
+	for (size_t round = 0; round < 2; round++) {
+		counted_index_builder<counted_record> idx("test_index", 0);
+
+		for (uint64_t i = 0; i < 20000; i++) {
+			const uint64_t key = (i * 7919 + round) % 3001;
+			const uint64_t value = (i * 104729) % 50;
+			idx.add(key, counted_record(value));
+			expected[key][value]++;
+		}
+
+		idx.append();
+		idx.merge();
+	}
+
+	config::index_merge_memory_mb = budget;
+
+	counted_index<counted_record> idx("test_index", 0);
+	for (const auto &iter : expected) {
+		std::vector<counted_record> res = idx.find(iter.first);
+		BOOST_REQUIRE_EQUAL(res.size(), iter.second.size());
+		size_t i = 0;
+		for (const auto &value_count : iter.second) {
+			BOOST_CHECK_EQUAL(res[i].m_value, value_count.first);
+			BOOST_CHECK_EQUAL(res[i].m_count, value_count.second);
+			i++;
+		}
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
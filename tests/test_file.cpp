@@ -31,6 +31,7 @@
 #include "file/tsv_file_remote.h"
 #include "file/tsv_file.h"
 #include "file/archive.h"
+#include "file/atomic_file_writer.h"
 #include "algorithm/hash.h"
 #include "config.h"
 
@@ -377,4 +378,59 @@ BOOST_AUTO_TEST_CASE(test_rename_file) {
 	BOOST_CHECK(!file::file_exists("/tmp/alexandria_test_98237593257"));
 }
 
+BOOST_AUTO_TEST_CASE(test_atomic_file_writer) {
+	auto read_file = [](const std::string &filename) {
+		std::ifstream infile(filename, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+	};
+
+	const std::string filename = "/tmp/alexandria_test_atomic_writer";
+	{
+		std::ofstream old_file(filename, std::ios::trunc);
+		old_file << "old content";
+	}
+	const file::file_version old_version = file::version(filename);
+	BOOST_CHECK(old_version.exists);
+
+	{
+		// Small buffer so both buffered and direct writes are used.
+		file::atomic_file_writer writer(filename, 16);
+		uint64_t header = 0;
+		writer.write((char *)&header, sizeof(header));
+		for (size_t i = 0; i < 100; i++) {
+			const std::string line = "line " + std::to_string(i) + "\n";
+			writer.write(line.c_str(), line.size());
+		}
+		writer.write(std::string(40, 'x').c_str(), 40);
+		BOOST_CHECK_EQUAL(read_file(filename), "old content");
+
+		header = writer.size();
+		writer.pwrite(0, (char *)&header, sizeof(header));
+		writer.commit();
+	}
+
+	BOOST_CHECK(!file::file_exists(filename + ".tmp"));
+	const file::file_version new_version = file::version(filename);
+	BOOST_CHECK(new_version.inode != old_version.inode);
+	BOOST_CHECK(!(new_version == old_version));
+	const std::string content = read_file(filename);
+	uint64_t header;
+	memcpy(&header, content.data(), sizeof(header));
+	BOOST_CHECK_EQUAL(header, content.size());
+	BOOST_CHECK_EQUAL(content.substr(8, 7), "line 0\n");
+	BOOST_CHECK_EQUAL(content.substr(content.size() - 40), std::string(40, 'x'));
+
+	{
+		// Not committed, the old file is kept and the temporary file is removed.
+		file::atomic_file_writer writer(filename);
+		writer.write("new", 3);
+	}
+	BOOST_CHECK(!file::file_exists(filename + ".tmp"));
+	BOOST_CHECK_EQUAL(read_file(filename), content);
+	BOOST_CHECK(file::version(filename) == new_version);
+
+	file::delete_file(filename);
+	BOOST_CHECK(!file::version(filename).exists);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -30,6 +30,7 @@
 #include "hash_table2/builder.h"
 #include "hash_table_helper/hash_table_helper.h"
 #include "indexer/merger.h"
+#include "file/file.h"
 
 #include <set>
 
@@ -137,6 +138,87 @@ BOOST_AUTO_TEST_CASE(single_shard_add_versioned2) {
 
 }
 
+BOOST_AUTO_TEST_CASE(single_shard_mapped) {
+
+	{
+		// Small hash table so the pages have many keys to search.
+		hash_table2::hash_table_shard_builder idx("test_index", 0, 10);
+
+		idx.truncate();
+
+		for (size_t key = 1; key < 1000; key++) {
+			idx.add(key * 7, std::string(key * 10, 'a' + key % 26), key);
+		}
+		idx.append();
+		idx.merge();
+	}
+
+	{
+		hash_table2::hash_table_shard idx("test_index", 0, 10);
+
+		for (size_t key = 1; key < 1000; key++) {
+			size_t ver = 0;
+			BOOST_REQUIRE_EQUAL(idx.find(key * 7, ver), std::string(key * 10, 'a' + key % 26));
+			BOOST_CHECK_EQUAL(ver, key);
+			BOOST_CHECK_EQUAL(idx.find(key * 7 + 1), "");
+		}
+		BOOST_CHECK_EQUAL(idx.find(0), "");
+		BOOST_CHECK_EQUAL(idx.find(7000), "");
+	}
+
+}
+
+BOOST_AUTO_TEST_CASE(rewrite_while_open) {
+
+	hash_table_helper::truncate("test_index");
+
+	{
+		hash_table2::builder idx("test_index", 43);
+		for (size_t i = 0; i < 100; i++) {
+			idx.add(i, "first " + std::to_string(i));
+		}
+		idx.merge();
+	}
+
+	// Stays open while the shards are rewritten, like the hash tables of the servers.
+	hash_table2::hash_table hash_table("test_index", 43);
+
+	BOOST_CHECK_EQUAL(hash_table.find(10), "first 10");
+
+	{
+		// Higher version on the same keys.
+		hash_table2::builder idx("test_index", 43);
+		for (size_t i = 0; i < 100; i++) {
+			idx.add(i, "second " + std::to_string(i), 1);
+		}
+		idx.merge();
+	}
+
+	for (size_t i = 0; i < 100; i++) {
+		BOOST_CHECK_EQUAL(hash_table.find(i), "second " + std::to_string(i));
+	}
+
+	{
+		hash_table2::builder idx("test_index", 43);
+		idx.truncate();
+	}
+
+	BOOST_CHECK_EQUAL(hash_table.find(10), "");
+
+	{
+		hash_table2::builder idx("test_index", 43);
+		for (size_t i = 50; i < 150; i++) {
+			idx.add(i, "third " + std::to_string(i));
+		}
+		idx.merge();
+	}
+
+	BOOST_CHECK_EQUAL(hash_table.find(10), "");
+	for (size_t i = 50; i < 150; i++) {
+		BOOST_CHECK_EQUAL(hash_table.find(i), "third " + std::to_string(i));
+	}
+}
+
 BOOST_AUTO_TEST_CASE(add_to_hash_table) {
 
 	hash_table_helper::truncate("test_index");
@@ -185,6 +267,49 @@ BOOST_AUTO_TEST_CASE(add_to_hash_table) {
 
 }
 
+BOOST_AUTO_TEST_CASE(find_many) {
+
+	hash_table_helper::truncate("test_index");
+
+	{
+		hash_table2::builder idx("test_index", 43);
+
+		idx.truncate();
+
+		for (size_t i = 0; i < 1000; i++) {
+			idx.add(i, "Random test data with id: " + std::to_string(i));
+		}
+
+		idx.merge();
+	}
+
+	{
+		hash_table2::hash_table hash_table("test_index", 43);
+
+		// Keys in descending order, some missing and some repeated.
+		std::vector<uint64_t> keys;
+		for (size_t i = 1100; i >= 3; i -= 3) {
+			keys.push_back(i);
+		}
+		keys.push_back(5);
+		keys.push_back(5);
+
+		for (size_t num_threads : {1, 8}) {
+			const std::vector<std::string> values = hash_table.find_many(keys, num_threads);
+			BOOST_REQUIRE_EQUAL(values.size(), keys.size());
+			for (size_t i = 0; i < keys.size(); i++) {
+				BOOST_CHECK_EQUAL(values[i], hash_table.find(keys[i]));
+				if (keys[i] < 1000) {
+					BOOST_CHECK_EQUAL(values[i], "Random test data with id: " + std::to_string(keys[i]));
+				}
+			}
+		}
+
+		BOOST_CHECK(hash_table.find_many({}).empty());
+	}
+
+}
+
 BOOST_AUTO_TEST_CASE(add_to_hash_table_reverse) {
 
 	hash_table_helper::truncate("test_index");
@@ -566,6 +691,155 @@ BOOST_AUTO_TEST_CASE(merge_with) {
 
 }
 
+BOOST_AUTO_TEST_CASE(dictionary_compression) {
+
+	auto url_line = [](const std::string &prefix, size_t i) {
+		return prefix + std::to_string(i) + ".example.com/some/path/page.html\tExample title number " +
+			std::to_string(i) + "\tThe quick brown fox jumps over the lazy dog, snippet text for page " +
+			std::to_string(i);
+	};
+	auto file_size = [](const std::string &filename) {
+		std::ifstream infile(filename, std::ios::binary | std::ios::ate);
+		return (size_t)infile.tellg();
+	};
+
+	size_t gzip_size;
+	{
+		hash_table2::hash_table_shard_builder idx("test_index", 0, 100);
+		idx.truncate();
+		for (size_t i = 0; i < 1000; i++) idx.add(i, url_line("https://www.", i));
+		idx.append();
+		idx.merge();
+		gzip_size = file_size(idx.filename_data());
+		BOOST_CHECK(!file::file_exists(idx.filename_dictionary()));
+	}
+
+	config::ht_dictionary_compression = true;
+
+	{
+		hash_table2::hash_table_shard_builder idx("test_index", 0, 100);
+		idx.truncate();
+		for (size_t i = 0; i < 1000; i++) idx.add(i, url_line("https://www.", i));
+		idx.append();
+		idx.merge();
+		BOOST_CHECK(file::file_exists(idx.filename_dictionary()));
+		BOOST_CHECK(file_size(idx.filename_data()) < gzip_size);
+	}
+
+	{
+		// A second shard gets a different dictionary.
+		hash_table2::hash_table_shard_builder idx("test_index2", 0, 100);
+		idx.truncate();
+		for (size_t i = 1000; i < 1100; i++) idx.add(i, url_line("http://", i));
+		idx.append();
+		idx.merge();
+	}
+
+	config::ht_dictionary_compression = false;
+
+	{
+		// Values written without the dictionary are mixed with the others.
+		hash_table2::hash_table_shard_builder idx("test_index", 0, 100);
+		idx.add(5000, "plain gzip value");
+		idx.append();
+		idx.merge();
+
+		hash_table2::hash_table_shard_builder idx2("test_index2", 0, 100);
+		idx.merge_with(idx2);
+	}
+
+	{
+		hash_table2::hash_table_shard idx("test_index", 0, 100);
+		for (size_t i = 0; i < 1000; i++) {
+			BOOST_REQUIRE_EQUAL(idx.find(i), url_line("https://www.", i));
+		}
+		for (size_t i = 1000; i < 1100; i++) {
+			BOOST_REQUIRE_EQUAL(idx.find(i), url_line("http://", i));
+		}
+		BOOST_CHECK_EQUAL(idx.find(5000), "plain gzip value");
+
+		size_t num_values = 0;
+		idx.for_each([&num_values](uint64_t key, const std::string &value) {
+			if (key < 1000) BOOST_CHECK(value.starts_with("https://www."));
+			num_values++;
+		});
+		// for_each skips key 0.
+		BOOST_CHECK_EQUAL(num_values, 1100);
+	}
+
+	{
+		hash_table2::hash_table_shard_builder idx("test_index2", 0, 100);
+		idx.truncate();
+		BOOST_CHECK(!file::file_exists(idx.filename_dictionary()));
+	}
+
+}
+
+BOOST_AUTO_TEST_CASE(dictionary_reload) {
+
+	auto url_line = [](const std::string &prefix, size_t i) {
+		return prefix + std::to_string(i) + ".example.com/some/path/page.html\tExample title number " +
+			std::to_string(i) + "\tThe quick brown fox jumps over the lazy dog, snippet text for page " +
+			std::to_string(i);
+	};
+
+	config::ht_dictionary_compression = true;
+
+	{
+		hash_table2::hash_table_shard_builder idx("test_index", 0, 100);
+		idx.truncate();
+		for (size_t i = 0; i < 1000; i++) idx.add(i, url_line("https://www.", i));
+		idx.append();
+		idx.merge();
+	}
+
+	// Stays open while the shard is truncated and a new dictionary is trained.
+	hash_table2::hash_table_shard reader("test_index", 0, 100);
+	BOOST_CHECK_EQUAL(reader.find(10), url_line("https://www.", 10));
+
+	{
+		hash_table2::hash_table_shard_builder idx("test_index", 0, 100);
+		idx.truncate();
+		for (size_t i = 0; i < 1000; i++) idx.add(i, url_line("ftp://", i * 3));
+		idx.append();
+		idx.merge();
+	}
+
+	for (size_t i = 0; i < 1000; i++) {
+		BOOST_REQUIRE_EQUAL(reader.find(i), url_line("ftp://", i * 3));
+	}
+
+	config::ht_dictionary_compression = false;
+
+	{
+		// A shard without dictionary compression does not take over the dictionary of the other shard.
+		hash_table2::hash_table_shard_builder idx("test_index2", 0, 100);
+		idx.truncate();
+		idx.add(5000, "plain gzip value");
+		idx.append();
+		idx.merge();
+
+		hash_table2::hash_table_shard_builder other("test_index", 0, 100);
+		idx.merge_with(other);
+		BOOST_CHECK(!file::file_exists(idx.filename_dictionary()));
+
+		idx.add(5001, "added after merge");
+		idx.append();
+		idx.merge();
+		BOOST_CHECK(!file::file_exists(idx.filename_dictionary()));
+	}
+
+	{
+		hash_table2::hash_table_shard idx("test_index2", 0, 100);
+		for (size_t i = 0; i < 1000; i++) {
+			BOOST_REQUIRE_EQUAL(idx.find(i), url_line("ftp://", i * 3));
+		}
+		BOOST_CHECK_EQUAL(idx.find(5000), "plain gzip value");
+		BOOST_CHECK_EQUAL(idx.find(5001), "added after merge");
+	}
+
+}
+
 BOOST_AUTO_TEST_CASE(merge_with_files) {
 
 	{
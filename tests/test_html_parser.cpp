@@ -297,6 +297,28 @@ BOOST_AUTO_TEST_CASE(html_parser_long_text) {
 	BOOST_CHECK(has_word);
 }
 
+BOOST_AUTO_TEST_CASE(html_parser_invisible) {
+	parser::html_parser parser;
+
+	// The style inside the script is text and does not hide anything after the script.
+	parser.parse("<title>test1</title><h1>test2</h1><script>document.write('<style>');</script><p>one</p>"
+		"<style>p {}</style><script>var a = 1;</script><p>two <b>three</b></p><script>", "http://example.com/");
+	BOOST_CHECK_EQUAL(parser.title(), "test1");
+	BOOST_CHECK_EQUAL(parser.h1(), "test2");
+	BOOST_CHECK_EQUAL(parser.text(), "one two three");
+
+	// A title inside a script is not used.
+	parser.parse("<script><title>hidden</title></script><title>visible</title><h1>h</h1>");
+	BOOST_CHECK_EQUAL(parser.title(), "");
+
+	parser.parse("<title>test1</title><script>var a = '</h1>';</script><body><p>body text</p>");
+	BOOST_CHECK_EQUAL(parser.text(), "body text");
+
+	parser.parse("<meta content=\"first\"><title>test1</title><meta name=\"description\" content=\"the description\">"
+		"<meta name=\"description\" content=\"second\">");
+	BOOST_CHECK_EQUAL(parser.meta(), "the description");
+}
+
 /*
 	test these links: <a href="http://skatteverket.se/">Skatteverket</A>
 	here: http://nomell.se/2009/03/24/prisa-gud-har-kommer-skatteaterbaringen/
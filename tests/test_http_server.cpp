@@ -0,0 +1,279 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include "http/request_parser.h"
+#include "http/epoll_server.h"
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+BOOST_AUTO_TEST_SUITE(test_http_server)
+
+BOOST_AUTO_TEST_CASE(parse_get) {
+	http::request_parser parser(1024);
+
+	const std::string req = "GET /?q=test HTTP/1.1\r\nHost: localhost\r\nX-Test:  value \r\n\r\n";
+	BOOST_CHECK_EQUAL(parser.parse(req.data(), req.size()), req.size());
+	BOOST_REQUIRE(parser.done());
+	BOOST_CHECK_EQUAL(parser.method(), "GET");
+	BOOST_CHECK_EQUAL(parser.uri(), "/?q=test");
+	BOOST_CHECK_EQUAL(parser.header("host"), "localhost");
+	BOOST_CHECK_EQUAL(parser.header("x-test"), "value");
+	BOOST_CHECK_EQUAL(parser.header("missing"), "");
+	BOOST_CHECK(parser.keep_alive());
+}
+
+BOOST_AUTO_TEST_CASE(parse_incrementally) {
+	http::request_parser parser(1024);
+
+	// Fed one byte at a time, followed by a pipelined request.
+	const std::string req = "POST /upload HTTP/1.0\r\nContent-Length: 11\r\nConnection: keep-alive\r\n\r\nhello world";
+	const std::string data = req + "GET / HTTP/1.1\r\n\r\n";
+	size_t pos = 0;
+	while (!parser.done() && pos < data.size()) {
+		pos += parser.parse(data.data() + pos, 1);
+	}
+	BOOST_REQUIRE(parser.done());
+	BOOST_CHECK_EQUAL(pos, req.size());
+	BOOST_CHECK_EQUAL(parser.method(), "POST");
+	BOOST_CHECK_EQUAL(parser.body(), "hello world");
+	BOOST_CHECK(parser.keep_alive());
+
+	parser.reset();
+	BOOST_CHECK_EQUAL(parser.parse(data.data() + pos, data.size() - pos), data.size() - pos);
+	BOOST_REQUIRE(parser.done());
+	BOOST_CHECK_EQUAL(parser.method(), "GET");
+	BOOST_CHECK_EQUAL(parser.body(), "");
+}
+
+BOOST_AUTO_TEST_CASE(parse_errors) {
+	{
+		http::request_parser parser(10);
+		const std::string req = "POST / HTTP/1.1\r\nContent-Length: 11\r\nExpect: 100-continue\r\n\r\n";
+		parser.parse(req.data(), req.size());
+		BOOST_CHECK(parser.error());
+		BOOST_CHECK_EQUAL(parser.error_code(), 413);
+	}
+	{
+		http::request_parser parser(10);
+		const std::string req = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+		parser.parse(req.data(), req.size());
+		BOOST_CHECK_EQUAL(parser.error_code(), 501);
+	}
+	{
+		http::request_parser parser(10);
+		const std::string req = "garbage\r\n\r\n";
+		parser.parse(req.data(), req.size());
+		BOOST_CHECK_EQUAL(parser.error_code(), 400);
+	}
+	{
+		http::request_parser parser(10);
+		const std::string req = "GET / HTTP/1.1\r\nX: " + std::string(http::request_parser::max_header_len, 'a');
+		parser.parse(req.data(), req.size());
+		BOOST_CHECK_EQUAL(parser.error_code(), 431);
+	}
+	{
+		http::request_parser parser(100);
+		const std::string req = "POST / HTTP/1.1\r\nContent-Length: 5\r\nExpect: 100-continue\r\n\r\n";
+		parser.parse(req.data(), req.size());
+		BOOST_CHECK(parser.headers_done());
+		BOOST_CHECK(!parser.done());
+		BOOST_CHECK(parser.expects_continue());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(epoll_server_keep_alive) {
+
+	const size_t port = 18931;
+	http::epoll_server srv([](const http::request &req) {
+		http::response res;
+		if (req.url().path() == "/stream") {
+			res.body_writer([](const http::response::write_function &write) {
+				write("first");
+				write("second part");
+			});
+			return res;
+		}
+		res.body(req.request_method() + " " + req.url().path() + " " + req.request_body());
+		return res;
+	}, "127.0.0.1", port, 2, 100);
+
+	std::thread server_thread([&srv]() { srv.run(); });
+
+	auto connect_client = [port]() {
+		const int fd = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+		for (size_t i = 0; i < 100; i++) {
+			if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return -1;
+	};
+
+	auto read_until = [](int fd, const std::string &end) {
+		std::string data;
+		char buffer[1024];
+		while (data.find(end) == std::string::npos) {
+			const ssize_t len = recv(fd, buffer, sizeof(buffer), 0);
+			if (len <= 0) break;
+			data.append(buffer, len);
+		}
+		return data;
+	};
+
+	{
+		const int fd = connect_client();
+		BOOST_REQUIRE(fd >= 0);
+
+		// Two pipelined requests on one connection, then a third after the answers.
+		const std::string reqs = "GET /first HTTP/1.1\r\n\r\nPOST /second HTTP/1.1\r\nContent-Length: 4\r\n\r\nbody";
+		send(fd, reqs.data(), reqs.size(), 0);
+		const std::string res = read_until(fd, "POST /second body");
+		BOOST_CHECK(res.find("HTTP/1.1 200 OK\r\n") == 0);
+		BOOST_CHECK(res.find("Content-Length: 11\r\nConnection: keep-alive\r\n\r\nGET /first ") != std::string::npos);
+
+		const std::string req3 = "GET /third HTTP/1.1\r\nConnection: close\r\n\r\n";
+		send(fd, req3.data(), req3.size(), 0);
+		const std::string res3 = read_until(fd, "GET /third ");
+		BOOST_CHECK(res3.find("Connection: close\r\n") != std::string::npos);
+
+		// The server closes the connection.
+		char c;
+		BOOST_CHECK_EQUAL(recv(fd, &c, 1, 0), 0);
+		close(fd);
+	}
+
+	{
+		// Streamed responses are sent with chunked encoding.
+		const int fd = connect_client();
+		const std::string req = "GET /stream HTTP/1.1\r\n\r\n";
+		send(fd, req.data(), req.size(), 0);
+		const std::string res = read_until(fd, "0\r\n\r\n");
+		BOOST_CHECK(res.find("HTTP/1.1 200 OK\r\n") == 0);
+		BOOST_CHECK(res.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+		BOOST_CHECK(res.find("\r\n\r\n5\r\nfirst\r\nb\r\nsecond part\r\n0\r\n\r\n") != std::string::npos);
+		close(fd);
+	}
+
+	{
+		const int fd = connect_client();
+		const std::string req = "POST / HTTP/1.1\r\nContent-Length: 1000\r\n\r\n";
+		send(fd, req.data(), req.size(), 0);
+		const std::string res = read_until(fd, "\r\n\r\n413");
+		BOOST_CHECK(res.find("HTTP/1.1 413 Payload Too Large\r\n") == 0);
+		close(fd);
+	}
+
+	srv.stop();
+	server_thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(epoll_server_slow_client) {
+
+	const size_t port = 18932;
+	const size_t num_chunks = 64;
+	std::atomic<size_t> chunks_written = 0;
+	std::atomic<bool> writer_returned = false;
+
+	// One worker so both clients are served by the same loop.
+	http::epoll_server srv([&](const http::request &req) {
+		http::response res;
+		if (req.url().path() == "/big") {
+			res.body_writer([&](const http::response::write_function &write) {
+				const std::string chunk(1024 * 1024, 'x');
+				for (size_t i = 0; i < num_chunks; i++) {
+					if (!write(chunk)) break;
+					chunks_written++;
+				}
+				writer_returned = true;
+			});
+			return res;
+		}
+		res.body("small");
+		return res;
+	}, "127.0.0.1", port, 1, 100);
+
+	std::thread server_thread([&srv]() { srv.run(); });
+
+	auto connect_client = [port]() {
+		const int fd = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+		for (size_t i = 0; i < 100; i++) {
+			if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return -1;
+	};
+
+	// Asks for a large streamed response and never reads it.
+	const int slow_fd = connect_client();
+	BOOST_REQUIRE(slow_fd >= 0);
+	const std::string big_req = "GET /big HTTP/1.1\r\n\r\n";
+	send(slow_fd, big_req.data(), big_req.size(), 0);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	// The writer waits for the client instead of buffering the whole response.
+	BOOST_CHECK(chunks_written < num_chunks);
+	BOOST_CHECK(!writer_returned);
+
+	const auto start = std::chrono::steady_clock::now();
+	const int fd = connect_client();
+	BOOST_REQUIRE(fd >= 0);
+	const std::string req = "GET / HTTP/1.1\r\nConnection: close\r\n\r\n";
+	send(fd, req.data(), req.size(), 0);
+	std::string res;
+	char buffer[1024];
+	ssize_t len;
+	while ((len = recv(fd, buffer, sizeof(buffer), 0)) > 0) res.append(buffer, len);
+	close(fd);
+	BOOST_CHECK(res.find("\r\n\r\nsmall") != std::string::npos);
+	BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+
+	// Closing the slow client stops the writer.
+	close(slow_fd);
+	for (size_t i = 0; i < 200 && !writer_returned; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	BOOST_CHECK(writer_returned);
+	BOOST_CHECK(chunks_written < num_chunks);
+
+	srv.stop();
+	server_thread.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -26,10 +26,17 @@
 
 #include <boost/test/unit_test.hpp>
 #include "file/file.h"
+#include "config.h"
+#include <map>
+#include <set>
 #include "indexer/index_builder.h"
 #include "indexer/index.h"
+#include "indexer/external_sorter.h"
+#include "indexer/index_generation.h"
 #include "indexer/generic_record.h"
 #include "indexer/value_record.h"
+#include "indexer/domain_record.h"
+#include "utils/sharded_lru_cache.h"
 
 BOOST_AUTO_TEST_SUITE(test_index_builder)
 
@@ -169,4 +176,215 @@ BOOST_AUTO_TEST_CASE(test_merge_with2) {
 	}
 }
 
+BOOST_AUTO_TEST_CASE(test_find_top_block_max) {
+
+	file::delete_directory("./0/full_text/test_index");
+	file::create_directory("./0/full_text/test_index");
+
+	{
+		indexer::index_builder<indexer::domain_record> idx("test_index", 0, 1000);
+
+		for (uint64_t value = 0; value < 5000; value++) {
+			const float score = (float)((value * 7919) % 1000) / 10.0f;
+			idx.add(1, indexer::domain_record(value, score));
+			if (value % 3 == 0) {
+				idx.add(2, indexer::domain_record(value, score));
+			}
+		}
+
+		idx.append();
+		idx.merge();
+	}
+
+	{
+		indexer::index<indexer::domain_record> idx("test_index", 0, 1000);
+
+		auto score_mod = [](const indexer::domain_record &rec) { return (float)(rec.m_value % 5); };
+		auto score_mod_bound = [](float) { return 4.0f; };
+
+		size_t total1 = 0;
+		size_t total2 = 0;
+		auto res1 = idx.find_top(total1, {1, 2}, 20, score_mod);
+		auto res2 = idx.find_top(total2, {1, 2}, 20, score_mod, score_mod_bound);
+
+		BOOST_CHECK_EQUAL(total1, 1667);
+		BOOST_CHECK_EQUAL(total2, 1667);
+		BOOST_REQUIRE_EQUAL(res1.size(), 20);
+		BOOST_REQUIRE_EQUAL(res2.size(), 20);
+
+		// Records with equal scores can come in any order so only compare the scores.
+		for (size_t i = 0; i < res1.size(); i++) {
+			BOOST_CHECK_EQUAL(res1[i].m_score, res2[i].m_score);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_find_top_nested) {
+
+	file::delete_directory("./0/full_text/test_index");
+	file::create_directory("./0/full_text/test_index");
+	file::delete_directory("./1/full_text/test_index");
+	file::create_directory("./1/full_text/test_index");
+
+	{
+		indexer::index_builder<indexer::domain_record> small("test_index", 0, 1000);
+		indexer::index_builder<indexer::domain_record> large("test_index", 1, 1000);
+
+		for (uint64_t value = 0; value < 100; value++) {
+			small.add(1, indexer::domain_record(value, (float)(value % 10)));
+		}
+		for (uint64_t value = 0; value < 10000; value++) {
+			large.add(1, indexer::domain_record(value, (float)(value % 100)));
+		}
+
+		small.append();
+		small.merge();
+		large.append();
+		large.merge();
+	}
+
+	{
+		indexer::index<indexer::domain_record> small("test_index", 0, 1000);
+		indexer::index<indexer::domain_record> large("test_index", 1, 1000);
+
+		auto score_mod = [](const indexer::domain_record &rec) { return (float)(rec.m_value % 7); };
+
+		size_t total = 0;
+		auto expected = small.find_top(total, {1}, 10, score_mod);
+
+		// score_mod runs find_top on a larger index on the same thread.
+		size_t nested_total = 0;
+		auto nested_score_mod = [&](const indexer::domain_record &rec) {
+			size_t large_total = 0;
+			large.find_top(large_total, {1}, 5, [](const indexer::domain_record &) { return 0.0f; });
+			nested_total += large_total;
+			return (float)(rec.m_value % 7);
+		};
+		auto res = small.find_top(total, {1}, 10, nested_score_mod);
+
+		BOOST_CHECK_EQUAL(nested_total, 100 * 10000);
+		BOOST_REQUIRE_EQUAL(res.size(), expected.size());
+		for (size_t i = 0; i < res.size(); i++) {
+			BOOST_CHECK_EQUAL(res[i].m_value, expected[i].m_value);
+			BOOST_CHECK_EQUAL(res[i].m_score, expected[i].m_score);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_rebuild_clears_result_cache) {
+
+	file::delete_directory("./0/full_text/test_index");
+	file::create_directory("./0/full_text/test_index");
+
+	// Checked on every call, the servers check at most once per second.
+	indexer::index_generation_watch index_generation(std::chrono::milliseconds(0));
+	indexer::index_generation_watch slow_index_generation(std::chrono::hours(1));
+
+	utils::sharded_lru_cache<std::string, std::string> result_cache(1024 * 1024);
+	result_cache.put("query", "cached response");
+
+	BOOST_CHECK(!index_generation.changed());
+
+	{
+		indexer::index_builder<indexer::domain_record> idx("test_index", 0, 1000);
+		idx.add(1, indexer::domain_record(1, 1.0f));
+		idx.append();
+		idx.merge();
+	}
+
+	// What the search server does before every query.
+	if (index_generation.changed()) {
+		result_cache.clear();
+	}
+
+	std::string cached;
+	BOOST_CHECK(!result_cache.get("query", cached));
+	BOOST_CHECK(!index_generation.changed());
+	BOOST_CHECK(!slow_index_generation.changed());
+
+	result_cache.put("query", "cached response");
+	{
+		indexer::index_builder<indexer::domain_record> idx("test_index", 0, 1000);
+		idx.truncate();
+	}
+	if (index_generation.changed()) {
+		result_cache.clear();
+	}
+	BOOST_CHECK(!result_cache.get("query", cached));
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_external_runs) {
+
+	file::delete_directory("./0/full_text/test_index");
+	file::create_directory("./0/full_text/test_index");
+
+	// Small enough to spill several sorted runs.
+	const size_t budget = config::index_merge_memory_mb;
+	config::index_merge_memory_mb = 1;
+
+	std::map<uint64_t, std::set<uint64_t>> expected;
+
+	for (size_t round = 0; round < 2; round++) {
+		indexer::index_builder<indexer::value_record> idx("test_index", 0, 1000);
+
+		for (uint64_t i = 0; i < 20000; i++) {
+			const uint64_t key = (i * 7919 + round) % 3001;
+			const uint64_t value = 100000 + (i * 104729 + round) % 5000;
+			idx.add(key, indexer::value_record(value));
+			expected[key].insert(value);
+		}
+
+		idx.append();
+		idx.merge();
+	}
+
+	config::index_merge_memory_mb = budget;
+
+	BOOST_CHECK(!file::file_exists("./0/full_text/test_index/0.cache.run0"));
+
+	indexer::index<indexer::value_record> idx("test_index", 0, 1000);
+	for (const auto &iter : expected) {
+		std::vector<indexer::value_record> res = idx.find(iter.first);
+		BOOST_REQUIRE_EQUAL(res.size(), iter.second.size());
+		std::set<uint64_t> values;
+		for (const auto &rec : res) values.insert(rec.m_value);
+		BOOST_CHECK(values == iter.second);
+	}
+	BOOST_CHECK_EQUAL(idx.find(3001).size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_external_sorter) {
+
+	struct item {
+		uint64_t m_key;
+		uint64_t m_data;
+	};
+
+	std::map<uint64_t, size_t> counts;
+	{
+		indexer::external_sorter<item> sorter("./0/full_text/test_sorter", 100, 1024);
+		for (uint64_t i = 0; i < 10000; i++) {
+			const uint64_t key = (i * 7919) % 1237;
+			sorter.add(item{key, i});
+			counts[key]++;
+		}
+		sorter.finish();
+
+		BOOST_CHECK_EQUAL(sorter.num_runs(), 10);
+		BOOST_CHECK(file::file_exists("./0/full_text/test_sorter.run9"));
+
+		uint64_t key, prev_key = 0;
+		std::vector<item> items;
+		size_t num_keys = 0;
+		while (sorter.next(key, items)) {
+			if (num_keys) BOOST_CHECK(sorter.less(prev_key, key));
+			BOOST_CHECK_EQUAL(items.size(), counts[key]);
+			prev_key = key;
+			num_keys++;
+		}
+		BOOST_CHECK_EQUAL(num_keys, counts.size());
+	}
+	BOOST_CHECK(!file::file_exists("./0/full_text/test_sorter.run0"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,183 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include "api/json_writer.h"
+#include "api/api_response.h"
+#include "api/result_with_snippet.h"
+#include "full_text/search_metric.h"
+#include "parser/unicode.h"
+#include "json.hpp"
+#include <random>
+#include <cstring>
+
+BOOST_AUTO_TEST_SUITE(test_json_writer)
+
+BOOST_AUTO_TEST_CASE(golden) {
+
+	std::string out;
+	api::json_writer writer(out);
+	writer.begin_object();
+	writer.key("string");
+	writer.value("quote \" backslash \\ slash / tab \t newline \n control \x01 \x1f unicode åäö 日本");
+	writer.key("numbers");
+	writer.begin_array();
+	writer.value((size_t)0);
+	writer.value((size_t)18446744073709551615ull);
+	writer.value(0.0);
+	writer.value(1.0);
+	writer.value(-2.5);
+	writer.value(0.001);
+	writer.value(0.0001);
+	writer.value(123456789012345.0);
+	writer.value(1234567890123456.0);
+	writer.value(1e100);
+	writer.value((double)0.1f);
+	writer.end_array();
+	writer.key("empty_object");
+	writer.begin_object();
+	writer.end_object();
+	writer.key("empty_array");
+	writer.begin_array();
+	writer.end_array();
+	writer.key("null");
+	writer.null();
+	writer.end_object();
+
+	const std::string expected = "{\"string\":\"quote \\\" backslash \\\\ slash / tab \\t newline \\n control \\u0001 "
+		"\\u001f unicode åäö 日本\",\"numbers\":[0,18446744073709551615,0.0,1.0,-2.5,0.001,0.0001,123456789012345.0,"
+		"1.234567890123456e+15,1e+100,0.10000000149011612],\"empty_object\":{},\"empty_array\":[],\"null\":null}";
+	BOOST_CHECK_EQUAL(out, expected);
+
+	// Same as nlohmann.
+	BOOST_CHECK_EQUAL(out, nlohmann::ordered_json::parse(out).dump());
+}
+
+BOOST_AUTO_TEST_CASE(doubles_like_nlohmann) {
+
+	std::mt19937_64 gen(42);
+	std::uniform_real_distribution<double> mantissa(-10.0, 10.0);
+	std::uniform_int_distribution<int> exponent(-30, 30);
+
+	size_t num_different = 0;
+	for (size_t i = 0; i < 100000; i++) {
+		double number = mantissa(gen) * std::pow(10.0, exponent(gen));
+		if (i % 2) number = (double)(float)number;
+		if (i % 3 == 0) number = std::round(number);
+
+		std::string out;
+		api::json_writer writer(out);
+		writer.value(number);
+
+		// Reads back as the same value, in the same notation and never longer than nlohmann.
+		const std::string expected = nlohmann::json(number).dump();
+		if (std::stod(out) != number || out.size() > expected.size() ||
+				(out.find('e') == std::string::npos) != (expected.find('e') == std::string::npos)) {
+			BOOST_CHECK_EQUAL(out, expected);
+			break;
+		}
+		if (out != expected) num_different++;
+	}
+	BOOST_CHECK(num_different < 1000);
+}
+
+BOOST_AUTO_TEST_CASE(api_response_like_nlohmann) {
+
+	std::vector<api::result_with_snippet> results;
+	for (size_t i = 0; i < 10; i++) {
+		indexer::return_record rec;
+		rec.m_value = i;
+		rec.m_score = 0.1f * i;
+		rec.m_domain_hash = 1000 + i;
+		results.emplace_back("https://www.example.com/page" + std::to_string(i) + "\tTitle \"" + std::to_string(i) +
+			"\"\th1\tmeta text\tThe snippet with a \\ and åäö in it.", rec);
+	}
+
+	full_text::search_metric metric;
+	metric.m_total_found = 123;
+	metric.m_total_url_links_found = 1;
+	metric.m_total_domain_links_found = 2;
+	metric.m_links_handled = 3;
+	metric.m_link_domain_matches = 4;
+	metric.m_link_url_matches = 5;
+
+	// How the response was built before json_writer.
+	auto nlohmann_response = [&metric](const std::vector<api::result_with_snippet> &results, double profile) {
+		nlohmann::ordered_json message;
+		nlohmann::ordered_json result_array;
+		for (const api::result_with_snippet &result : results) {
+			nlohmann::ordered_json json_result;
+			json_result["url"] = result.url().str();
+			json_result["title"] = parser::unicode::encode(result.title());
+			json_result["snippet"] = parser::unicode::encode(result.snippet());
+			json_result["score"] = result.score();
+			json_result["domain_hash"] = std::to_string(result.domain_hash());
+			json_result["url_hash"] = std::to_string(result.url().hash());
+			result_array.push_back(json_result);
+		}
+		message["status"] = "success";
+		message["time_ms"] = profile;
+		message["total_found"] = metric.m_total_found;
+		message["total_url_links_found"] = metric.m_total_url_links_found;
+		message["total_domain_links_found"] = metric.m_total_domain_links_found;
+		message["links_handled"] = metric.m_links_handled;
+		message["link_domain_matches"] = metric.m_link_domain_matches;
+		message["link_url_matches"] = metric.m_link_url_matches;
+		message["results"] = result_array;
+		return message.dump();
+	};
+
+	// The scores of these results are written with the same digits by both.
+	std::stringstream ss;
+	ss << api::api_response(results, metric, 12.345);
+	BOOST_CHECK_EQUAL(ss.str(), nlohmann_response(results, 12.345));
+
+	std::vector<api::result_with_snippet> no_results;
+	std::stringstream ss_empty;
+	ss_empty << api::api_response(no_results, metric, 0.5);
+	BOOST_CHECK_EQUAL(ss_empty.str(), nlohmann_response(no_results, 0.5));
+}
+
+BOOST_AUTO_TEST_CASE(api_response_with_time_ms) {
+
+	std::vector<api::result_with_snippet> results;
+	indexer::return_record rec;
+	rec.m_value = 1;
+	rec.m_score = 0.5f;
+	results.emplace_back("https://www.example.com/\ttitle, with \"time_ms\":1,\th1\tmeta\tsnippet", rec);
+	full_text::search_metric metric;
+	metric.m_total_found = 1;
+
+	std::stringstream cached;
+	cached << api::api_response(results, metric, 12.345);
+	std::stringstream expected;
+	expected << api::api_response(results, metric, 0.25);
+
+	BOOST_CHECK_EQUAL(api::api_response::with_time_ms(cached.str(), 0.25), expected.str());
+	BOOST_CHECK_EQUAL(nlohmann::json::parse(api::api_response::with_time_ms(cached.str(), 1.5))["time_ms"], 1.5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
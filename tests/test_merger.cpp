@@ -0,0 +1,83 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include "indexer/merger.h"
+#include <atomic>
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(test_merger)
+
+BOOST_AUTO_TEST_CASE(test_flush_error_is_rethrown) {
+	bool fail = true;
+	size_t num_appends = 0;
+	indexer::merger::register_appender(1, [&fail, &num_appends]() {
+		if (fail) throw std::runtime_error("disk full");
+		num_appends++;
+	}, []() { return 0; });
+
+	BOOST_CHECK_THROW(indexer::merger::force_append(), std::runtime_error);
+
+	fail = false;
+	indexer::merger::force_append();
+	BOOST_CHECK_EQUAL(num_appends, 1);
+
+	indexer::merger::deregister_merger(1);
+	indexer::merger::force_append();
+	BOOST_CHECK_EQUAL(num_appends, 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_high_watermark_flushes_own_builder) {
+	std::atomic<size_t> size = 0;
+	std::atomic<size_t> num_appends = 0;
+	std::atomic<size_t> other_appends = 0;
+	auto app = indexer::merger::register_appender(1, [&size, &num_appends]() {
+		num_appends++;
+		size = 0;
+	}, [&size]() { return size.load(); });
+	indexer::merger::register_appender(2, [&other_appends]() { other_appends++; }, []() { return 0; });
+
+	// Limit of zero bytes, every builder with data is over its high-watermark.
+	indexer::merger::set_mem_limit(0.0);
+	indexer::merger::start_merge_thread();
+
+	for (size_t i = 0; i < 100 * indexer::merger::size_report_interval; i++) {
+		indexer::merger::lock(*app);
+		size += 100;
+	}
+
+	// Every size report after the first one saw a full cache and flushed it before returning.
+	BOOST_CHECK_EQUAL(num_appends, 99);
+	BOOST_CHECK_EQUAL(other_appends, 0);
+
+	indexer::merger::terminate_merge_thread();
+	indexer::merger::set_mem_limit(0.4);
+
+	indexer::merger::deregister_merger(1);
+	indexer::merger::deregister_merger(2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include "utils/sharded_lru_cache.h"
+#include <thread>
+#include <atomic>
+
+BOOST_AUTO_TEST_SUITE(test_sharded_lru_cache)
+
+BOOST_AUTO_TEST_CASE(get_and_put) {
+	utils::sharded_lru_cache<uint64_t, std::string> cache(100, 1, [](const std::string &value) { return value.size(); });
+
+	std::string value;
+	BOOST_CHECK(!cache.get(1, value));
+
+	cache.put(1, std::string(40, 'a'));
+	cache.put(2, std::string(40, 'b'));
+	BOOST_CHECK(cache.get(1, value));
+	BOOST_CHECK_EQUAL(value, std::string(40, 'a'));
+
+	// 2 is the least recently used.
+	cache.put(3, std::string(40, 'c'));
+	BOOST_CHECK(!cache.get(2, value));
+	BOOST_CHECK(cache.get(1, value));
+	BOOST_CHECK(cache.get(3, value));
+
+	// Replacing a value updates the size.
+	cache.put(3, std::string(10, 'd'));
+	BOOST_CHECK(cache.get(3, value));
+	BOOST_CHECK_EQUAL(value, std::string(10, 'd'));
+
+	// Larger than the capacity, not cached.
+	cache.put(4, std::string(101, 'e'));
+	BOOST_CHECK(!cache.get(4, value));
+
+	auto stats = cache.get_stats();
+	BOOST_CHECK_EQUAL(stats.m_hits, 4);
+	BOOST_CHECK_EQUAL(stats.m_misses, 3);
+	BOOST_CHECK_EQUAL(stats.m_entries, 2);
+	BOOST_CHECK_EQUAL(stats.m_size, 50);
+	BOOST_CHECK_EQUAL(stats.m_capacity, 100);
+
+	cache.clear();
+	BOOST_CHECK(!cache.get(1, value));
+	BOOST_CHECK_EQUAL(cache.get_stats().m_size, 0);
+}
+
+BOOST_AUTO_TEST_CASE(capacity_zero) {
+	utils::sharded_lru_cache<uint64_t, std::string> cache(0);
+
+	std::string value;
+	cache.put(1, "a");
+	BOOST_CHECK(!cache.get(1, value));
+	BOOST_CHECK_EQUAL(cache.get_stats().m_entries, 0);
+}
+
+BOOST_AUTO_TEST_CASE(max_entries) {
+	// Small entries that fit the byte capacity many times over, the entry limit evicts them.
+	utils::sharded_lru_cache<uint64_t, std::string> cache(1000000, 1, [](const std::string &value) { return value.size(); },
+		3);
+
+	std::string value;
+	for (uint64_t key = 1; key <= 5; key++) {
+		cache.put(key, "a");
+	}
+	BOOST_CHECK_EQUAL(cache.get_stats().m_entries, 3);
+	BOOST_CHECK(!cache.get(1, value));
+	BOOST_CHECK(!cache.get(2, value));
+	BOOST_CHECK(cache.get(3, value));
+	BOOST_CHECK(cache.get(5, value));
+
+	// Split over the shards, at least one per shard.
+	utils::sharded_lru_cache<uint64_t, std::string> sharded(1000000, 16, [](const std::string &value) { return value.size(); },
+		32);
+	for (uint64_t key = 0; key < 1000; key++) {
+		sharded.put(key, "a");
+	}
+	BOOST_CHECK(sharded.get_stats().m_entries <= 32);
+}
+
+BOOST_AUTO_TEST_CASE(threads) {
+	utils::sharded_lru_cache<uint64_t, uint64_t> cache(1000, 16);
+
+	std::atomic<size_t> wrong_values = 0;
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < 8; t++) {
+		threads.emplace_back([&cache, &wrong_values]() {
+			for (uint64_t key = 0; key < 10000; key++) {
+				uint64_t value;
+				if (cache.get(key, value)) {
+					if (value != key * 2) wrong_values++;
+				} else {
+					cache.put(key, key * 2);
+				}
+			}
+		});
+	}
+	for (auto &thread : threads) thread.join();
+
+	BOOST_CHECK_EQUAL(wrong_values, 0);
+	auto stats = cache.get_stats();
+	BOOST_CHECK_EQUAL(stats.m_hits + stats.m_misses, 80000);
+	BOOST_CHECK(stats.m_entries <= 1000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
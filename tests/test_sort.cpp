@@ -26,7 +26,9 @@
 
 #include <boost/test/unit_test.hpp>
 #include "algorithm/sort.h"
+#include "algorithm/radix_sort.h"
 #include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -181,4 +183,43 @@ BOOST_AUTO_TEST_CASE(merge_many_arrays_of_struct) {
 
 }
 
+BOOST_AUTO_TEST_CASE(merge_many_random_arrays) {
+
+	srand(1);
+	for (size_t num_arrays : {1, 2, 5, 32, 256}) {
+		vector<vector<int>> inp(num_arrays);
+		vector<int> corr;
+		for (auto &arr : inp) {
+			const size_t len = rand() % 50;
+			for (size_t i = 0; i < len; i++) arr.push_back(rand() % 1000);
+			std::sort(arr.begin(), arr.end());
+			corr.insert(corr.end(), arr.begin(), arr.end());
+		}
+		std::sort(corr.begin(), corr.end());
+
+		vector<int> res;
+		algorithm::sort::merge_arrays(inp, res);
+
+		BOOST_CHECK(res == corr);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(radix_sort) {
+
+	srand(3);
+	vector<pair<uint64_t, int>> items;
+	for (int i = 0; i < 5000; i++) {
+		items.emplace_back(((uint64_t)rand() << 32) ^ (uint64_t)(rand() % 100), i);
+	}
+	vector<pair<uint64_t, int>> corr = items;
+	std::stable_sort(corr.begin(), corr.end(), [](const auto &a, const auto &b) {
+		return a.first < b.first;
+	});
+
+	vector<pair<uint64_t, int>> tmp;
+	algorithm::radix_sort(items, tmp, [](const auto &a) { return a.first; });
+
+	BOOST_CHECK(items == corr);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -26,6 +26,9 @@
 
 #include <boost/test/unit_test.hpp>
 #include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
 #include "algorithm/sum_sorted.h"
 #include "indexer/counted_record.h"
 
@@ -131,4 +134,56 @@ BOOST_AUTO_TEST_CASE(test_sum_sorted5) {
 	BOOST_CHECK(res[2] == 3);
 }
 
+BOOST_AUTO_TEST_CASE(test_sum_sorted_many) {
+
+	srand(1);
+	for (size_t num_vectors : {2, 7, 64, 200}) {
+		vector<vector<indexer::counted_record>> sorted(num_vectors);
+		map<uint64_t, float> expected;
+		for (auto &vec : sorted) {
+			set<uint64_t> values;
+			const size_t len = rand() % 100;
+			while (values.size() < len) values.insert(rand() % 500);
+			for (uint64_t value : values) {
+				vec.emplace_back(indexer::counted_record(value, 1.0f));
+				expected[value] += 1.0f;
+			}
+		}
+		vector<indexer::counted_record> res = ::algorithm::sum_sorted<indexer::counted_record>(sorted,
+				[](indexer::counted_record &a, const indexer::counted_record &b) {
+			a.m_score += b.m_score;
+		});
+
+		BOOST_REQUIRE_EQUAL(res.size(), expected.size());
+		size_t i = 0;
+		for (const auto &iter : expected) {
+			BOOST_CHECK_EQUAL(res[i].m_value, iter.first);
+			BOOST_CHECK_EQUAL(res[i].m_score, iter.second);
+			i++;
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_sum_sorted_scan_and_tree) {
+
+	// Both implementations must give the same result, also when a vector holds duplicates.
+	srand(2);
+	vector<vector<int>> sorted(40);
+	for (auto &vec : sorted) {
+		const size_t len = rand() % 30;
+		for (size_t i = 0; i < len; i++) vec.push_back(rand() % 50);
+		std::sort(vec.begin(), vec.end());
+	}
+	auto plus_eq = [](int &a, const int &b) {
+		a += b;
+	};
+	vector<int> res1;
+	vector<int> res2;
+	::algorithm::sum_sorted_scan<int>(sorted, plus_eq, res1);
+	::algorithm::sum_sorted_tree<int>(sorted, plus_eq, res2);
+
+	BOOST_CHECK(res1.size() > 50);
+	BOOST_CHECK(res1 == res2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -51,6 +51,34 @@ BOOST_AUTO_TEST_CASE(get_full_text_words) {
 	}
 }
 
+BOOST_AUTO_TEST_CASE(get_words_into_buffer) {
+	string buffer;
+	vector<string_view> words;
+
+	const string text = "Hej, Example.com är bra!! x-y ... " + string(150, 'a') + " slut";
+	text::get_full_text_words(text, buffer, words);
+	BOOST_CHECK(vector<string>(words.begin(), words.end()) == text::get_full_text_words(text));
+	BOOST_CHECK_EQUAL(words.size(), 6);
+	BOOST_CHECK_EQUAL(words[1], "example.com");
+
+	text::get_expanded_full_text_words(text, buffer, words);
+	BOOST_CHECK(vector<string>(words.begin(), words.end()) == text::get_expanded_full_text_words(text));
+	BOOST_CHECK_EQUAL(words.size(), 10);
+	BOOST_CHECK_EQUAL(words[2], "example");
+	BOOST_CHECK_EQUAL(words[3], "com");
+
+	// The buffer and the words are reused.
+	text::get_expanded_full_text_words("Second Text", buffer, words, 1);
+	BOOST_REQUIRE_EQUAL(words.size(), 1);
+	BOOST_CHECK_EQUAL(words[0], "second");
+
+	vector<uint64_t> hashes;
+	text::words_to_ngram_hash(vector<string_view>{"a", "b.c"}, 2, [&hashes](uint64_t hash) {
+		hashes.push_back(hash);
+	});
+	BOOST_CHECK(hashes == vector<uint64_t>({algorithm::hash("a"), algorithm::hash("a b.c"), algorithm::hash("b.c")}));
+}
+
 BOOST_AUTO_TEST_CASE(get_tokens) {
 	vector<uint64_t> tokens = text::get_tokens("My name is Josef Cullhed");
 
@@ -63,6 +91,12 @@ BOOST_AUTO_TEST_CASE(get_tokens) {
 	};
 
 	BOOST_CHECK(tokens == targets);
+
+	// NUL ends a token.
+	tokens = text::get_tokens(string("abc\0def", 7));
+	targets = {algorithm::hash("abc"), algorithm::hash("def")};
+
+	BOOST_CHECK(tokens == targets);
 }
 
 BOOST_AUTO_TEST_CASE(get_tokens2) {
@@ -0,0 +1,206 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include "server/url_server_client.h"
+#include "server/url_server_protocol.h"
+#include "http/epoll_server.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <thread>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+BOOST_AUTO_TEST_SUITE(test_url_server_client)
+
+/*
+ * Runs a fake url server in a child process. It answers every domain hash with one url record, with the node id as
+ * score. For the query "slow" the domains with odd hashes are sent 2 seconds after the others.
+ * */
+pid_t start_node(size_t node_id, size_t port) {
+	const pid_t pid = fork();
+	if (pid != 0) return pid;
+
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	http::epoll_server srv([node_id](const http::request &req) {
+		URL url = req.url();
+		const bool slow = url.query()["q"] == "slow";
+
+		const std::string req_body = req.request_body();
+		std::vector<uint64_t> domain_hashes(req_body.size() / sizeof(uint64_t));
+		memcpy(domain_hashes.data(), req_body.data(), domain_hashes.size() * sizeof(uint64_t));
+
+		http::response res;
+		res.content_type("application/octet-stream");
+		res.body_writer([node_id, slow, domain_hashes](const http::response::write_function &write) {
+			write(server::url_protocol_header());
+			for (size_t odd = 0; odd < 2; odd++) {
+				if (odd && slow) std::this_thread::sleep_for(std::chrono::seconds(2));
+				for (uint64_t domain_hash : domain_hashes) {
+					if (domain_hash % 2 != odd) continue;
+					write(server::url_domain_frame(domain_hash, 10, {indexer::url_record(domain_hash * 100, node_id)}));
+				}
+			}
+			write(server::url_end_frame(domain_hashes.size()));
+		});
+		return res;
+	}, "127.0.0.1", port, 1, 1024 * 1024);
+	srv.run();
+	_exit(0);
+}
+
+void stop_nodes(const std::vector<pid_t> &pids) {
+	for (pid_t pid : pids) {
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(scatter_gather) {
+
+	const size_t base_port = 18941;
+	std::vector<pid_t> pids;
+	std::vector<std::string> nodes;
+	for (size_t node_id = 0; node_id < 3; node_id++) {
+		pids.push_back(start_node(node_id, base_port + node_id));
+		nodes.push_back("127.0.0.1:" + std::to_string(base_port + node_id));
+	}
+
+	server::url_server_client client(nodes, 1000);
+	BOOST_CHECK_EQUAL(client.num_nodes(), 3);
+
+	std::vector<uint64_t> domain_hashes;
+	for (uint64_t domain_hash = 1; domain_hash <= 20; domain_hash++) {
+		domain_hashes.push_back(domain_hash);
+	}
+
+	// The nodes need a moment to start listening.
+	bool complete = false;
+	size_t total_num_results = 0;
+	std::map<uint64_t, std::vector<indexer::url_record>> results;
+	for (size_t attempt = 0; attempt < 50 && !complete; attempt++) {
+		if (attempt) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		results.clear();
+		complete = client.find("test query", 5, domain_hashes, total_num_results, results);
+	}
+
+	BOOST_REQUIRE(complete);
+	BOOST_CHECK_EQUAL(total_num_results, 200);
+	BOOST_REQUIRE_EQUAL(results.size(), 20);
+	for (const auto &[domain_hash, records] : results) {
+		BOOST_REQUIRE_EQUAL(records.size(), 1);
+		BOOST_CHECK_EQUAL(records[0].m_value, domain_hash * 100);
+		BOOST_CHECK_EQUAL(records[0].m_score, (float)(domain_hash % 3));
+	}
+
+	// Repeated queries go over the pooled connections.
+	for (size_t i = 0; i < 10; i++) {
+		results.clear();
+		BOOST_CHECK(client.find("test query", 5, domain_hashes, total_num_results, results));
+		BOOST_CHECK_EQUAL(results.size(), 20);
+	}
+
+	// Slow domains are cut off by the timeout, the domains that were sent before are kept.
+	server::url_server_client slow_client(nodes, 300);
+	const auto start = std::chrono::steady_clock::now();
+	results.clear();
+	BOOST_CHECK(!slow_client.find("slow", 5, {2, 3, 4, 5}, total_num_results, results));
+	BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(1500));
+	BOOST_CHECK_EQUAL(results.size(), 2);
+	BOOST_CHECK_EQUAL(results.count(2), 1);
+	BOOST_CHECK_EQUAL(results.count(4), 1);
+	BOOST_CHECK_EQUAL(total_num_results, 20);
+
+	stop_nodes(pids);
+
+	// All nodes down.
+	results.clear();
+	BOOST_CHECK(!client.find("test query", 5, domain_hashes, total_num_results, results));
+	BOOST_CHECK_EQUAL(results.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(frame_reader) {
+
+	const std::string response = server::url_protocol_header() +
+		server::url_domain_frame(123, 7, {indexer::url_record(1, 0.5f), indexer::url_record(2, 1.0f)}) +
+		server::url_domain_frame(456, 0, {}) +
+		server::url_end_frame(2);
+
+	// Fed one byte at a time.
+	{
+		size_t total_num_results = 0;
+		std::map<uint64_t, std::vector<indexer::url_record>> results;
+		server::url_frame_reader reader(results, total_num_results);
+		for (size_t i = 0; i < response.size(); i++) {
+			BOOST_REQUIRE(reader.consume(response.data() + i, 1));
+			BOOST_CHECK_EQUAL(reader.done(), i == response.size() - 1);
+		}
+		BOOST_CHECK_EQUAL(total_num_results, 7);
+		BOOST_CHECK_EQUAL(results.size(), 2);
+		BOOST_REQUIRE_EQUAL(results[123].size(), 2);
+		BOOST_CHECK_EQUAL(results[123][1].m_value, 2);
+		BOOST_CHECK_EQUAL(results[123][1].m_score, 1.0f);
+		BOOST_CHECK_EQUAL(results[456].size(), 0);
+	}
+
+	// A truncated response is not done, but the complete frames are used.
+	{
+		size_t total_num_results = 0;
+		std::map<uint64_t, std::vector<indexer::url_record>> results;
+		server::url_frame_reader reader(results, total_num_results);
+		BOOST_CHECK(reader.consume(response.data(), response.size() - 1));
+		BOOST_CHECK(!reader.done());
+		BOOST_CHECK_EQUAL(results.size(), 2);
+	}
+
+	// Wrong version.
+	{
+		std::string old_response = response;
+		old_response[4] = 0;
+		size_t total_num_results = 0;
+		std::map<uint64_t, std::vector<indexer::url_record>> results;
+		server::url_frame_reader reader(results, total_num_results);
+		BOOST_CHECK(!reader.consume(old_response.data(), old_response.size()));
+		BOOST_CHECK(reader.error());
+		BOOST_CHECK_EQUAL(results.size(), 0);
+	}
+
+	// End frame with the wrong number of domains.
+	{
+		const std::string bad_response = server::url_protocol_header() + server::url_domain_frame(123, 7, {}) +
+			server::url_end_frame(2);
+		size_t total_num_results = 0;
+		std::map<uint64_t, std::vector<indexer::url_record>> results;
+		server::url_frame_reader reader(results, total_num_results);
+		BOOST_CHECK(!reader.consume(bad_response.data(), bad_response.size()));
+		BOOST_CHECK(!reader.done());
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
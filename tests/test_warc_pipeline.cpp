@@ -0,0 +1,179 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include "warc/pipeline.h"
+#include "warc/warc.h"
+#include "file/file.h"
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <fstream>
+#include <mutex>
+#include <map>
+#include <set>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(warc_pipeline)
+
+namespace {
+
+	const string test_dir = "/tmp/alexandria_test_warc_pipeline";
+
+	string gzip_warc_record(const string &type, const string &url, const string &content) {
+		const string record = "WARC/1.0\r\nWARC-Type: " + type + "\r\nWARC-Date: 2021-01-01T00:00:00Z\r\n"
+			"WARC-IP-Address: 1.2.3.4\r\nWARC-Target-URI: " + url + "\r\nContent-Length: " + to_string(content.size()) +
+			"\r\n\r\n" + content + "\r\n\r\n";
+
+		stringstream compressed;
+		{
+			boost::iostreams::filtering_ostream out;
+			out.push(boost::iostreams::gzip_compressor());
+			out.push(compressed);
+			out << record;
+		}
+		return compressed.str();
+	}
+
+	string response(const string &title, const string &body) {
+		return "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n<html><head><title>" + title +
+			"</title></head><body><h1>Heading</h1>" + body + "</body></html>";
+	}
+
+	/*
+	 * A warc file with num_pages pages and a request and a page on an unknown tld between them.
+	 * */
+	string warc_file(size_t file, size_t num_pages) {
+		string warc = gzip_warc_record("warcinfo", "", "software: test\r\n");
+		for (size_t i = 0; i < num_pages; i++) {
+			const string url = "https://www.example" + to_string(file) + ".com/page" + to_string(i);
+			warc += gzip_warc_record("request", url, "GET /page HTTP/1.1\r\n\r\n");
+			warc += gzip_warc_record("response", url, response("Page " + to_string(i), "<p>Text " +
+				string(i * 100, 'a') + "</p>"));
+			warc += gzip_warc_record("response", "https://www.example.unknowntld/" + to_string(i), response("Unknown", "x"));
+		}
+		return warc;
+	}
+
+	void write_file(const string &path, const string &data) {
+		ofstream out(test_dir + "/" + path, ios::binary | ios::trunc);
+		out << data;
+	}
+
+}
+
+BOOST_AUTO_TEST_CASE(local_directory) {
+
+	file::delete_directory(test_dir);
+	file::create_directory(test_dir);
+
+	const size_t num_files = 4;
+	const size_t num_pages = 30;
+
+	vector<string> paths;
+	for (size_t file = 0; file < num_files; file++) {
+		paths.push_back("file" + to_string(file) + ".warc.gz");
+		write_file(paths.back(), warc_file(file, num_pages));
+	}
+
+	// A file that does not exist and one that ends in the middle of its last gzip member both fail, the complete
+	// records of the truncated file are still written.
+	paths.push_back("missing.warc.gz");
+	const string truncated = warc_file(num_files, 5);
+	paths.push_back("truncated.warc.gz");
+	write_file(paths.back(), truncated.substr(0, truncated.size() - 10));
+
+	warc::directory_source source(test_dir);
+
+	// Small ranges so the records are split over ranges and the queues fill up.
+	warc::pipeline::options options;
+	options.m_download_threads = 3;
+	options.m_inflate_threads = 2;
+	options.m_parse_threads = 3;
+	options.m_write_threads = 2;
+	options.m_range_size = 1000;
+	options.m_ranges_ahead = 2;
+	options.m_queue_len = 4;
+	warc::pipeline pipeline(source, options);
+
+	mutex lock;
+	map<size_t, set<string>> pages;
+	map<size_t, size_t> pages_when_done;
+	set<size_t> writer_ids;
+	pipeline.run(paths, [&](size_t writer_id, const warc::page &page) {
+		lock_guard guard(lock);
+		BOOST_CHECK(pages_when_done.count(page.m_file) == 0);
+		BOOST_CHECK(pages[page.m_file].insert(page.m_url).second);
+		BOOST_CHECK_EQUAL(page.m_ip, "1.2.3.4");
+		BOOST_CHECK_EQUAL(page.m_date, "2021-01-01T00:00:00Z");
+		BOOST_CHECK_EQUAL(page.m_h1, "Heading");
+		BOOST_CHECK_EQUAL(page.m_title, "Page " + page.m_url.substr(page.m_url.find("/page") + 5));
+		writer_ids.insert(writer_id);
+	}, [&](size_t file) {
+		lock_guard guard(lock);
+		BOOST_CHECK(pages_when_done.count(file) == 0);
+		pages_when_done[file] = pages[file].size();
+	});
+
+	BOOST_CHECK_EQUAL(pages_when_done.size(), paths.size());
+	for (size_t file = 0; file < num_files; file++) {
+		BOOST_CHECK_EQUAL(pages[file].size(), num_pages);
+		BOOST_CHECK_EQUAL(pages_when_done[file], num_pages);
+	}
+	BOOST_CHECK_EQUAL(pages_when_done[num_files], 0);
+	BOOST_CHECK_EQUAL(pages_when_done[num_files + 1], 5);
+	BOOST_CHECK_EQUAL(pipeline.num_failed_files(), 2);
+	for (size_t writer_id : writer_ids) {
+		BOOST_CHECK(writer_id < options.m_write_threads);
+	}
+
+	const auto stats = pipeline.get_stats();
+	BOOST_REQUIRE_EQUAL(stats.size(), 4);
+	BOOST_CHECK_EQUAL(stats[0].m_name, "download");
+	BOOST_CHECK_EQUAL(stats[1].m_processed, num_files * (1 + num_pages * 3) + 1 + 5 * 3 - 1);
+	BOOST_CHECK_EQUAL(stats[2].m_processed, stats[1].m_processed);
+	BOOST_CHECK_EQUAL(stats[3].m_processed, num_files * num_pages + 5);
+	for (const auto &stage : stats) {
+		BOOST_CHECK_EQUAL(stage.m_queue_len, 0);
+	}
+	BOOST_CHECK(stats[0].m_max_queue_len <= options.m_queue_len);
+	BOOST_CHECK(stats[2].m_max_queue_len <= options.m_queue_len);
+	BOOST_CHECK(stats[1].m_max_queue_len <= options.m_inflate_threads * (options.m_ranges_ahead + 1));
+
+	// The same pages as the sequential parser.
+	ifstream file_stream(test_dir + "/file0.warc.gz", ios::binary);
+	set<string> sequential_pages;
+	warc::parser pp;
+	pp.parse_stream(file_stream, [&sequential_pages](const string &url, const ::parser::html_parser &, const string &,
+			const string &) {
+		sequential_pages.insert(url);
+	});
+	BOOST_CHECK(sequential_pages == pages[0]);
+
+	file::delete_directory(test_dir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()